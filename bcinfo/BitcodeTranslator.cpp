@@ -26,15 +26,24 @@
 #define LOG_TAG "bcinfo"
 #include <cutils/log.h>
 
+#include "llvm/ADT/ArrayRef.h"
 #include "llvm/Bitcode/BitstreamWriter.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/LLVMContext.h"
 #include "llvm/IR/Module.h"
+#include "llvm/Support/MD5.h"
 #include "llvm/Support/MemoryBuffer.h"
 #include "llvm/Support/raw_ostream.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <climits>
+#include <cstring>
+#include <list>
+#include <mutex>
 
 namespace bcinfo {
 
@@ -67,6 +76,172 @@ static const unsigned int kMinimumUntranslatedVersion = 16;
 static const unsigned int kMinimumCompatibleVersion_LLVM_3_0 = 14;
 static const unsigned int kMinimumCompatibleVersion_LLVM_2_7 = 11;
 
+/**
+ * Version of the translation itself. Bump it whenever translate() produces
+ * different bitcode for the same input (e.g. after a change to a reader or to
+ * the writer), so that the cached translations are not reused.
+ */
+static const unsigned int kTranslatorVersion = 1;
+
+/**
+ * Upper bound of the bytes of translated bitcode kept in memory. The least
+ * recently used translations are dropped first.
+ */
+static const size_t kTranslationCacheLimit = 4 * 1024 * 1024;
+
+
+namespace {
+
+struct TranslationKey {
+  uint8_t Digest[16];
+};
+
+struct TranslationCacheEntry {
+  TranslationKey Key;
+  std::shared_ptr<const std::string> Translation;
+};
+
+// Translations done by this process, most recently used first.
+std::mutex gTranslationCacheLock;
+std::list<TranslationCacheEntry> gTranslationCache;
+size_t gTranslationCacheSize = 0;
+
+}  // end anonymous namespace
+
+
+static TranslationKey computeTranslationKey(const char *bitcode,
+                                            size_t bitcodeSize,
+                                            unsigned int version) {
+  uint32_t Versions[2] = { kTranslatorVersion, version };
+  llvm::MD5 Hash;
+  Hash.update(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(Versions), sizeof(Versions)));
+  Hash.update(llvm::ArrayRef<uint8_t>(
+      reinterpret_cast<const uint8_t *>(bitcode), bitcodeSize));
+
+  llvm::MD5::MD5Result Result;
+  Hash.final(Result);
+
+  TranslationKey Key;
+  memcpy(Key.Digest, Result, sizeof(Key.Digest));
+  return Key;
+}
+
+
+static std::shared_ptr<const std::string>
+lookupTranslation(const TranslationKey &Key) {
+  std::lock_guard<std::mutex> Lock(gTranslationCacheLock);
+  for (std::list<TranslationCacheEntry>::iterator
+           I = gTranslationCache.begin(), E = gTranslationCache.end();
+       I != E; ++I) {
+    if (memcmp(I->Key.Digest, Key.Digest, sizeof(Key.Digest)) == 0) {
+      gTranslationCache.splice(gTranslationCache.begin(), gTranslationCache,
+                               I);
+      return I->Translation;
+    }
+  }
+  return std::shared_ptr<const std::string>();
+}
+
+
+static void storeTranslation(const TranslationKey &Key,
+                             const std::shared_ptr<const std::string> &T) {
+  if (T->size() > kTranslationCacheLimit) {
+    return;
+  }
+
+  std::lock_guard<std::mutex> Lock(gTranslationCacheLock);
+  TranslationCacheEntry Entry = { Key, T };
+  gTranslationCache.push_front(Entry);
+  gTranslationCacheSize += T->size();
+
+  // The translators still using an evicted translation keep it alive.
+  while (gTranslationCacheSize > kTranslationCacheLimit) {
+    gTranslationCacheSize -= gTranslationCache.back().Translation->size();
+    gTranslationCache.pop_back();
+  }
+}
+
+
+static std::string getTranslationPath(const std::string &cacheDir,
+                                      const TranslationKey &Key) {
+  static const char HexDigits[] = "0123456789abcdef";
+  std::string Path(cacheDir);
+  Path.append("/");
+  for (size_t i = 0; i < sizeof(Key.Digest); i++) {
+    Path.push_back(HexDigits[Key.Digest[i] >> 4]);
+    Path.push_back(HexDigits[Key.Digest[i] & 0xf]);
+  }
+  Path.append(".bctrans");
+  return Path;
+}
+
+
+static std::shared_ptr<const std::string>
+readTranslation(const std::string &Path) {
+  std::shared_ptr<const std::string> None;
+
+  FILE *F = fopen(Path.c_str(), "rb");
+  if (F == NULL) {
+    return None;
+  }
+
+  std::string *T = new std::string();
+  char Buffer[4096];
+  size_t N;
+  while ((N = fread(Buffer, 1, sizeof(Buffer), F)) > 0) {
+    T->append(Buffer, N);
+  }
+  bool ReadError = ferror(F);
+  fclose(F);
+
+  // The name of the file is the digest of the input. Only make sure the file
+  // is complete.
+  const AndroidBitcodeWrapper *Wrapper =
+      reinterpret_cast<const AndroidBitcodeWrapper *>(T->data());
+  if (ReadError || (T->size() < sizeof(*Wrapper)) ||
+      (Wrapper->Magic != 0x0B17C0DE) ||
+      (static_cast<uint64_t>(Wrapper->BitcodeOffset) + Wrapper->BitcodeSize !=
+          T->size())) {
+    ALOGW("Ignoring corrupted bitcode translation %s", Path.c_str());
+    delete T;
+    return None;
+  }
+
+  return std::shared_ptr<const std::string>(T);
+}
+
+
+static void writeTranslation(const std::string &Path, const std::string &T) {
+  // Write to a temporary file first so that the rename below replaces the
+  // translation atomically. mkstemp() keeps the threads of this process
+  // translating the same bitcode from sharing the temporary.
+  std::string TmpPath = Path + ".XXXXXX";
+  int FD = mkstemp(&TmpPath[0]);
+  if (FD < 0) {
+    ALOGW("Could not create bitcode translation %s (%s)", TmpPath.c_str(),
+          strerror(errno));
+    return;
+  }
+
+  FILE *F = fdopen(FD, "wb");
+  if (F == NULL) {
+    ALOGW("Could not create bitcode translation %s (%s)", TmpPath.c_str(),
+          strerror(errno));
+    close(FD);
+    unlink(TmpPath.c_str());
+    return;
+  }
+
+  bool WriteError = (fwrite(T.data(), 1, T.size(), F) != T.size());
+  if ((fclose(F) != 0) || WriteError ||
+      (rename(TmpPath.c_str(), Path.c_str()) != 0)) {
+    ALOGW("Could not write bitcode translation %s (%s)", Path.c_str(),
+          strerror(errno));
+    unlink(TmpPath.c_str());
+  }
+}
+
 
 BitcodeTranslator::BitcodeTranslator(const char *bitcode, size_t bitcodeSize,
                                      unsigned int version)
@@ -77,11 +252,7 @@ BitcodeTranslator::BitcodeTranslator(const char *bitcode, size_t bitcodeSize,
 
 
 BitcodeTranslator::~BitcodeTranslator() {
-  if (mVersion < kMinimumUntranslatedVersion) {
-    // We didn't actually do a translation in the alternate case, so deleting
-    // the bitcode would be improper.
-    delete [] mTranslatedBitcode;
-  }
+  // The translation, if any, is released along with mTranslation.
   mTranslatedBitcode = NULL;
   return;
 }
@@ -116,6 +287,24 @@ bool BitcodeTranslator::translate() {
     return true;
   }
 
+  // Reuse the translation done for the same bitcode by this process or, if
+  // there's a cache directory, by a previous one.
+  TranslationKey Key = computeTranslationKey(mBitcode, mBitcodeSize, mVersion);
+  std::string CachePath;
+  mTranslation = lookupTranslation(Key);
+  if (!mTranslation && !mCacheDir.empty()) {
+    CachePath = getTranslationPath(mCacheDir, Key);
+    mTranslation = readTranslation(CachePath);
+    if (mTranslation) {
+      storeTranslation(Key, mTranslation);
+    }
+  }
+  if (mTranslation) {
+    mTranslatedBitcode = mTranslation->data();
+    mTranslatedBitcodeSize = mTranslation->size();
+    return true;
+  }
+
   // Do the actual transcoding by invoking a 2.7-era bitcode reader that can
   // then write the bitcode back out in a more modern (acceptable) version.
   std::unique_ptr<llvm::LLVMContext> mContext(new llvm::LLVMContext());
@@ -142,28 +331,49 @@ bool BitcodeTranslator::translate() {
     return false;
   }
 
-  std::string Buffer;
+  // The bitcode is written straight into the translation, after room left for
+  // the wrapper, so that there's never a second copy of it. The reserve is a
+  // heuristic guess, not a bound: the writer's output size isn't known until
+  // it's done, and is usually about the size of the input. A quarter more
+  // than the input avoids most regrowth, and a larger output just grows the
+  // string as usual.
+  std::string *Translation = new std::string();
+  mTranslation.reset(Translation);
+  Translation->reserve(sizeof(AndroidBitcodeWrapper) + mBitcodeSize +
+                       mBitcodeSize / 4);
+  Translation->resize(sizeof(AndroidBitcodeWrapper));
+  {
+    llvm::raw_string_ostream OS(*Translation);
+    // Use the LLVM 3.2 bitcode writer, instead of the top-of-tree version.
+    llvm_3_2::WriteBitcodeToFile(module, OS);
+    OS.flush();
+  }
 
-  llvm::raw_string_ostream OS(Buffer);
-  // Use the LLVM 3.2 bitcode writer, instead of the top-of-tree version.
-  llvm_3_2::WriteBitcodeToFile(module, OS);
-  OS.flush();
+  // Free the module before anything else is done with the translation.
+  module = NULL;
+  mContext.reset();
 
   AndroidBitcodeWrapper wrapper;
   size_t actualWrapperLen = writeAndroidBitcodeWrapper(
-      &wrapper, Buffer.size(), BCWrapper.getTargetAPI(),
-      BCWrapper.getCompilerVersion(), BCWrapper.getOptimizationLevel());
-  if (!actualWrapperLen) {
+      &wrapper, Translation->size() - sizeof(wrapper),
+      BCWrapper.getTargetAPI(), BCWrapper.getCompilerVersion(),
+      BCWrapper.getOptimizationLevel());
+  if (actualWrapperLen != sizeof(wrapper)) {
     ALOGE("Couldn't produce bitcode wrapper!");
+    mTranslation.reset();
     return false;
   }
+  Translation->replace(0, actualWrapperLen,
+                       reinterpret_cast<const char *>(&wrapper),
+                       actualWrapperLen);
 
-  mTranslatedBitcodeSize = actualWrapperLen + Buffer.size();
-  char *c = new char[mTranslatedBitcodeSize];
-  memcpy(c, &wrapper, actualWrapperLen);
-  memcpy(c + actualWrapperLen, Buffer.c_str(), Buffer.size());
+  mTranslatedBitcode = mTranslation->data();
+  mTranslatedBitcodeSize = mTranslation->size();
 
-  mTranslatedBitcode = c;
+  storeTranslation(Key, mTranslation);
+  if (!CachePath.empty()) {
+    writeTranslation(CachePath, *mTranslation);
+  }
 
   return true;
 }
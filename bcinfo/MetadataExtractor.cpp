@@ -24,6 +24,9 @@
 #include <cutils/properties.h>
 #endif
 
+#include "llvm/ADT/SmallVector.h"
+#include "llvm/Bitcode/BitstreamReader.h"
+#include "llvm/Bitcode/LLVMBitCodes.h"
 #include "llvm/Bitcode/ReaderWriter.h"
 #include "llvm/IR/Constants.h"
 #include "llvm/IR/LLVMContext.h"
@@ -31,6 +34,9 @@
 #include "llvm/Support/MemoryBuffer.h"
 
 #include <cstdlib>
+#include <cstring>
+#include <string>
+#include <vector>
 
 namespace bcinfo {
 
@@ -60,8 +66,346 @@ static const llvm::StringRef ExportForEachMetadataName = "#rs_export_foreach";
 static const llvm::StringRef ObjectSlotMetadataName = "#rs_object_slots";
 
 
+// The strings of a MetadataExtractor are carved out of a few large chunks, so
+// that extracting a script takes a handful of allocations instead of one per
+// string. They are all freed along with the extractor.
+class MetadataExtractor::StringArena {
+ private:
+  static const size_t ChunkSize = 4096;
+
+  std::vector<char *> mChunks;
+  char *mNext;
+  size_t mLeft;
+
+ public:
+  StringArena() : mNext(NULL), mLeft(0) {
+  }
+
+  ~StringArena() {
+    for (size_t i = 0; i < mChunks.size(); i++) {
+      delete [] mChunks[i];
+    }
+  }
+
+  const char *save(llvm::StringRef S) {
+    size_t Size = S.size() + 1;
+    char *Result;
+    if (Size > ChunkSize / 4) {
+      // Don't waste the rest of the current chunk on a long string.
+      Result = new char[Size];
+      mChunks.push_back(Result);
+    } else {
+      if (Size > mLeft) {
+        mNext = new char[ChunkSize];
+        mChunks.push_back(mNext);
+        mLeft = ChunkSize;
+      }
+      Result = mNext;
+      mNext += Size;
+      mLeft -= Size;
+    }
+    memcpy(Result, S.data(), S.size());
+    Result[S.size()] = '\0';
+    return Result;
+  }
+};
+
+
+// The fast scan of the bitcode. It reads the type table and the module-level
+// metadata straight from the bitstream and skips every other block, the
+// function bodies in particular. The RS named metadata found is rebuilt in an
+// otherwise empty module, with their string operands only: an operand that
+// isn't a string is replaced by a placeholder, which is all the populate*()
+// functions need to know about it.
+//
+// Anything the scan isn't sure about (older encodings, forward references
+// to strings, ...) makes it fail, in which case the bitcode is fully parsed.
+namespace {
+
+enum ScannedTypeKind {
+  kOtherType,
+  kVoidType,
+  kMetadataType
+};
+
+// An entry of the metadata value list: a string or a node whose operands are
+// kept as (type ID, value ID) pairs like in the bitcode.
+struct ScannedMDValue {
+  bool IsString;
+  std::string String;
+  std::vector<uint64_t> Operands;
+};
+
+struct MetadataScanner {
+  llvm::BitstreamCursor &Stream;
+  llvm::Module &M;
+  std::vector<ScannedTypeKind> Types;
+  std::vector<ScannedMDValue> Values;
+
+  MetadataScanner(llvm::BitstreamCursor &S, llvm::Module &Module)
+      : Stream(S), M(Module) {
+  }
+
+  static bool isRSNamedMetadata(llvm::StringRef Name) {
+    return (Name == PragmaMetadataName) ||
+           (Name == ExportVarMetadataName) ||
+           (Name == ExportFuncMetadataName) ||
+           (Name == ExportForEachNameMetadataName) ||
+           (Name == ExportForEachMetadataName) ||
+           (Name == ObjectSlotMetadataName);
+  }
+
+  // Only the kind of each type matters. Every record but NUMENTRY and
+  // STRUCT_NAME defines the next type ID.
+  bool scanTypeTable() {
+    if (Stream.EnterSubBlock(llvm::bitc::TYPE_BLOCK_ID_NEW)) {
+      return false;
+    }
+
+    llvm::SmallVector<uint64_t, 64> Record;
+    while (1) {
+      llvm::BitstreamEntry Entry = Stream.advanceSkippingSubblocks();
+      switch (Entry.Kind) {
+      case llvm::BitstreamEntry::SubBlock:
+      case llvm::BitstreamEntry::Error:
+        return false;
+      case llvm::BitstreamEntry::EndBlock:
+        return true;
+      case llvm::BitstreamEntry::Record:
+        break;
+      }
+
+      Record.clear();
+      switch (Stream.readRecord(Entry.ID, Record)) {
+      case llvm::bitc::TYPE_CODE_NUMENTRY:
+      case llvm::bitc::TYPE_CODE_STRUCT_NAME:
+        break;
+      case llvm::bitc::TYPE_CODE_VOID:
+        Types.push_back(kVoidType);
+        break;
+      case llvm::bitc::TYPE_CODE_METADATA:
+        Types.push_back(kMetadataType);
+        break;
+      default:
+        Types.push_back(kOtherType);
+        break;
+      }
+    }
+  }
+
+  bool addNamedMetadata(llvm::StringRef Name,
+                        const llvm::SmallVectorImpl<uint64_t> &NodeIDs) {
+    llvm::LLVMContext &Context = M.getContext();
+    llvm::Value *Placeholder =
+        llvm::UndefValue::get(llvm::Type::getInt32Ty(Context));
+    llvm::NamedMDNode *NMD = M.getOrInsertNamedMetadata(Name);
+
+    for (size_t i = 0; i < NodeIDs.size(); i++) {
+      if ((NodeIDs[i] >= Values.size()) || Values[NodeIDs[i]].IsString) {
+        return false;
+      }
+
+      const std::vector<uint64_t> &Operands = Values[NodeIDs[i]].Operands;
+      llvm::SmallVector<llvm::Value *, 4> Elts;
+      for (size_t j = 0; j < Operands.size(); j += 2) {
+        uint64_t TypeID = Operands[j];
+        uint64_t ValueID = Operands[j + 1];
+        if (TypeID >= Types.size()) {
+          return false;
+        }
+
+        if (Types[TypeID] == kVoidType) {
+          Elts.push_back(NULL);
+        } else if (Types[TypeID] == kMetadataType) {
+          if (ValueID >= Values.size()) {
+            return false;
+          }
+          if (Values[ValueID].IsString) {
+            Elts.push_back(llvm::MDString::get(Context,
+                                               Values[ValueID].String));
+          } else {
+            Elts.push_back(Placeholder);
+          }
+        } else {
+          Elts.push_back(Placeholder);
+        }
+      }
+      NMD->addOperand(llvm::MDNode::get(Context, Elts));
+    }
+
+    return true;
+  }
+
+  bool scanMetadataBlock() {
+    if (Stream.EnterSubBlock(llvm::bitc::METADATA_BLOCK_ID)) {
+      return false;
+    }
+
+    llvm::SmallVector<uint64_t, 64> Record;
+    while (1) {
+      llvm::BitstreamEntry Entry = Stream.advanceSkippingSubblocks();
+      switch (Entry.Kind) {
+      case llvm::BitstreamEntry::SubBlock:
+      case llvm::BitstreamEntry::Error:
+        return false;
+      case llvm::BitstreamEntry::EndBlock:
+        return true;
+      case llvm::BitstreamEntry::Record:
+        break;
+      }
+
+      Record.clear();
+      switch (Stream.readRecord(Entry.ID, Record)) {
+      case llvm::bitc::METADATA_STRING: {
+        ScannedMDValue V;
+        V.IsString = true;
+        V.String.assign(Record.begin(), Record.end());
+        Values.push_back(V);
+        break;
+      }
+      case llvm::bitc::METADATA_NODE:
+      case llvm::bitc::METADATA_FN_NODE: {
+        if (Record.size() % 2 == 1) {
+          return false;
+        }
+        ScannedMDValue V;
+        V.IsString = false;
+        V.Operands.assign(Record.begin(), Record.end());
+        Values.push_back(V);
+        break;
+      }
+      case llvm::bitc::METADATA_NAME: {
+        std::string Name(Record.begin(), Record.end());
+
+        // METADATA_NAME is always followed by METADATA_NAMED_NODE.
+        Record.clear();
+        unsigned Code = Stream.ReadCode();
+        if (Stream.readRecord(Code, Record) !=
+                llvm::bitc::METADATA_NAMED_NODE) {
+          return false;
+        }
+        if (isRSNamedMetadata(Name) && !addNamedMetadata(Name, Record)) {
+          return false;
+        }
+        break;
+      }
+      case llvm::bitc::METADATA_KIND:
+        break;
+      default:
+        return false;
+      }
+    }
+  }
+
+  bool scanModule() {
+    if (Stream.EnterSubBlock(llvm::bitc::MODULE_BLOCK_ID)) {
+      return false;
+    }
+
+    while (1) {
+      llvm::BitstreamEntry Entry = Stream.advance();
+      switch (Entry.Kind) {
+      case llvm::BitstreamEntry::Error:
+        return false;
+      case llvm::BitstreamEntry::EndBlock:
+        return true;
+      case llvm::BitstreamEntry::SubBlock:
+        switch (Entry.ID) {
+        case llvm::bitc::BLOCKINFO_BLOCK_ID:
+          if (Stream.ReadBlockInfoBlock()) {
+            return false;
+          }
+          break;
+        case llvm::bitc::TYPE_BLOCK_ID_NEW:
+          if (!scanTypeTable()) {
+            return false;
+          }
+          break;
+        case llvm::bitc::METADATA_BLOCK_ID:
+          if (!scanMetadataBlock()) {
+            return false;
+          }
+          break;
+        default:
+          // Function bodies, constants, symbol tables, ...
+          if (Stream.SkipBlock()) {
+            return false;
+          }
+          break;
+        }
+        break;
+      case llvm::BitstreamEntry::Record:
+        Stream.skipRecord(Entry.ID);
+        break;
+      }
+    }
+  }
+};
+
+}  // end anonymous namespace
+
+
+static bool scanBitcodeMetadata(const char *bitcode, size_t bitcodeSize,
+                                llvm::Module &M) {
+  const unsigned char *BufPtr =
+      reinterpret_cast<const unsigned char *>(bitcode);
+  const unsigned char *BufEnd = BufPtr + bitcodeSize;
+
+  // The Android bitcode wrapper is compatible with the one LLVM knows.
+  if (llvm::isBitcodeWrapper(BufPtr, BufEnd) &&
+      llvm::SkipBitcodeWrapperHeader(BufPtr, BufEnd, true)) {
+    return false;
+  }
+
+  // The bitstream is made of 32-bit words.
+  if (((BufEnd - BufPtr) & 3) != 0) {
+    return false;
+  }
+
+  llvm::BitstreamReader StreamFile(BufPtr, BufEnd);
+  llvm::BitstreamCursor Stream(StreamFile);
+
+  if (Stream.Read(8) != 'B' ||
+      Stream.Read(8) != 'C' ||
+      Stream.Read(4) != 0x0 ||
+      Stream.Read(4) != 0xC ||
+      Stream.Read(4) != 0xE ||
+      Stream.Read(4) != 0xD) {
+    return false;
+  }
+
+  while (!Stream.AtEndOfStream()) {
+    llvm::BitstreamEntry Entry =
+        Stream.advance(llvm::BitstreamCursor::AF_DontAutoprocessAbbrevs);
+    if (Entry.Kind != llvm::BitstreamEntry::SubBlock) {
+      return false;
+    }
+
+    switch (Entry.ID) {
+    case llvm::bitc::BLOCKINFO_BLOCK_ID:
+      if (Stream.ReadBlockInfoBlock()) {
+        return false;
+      }
+      break;
+    case llvm::bitc::MODULE_BLOCK_ID: {
+      // There's nothing of interest after the module.
+      MetadataScanner Scanner(Stream, M);
+      return Scanner.scanModule();
+    }
+    default:
+      if (Stream.SkipBlock()) {
+        return false;
+      }
+      break;
+    }
+  }
+
+  return false;
+}
+
+
 MetadataExtractor::MetadataExtractor(const char *bitcode, size_t bitcodeSize)
-    : mModule(NULL), mBitcode(bitcode), mBitcodeSize(bitcodeSize),
+    : mStrings(new StringArena()), mModule(NULL), mBitcode(bitcode), mBitcodeSize(bitcodeSize),
       mExportVarCount(0), mExportFuncCount(0), mExportForEachSignatureCount(0),
       mExportVarNameList(NULL), mExportFuncNameList(NULL),
       mExportForEachNameList(NULL), mExportForEachSignatureList(NULL),
@@ -75,7 +419,8 @@ MetadataExtractor::MetadataExtractor(const char *bitcode, size_t bitcodeSize)
 
 
 MetadataExtractor::MetadataExtractor(const llvm::Module *module)
-    : mModule(module), mBitcode(NULL), mBitcodeSize(0), mExportVarCount(0),
+    : mStrings(new StringArena()), mModule(module), mBitcode(NULL),
+      mBitcodeSize(0), mExportVarCount(0),
       mExportFuncCount(0), mExportForEachSignatureCount(0),
       mExportVarNameList(NULL), mExportFuncNameList(NULL),
       mExportForEachNameList(NULL), mExportForEachSignatureList(NULL),
@@ -88,46 +433,19 @@ MetadataExtractor::MetadataExtractor(const llvm::Module *module)
 
 
 MetadataExtractor::~MetadataExtractor() {
-  if (mExportVarNameList) {
-    for (size_t i = 0; i < mExportVarCount; i++) {
-        delete [] mExportVarNameList[i];
-        mExportVarNameList[i] = NULL;
-    }
-  }
+  // The strings in the lists are freed along with the arena.
   delete [] mExportVarNameList;
   mExportVarNameList = NULL;
 
-  if (mExportFuncNameList) {
-    for (size_t i = 0; i < mExportFuncCount; i++) {
-        delete [] mExportFuncNameList[i];
-        mExportFuncNameList[i] = NULL;
-    }
-  }
   delete [] mExportFuncNameList;
   mExportFuncNameList = NULL;
 
-  if (mExportForEachNameList) {
-    for (size_t i = 0; i < mExportForEachSignatureCount; i++) {
-        delete [] mExportForEachNameList[i];
-        mExportForEachNameList[i] = NULL;
-    }
-  }
   delete [] mExportForEachNameList;
   mExportForEachNameList = NULL;
 
   delete [] mExportForEachSignatureList;
   mExportForEachSignatureList = NULL;
 
-  for (size_t i = 0; i < mPragmaCount; i++) {
-    if (mPragmaKeyList) {
-      delete [] mPragmaKeyList[i];
-      mPragmaKeyList[i] = NULL;
-    }
-    if (mPragmaValueList) {
-      delete [] mPragmaValueList[i];
-      mPragmaValueList[i] = NULL;
-    }
-  }
   delete [] mPragmaKeyList;
   mPragmaKeyList = NULL;
   delete [] mPragmaValueList;
@@ -136,6 +454,9 @@ MetadataExtractor::~MetadataExtractor() {
   delete [] mObjectSlotList;
   mObjectSlotList = NULL;
 
+  delete mStrings;
+  mStrings = NULL;
+
   return;
 }
 
@@ -178,18 +499,12 @@ bool MetadataExtractor::populateObjectSlotMetadata(
 }
 
 
-static const char *createStringFromValue(llvm::Value *v) {
-  if (v->getValueID() != llvm::Value::MDStringVal) {
+const char *MetadataExtractor::createStringFromValue(llvm::Value *v) {
+  if (v == NULL || v->getValueID() != llvm::Value::MDStringVal) {
     return NULL;
   }
 
-  llvm::StringRef ref = static_cast<llvm::MDString*>(v)->getString();
-
-  char *c = new char[ref.size() + 1];
-  memcpy(c, ref.data(), ref.size());
-  c[ref.size()] = '\0';
-
-  return c;
+  return mStrings->save(static_cast<llvm::MDString*>(v)->getString());
 }
 
 
@@ -329,14 +644,13 @@ bool MetadataExtractor::populateForEachMetadata(
     // section for ForEach. We generate a full signature for a "root" function
     // which means that we need to set the bottom 5 bits in the mask.
     mExportForEachSignatureCount = 1;
-    char **TmpNameList = new char*[mExportForEachSignatureCount];
-    TmpNameList[0] = new char[5];
-    strncpy(TmpNameList[0], "root", 5);
+    const char **TmpNameList = new const char*[mExportForEachSignatureCount];
+    TmpNameList[0] = mStrings->save("root");
 
     uint32_t *TmpSigList = new uint32_t[mExportForEachSignatureCount];
     TmpSigList[0] = 0x1f;
 
-    mExportForEachNameList = (const char**)TmpNameList;
+    mExportForEachNameList = TmpNameList;
     mExportForEachSignatureList = TmpSigList;
     return true;
   }
@@ -384,9 +698,7 @@ bool MetadataExtractor::populateForEachMetadata(
       ALOGE("mExportForEachSignatureCount = %zu, but should be 1",
             mExportForEachSignatureCount);
     }
-    char *RootName = new char[5];
-    strncpy(RootName, "root", 5);
-    TmpNameList[0] = RootName;
+    TmpNameList[0] = mStrings->save("root");
   }
 
   mExportForEachNameList = TmpNameList;
@@ -406,6 +718,18 @@ bool MetadataExtractor::extract() {
 
   if (!mModule) {
     mContext.reset(new llvm::LLVMContext());
+
+    // Try the fast scan first. The module it fills is owned by the context.
+    llvm::Module *Scanned = new llvm::Module("", *mContext);
+    if (scanBitcodeMetadata(mBitcode, mBitcodeSize, *Scanned)) {
+      mModule = Scanned;
+    } else {
+      ALOGV("Fast metadata scan failed. Parsing the whole bitcode instead.");
+      delete Scanned;
+    }
+  }
+
+  if (!mModule) {
     std::unique_ptr<llvm::MemoryBuffer> MEM(
       llvm::MemoryBuffer::getMemBuffer(
         llvm::StringRef(mBitcode, mBitcodeSize), "", false));
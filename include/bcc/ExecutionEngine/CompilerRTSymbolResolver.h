@@ -23,8 +23,11 @@ namespace bcc {
 
 class CompilerRTSymbolResolver : public DyldSymbolResolver {
 public:
+ // libcompiler_rt.so is a system library and never changes during the lifetime
+ // of the process. Mark it stable so its lookups are shared across scripts.
  CompilerRTSymbolResolver() :
-      DyldSymbolResolver("/system/lib/libcompiler_rt.so") { }
+      DyldSymbolResolver("/system/lib/libcompiler_rt.so",
+                         /* pLazyBinding */true, /* pStable */true) { }
 
  virtual void *getAddress(const char *pName) {
    // Compiler runtime functions are always prefixed by "__"
@@ -0,0 +1,71 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_EXECUTION_ENGINE_HUGE_PAGE_TEXT_H
+#define BCC_EXECUTION_ENGINE_HUGE_PAGE_TEXT_H
+
+#include <cstddef>
+
+namespace bcc {
+
+/*
+ * HugePageText backs the code of the loaded scripts with transparent huge
+ * pages to cut the iTLB misses of the kernels running in tight loops. The
+ * code is copied into an anonymous, huge page aligned mapping which is then
+ * moved over the original one, so its address (and everything that refers to
+ * it) doesn't change.
+ *
+ * Only the huge page aligned part of the code can be remapped. This is
+ * worthwhile for big objects (e.g., one linked from all the scripts of an
+ * app) rather than for a small script. The remapped code is private to the
+ * process, i.e., it is no longer shared with the other processes mapping the
+ * same file. Therefore this is off unless enabled by SetEnabled() or, if it's
+ * never called, by the environment variable BCC_HUGE_PAGES (or the system
+ * property debug.bcc.hugepages on the device.)
+ */
+class HugePageText {
+public:
+  static const size_t HugePageSize = 2 * 1024 * 1024;
+
+private:
+  // 0 or 1. Negative until it's read from the environment.
+  static volatile int sEnabled;
+
+  static bool ReadEnabled();
+
+public:
+  static void SetEnabled(bool pEnabled);
+
+  static inline bool IsEnabled() {
+    if (sEnabled < 0) {
+      return ReadEnabled();
+    }
+    return (sEnabled != 0);
+  }
+
+  // Back the huge page aligned part of the executable range [pStart,
+  // pStart + pSize) with huge pages. Return the number of bytes remapped,
+  // which is 0 if the range doesn't cover a huge page or on error (the
+  // original mapping is left untouched then.)
+  static size_t Remap(void *pStart, size_t pSize);
+
+  // Return the bytes remapped by Remap() in the process so far.
+  static size_t GetTotalRemapped();
+};
+
+} // end namespace bcc
+
+#endif // BCC_EXECUTION_ENGINE_HUGE_PAGE_TEXT_H
@@ -17,6 +17,8 @@
 #ifndef BCC_EXECUTION_ENGINE_OBJECT_LOADER_H
 #define BCC_EXECUTION_ENGINE_OBJECT_LOADER_H
 
+#include <pthread.h>
+
 #include <cstddef>
 
 #include "bcc/Support/Log.h"
@@ -26,6 +28,7 @@
 namespace bcc {
 
 class FileBase;
+class LoadStats;
 class ObjectLoaderImpl;
 class SymbolResolverInterface;
 
@@ -40,30 +43,85 @@ public:
 private:
   ObjectLoaderImpl *mImpl;
 
+  // The image of the object registered with GDB's JIT interface. It's a copy
+  // of the object made at load time, prepared and registered by
+  // registerDebugImage() on demand, only once a debugger is around.
   void *mDebugImage;
+  size_t mDebugImageSize;
+
+  bool mIsDebugImageRegistered;
+
+  ObjectLoader() : mImpl(NULL), mDebugImage(0), mDebugImageSize(0),
+                   mIsDebugImageRegistered(false) { }
+
+  // Load a relocatable object at pMemStart. pResolverLock is as in Load().
+  static ObjectLoader *LoadRelocatable(void *pMemStart, size_t pMemSize,
+                                       const char *pName,
+                                       SymbolResolverInterface &pResolver,
+                                       bool pEnableGDBDebug,
+                                       LoadStats *pStats,
+                                       pthread_mutex_t *pResolverLock);
+
+  // Prepare the debug image of the object and register it with GDB's JIT
+  // interface if it hasn't been registered yet. Return false if there's
+  // nothing to register or on error. Called by RegisterDebugImages() only.
+  bool registerDebugImage();
 
-  ObjectLoader() : mImpl(NULL), mDebugImage(0) { }
+  // Load a shared object at pPath whose contents are mapped at pMemStart.
+  static ObjectLoader *LoadSharedObject(const void *pMemStart, size_t pMemSize,
+                                        const char *pPath,
+                                        SymbolResolverInterface &pResolver,
+                                        LoadStats *pStats,
+                                        pthread_mutex_t *pResolverLock);
 
 public:
   // Load from a in-memory object. pName is a descriptive name of this memory.
+  // If pStats is non-NULL, the time and the memory spent are added to it.
   static ObjectLoader *Load(void *pMemStart, size_t pMemSize, const char *pName,
                             SymbolResolverInterface &pResolver,
-                            bool pEnableGDBDebug);
-
-  // Load from a file.
+                            bool pEnableGDBDebug,
+                            LoadStats *pStats = NULL);
+
+  // Load from a file. The file is either a relocatable object or a shared
+  // object. The latter is loaded through the system dynamic loader, which maps
+  // its code directly from the file so that it's shared across processes.
+  // If pResolverLock is non-NULL, it's held only while pResolver is in use
+  // (i.e., during the relocation), so that the rest of the loads of several
+  // objects sharing a resolver can run concurrently.
   static ObjectLoader *Load(FileBase &pFile,
                             SymbolResolverInterface &pResolver,
-                            bool pEnableGDBDebug);
+                            bool pEnableGDBDebug,
+                            LoadStats *pStats = NULL,
+                            pthread_mutex_t *pResolverLock = NULL);
 
   void *getSymbolAddress(const char *pName) const;
 
   size_t getSymbolSize(const char *pName) const;
 
+  // Return the address where the section at index pIndex of the object file
+  // is loaded. Return NULL if the section isn't loaded or the loader doesn't
+  // place the sections individually (e.g., shared objects.)
+  void *getSectionAddress(unsigned pIndex) const;
+
+  // Register the debug images of all the objects loaded with GDB debugging
+  // enabled. It's done automatically on load if the process is being traced
+  // at that time. Otherwise, this has to be called (e.g., by the debugger
+  // through bccRegisterDebugImages()) once a debugger is attached.
+  static void RegisterDebugImages();
+
   // Get the symbol name where the symbol is of the type pType. If kUnknownType
   // is given, it returns all symbols' names in the object.
   bool getSymbolNameList(android::Vector<const char *>& pNameList,
                          SymbolType pType = kUnknownType) const;
 
+  // Release the data kept only for the symbol queries above once the caller
+  // has looked up all the symbols it needs. Afterwards, getSymbolAddress() may
+  // return NULL and getSymbolSize() and getSymbolNameList() may fail. The
+  // objects loaded for debugging are left intact. librsloader offers no way
+  // to drop parts of a relocatable object, so only shared objects shrink for
+  // now.
+  void compact();
+
   ~ObjectLoader();
 };
 
@@ -0,0 +1,68 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_EXECUTION_ENGINE_PERF_MAP_H
+#define BCC_EXECUTION_ENGINE_PERF_MAP_H
+
+namespace bcc {
+
+class ObjectLoader;
+
+/*
+ * PerfMap tells the Linux profilers (perf and simpleperf) about the functions
+ * in the objects loaded by ObjectLoader, which otherwise show up as anonymous
+ * memory in the profiles. Two outputs are supported:
+ *
+ *   - <dir>/perf-<pid>.map, a text file with the address, the size and the
+ *     name of each function.
+ *   - <dir>/jit-<pid>.dump, perf's jitdump format, which also carries the code
+ *     so that the samples can be annotated. Use "perf inject --jit" on it.
+ *
+ * The outputs are selected by SetMode() or, if it's never called, by the
+ * environment variable BCC_PERF_MAP (or the system property debug.bcc.perfmap
+ * on the device) holding the sum of the modes. <dir> is /tmp on the host and
+ * /data/local/tmp on the device.
+ */
+class PerfMap {
+public:
+  enum Mode {
+    kDisabled   = 0,
+    kWriteMap   = 1 << 0,
+    kWriteDump  = 1 << 1,
+  };
+
+private:
+  // Combination of Mode. Negative until it's read from the environment.
+  static volatile int sMode;
+
+  static void RecordObjectImpl(const ObjectLoader &pLoader, const char *pName);
+
+public:
+  static void SetMode(unsigned pMode);
+
+  // Report the functions in pLoader. Only the check of the mode is performed
+  // when the outputs are disabled.
+  static inline void RecordObject(const ObjectLoader &pLoader,
+                                  const char *pName) {
+    if (sMode != kDisabled) {
+      RecordObjectImpl(pLoader, pName);
+    }
+  }
+};
+
+} // end namespace bcc
+
+#endif // BCC_EXECUTION_ENGINE_PERF_MAP_H
@@ -0,0 +1,163 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_EXECUTION_ENGINE_RELOCATION_CACHE_H
+#define BCC_EXECUTION_ENGINE_RELOCATION_CACHE_H
+
+#include <stdint.h>
+
+#include <llvm/ADT/StringMap.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "bcc/ExecutionEngine/SymbolResolverInterface.h"
+#include "bcc/Support/Sha1Util.h"
+
+namespace bcc {
+
+class SymbolResolverProxy;
+
+namespace reloccache {
+
+// The magic number of the relocation cache file.
+#define RELOCCACHE_MAGIC           "\0rsreloc"
+#define RELOCCACHE_MAGIC_LENGTH    8
+// Increase this when the file format changes.
+#define RELOCCACHE_VERSION         "002"
+#define RELOCCACHE_VERSION_LENGTH  4
+
+struct Header {
+  uint8_t magic[RELOCCACHE_MAGIC_LENGTH];
+  uint8_t version[RELOCCACHE_VERSION_LENGTH];
+
+  uint32_t numModules;
+  uint32_t numEntries;
+  uint32_t strPoolSize;
+
+  // Digest of the resolver chain the cache was generated with. See
+  // RelocationCache::ComputeChainDigest().
+  uint8_t chainDigest[SHA1_DIGEST_LENGTH];
+  // Keep the entries 8-byte aligned.
+  uint32_t padding;
+};
+
+// A module is a shared library (or the executable) which provides at least
+// one of the addresses in the cache. Its anchor is the index of one entry
+// resolved into it. Re-resolving the anchor is enough to tell whether the
+// module was loaded at the same base address as the one the cache was
+// generated with.
+struct ModuleItem {
+  uint32_t anchor;
+};
+
+struct EntryItem {
+  // Index into the string pool.
+  uint32_t name;
+  // Index into the module list.
+  uint32_t module;
+  uint64_t addr;
+};
+
+} // end namespace reloccache
+
+/*
+ * A symbol resolver which persists the result of symbol resolution across
+ * the loads of a script.
+ *
+ * The address of every symbol looked up through it is obtained from
+ * pFallback and recorded together with the base address of the module which
+ * defines it. writeToFile() stores the recorded addresses next to the object
+ * file. A later readFromFile() (usually from another load of the same object
+ * in a new process) checks that pFallback is made of the same resolvers, in
+ * the same order. Then the name of a symbol resolves to the same module as
+ * before, so only one anchor symbol per module is re-resolved to check that
+ * the module is still at the same address. When all of them still match, the
+ * rest of the addresses are served from the cache without consulting
+ * pFallback. Otherwise the cache is discarded and every lookup goes to
+ * pFallback as usual.
+ */
+class RelocationCache : public SymbolResolverInterface {
+private:
+  struct Entry {
+    void *addr;
+    unsigned module;
+  };
+
+  struct Module {
+    // Base address of the module in the memory.
+    const void *base;
+    // Name of the symbol in the module used to validate the cache.
+    const char *anchor;
+  };
+
+  SymbolResolverProxy &mFallback;
+
+  // See ComputeChainDigest().
+  uint8_t mChainDigest[SHA1_DIGEST_LENGTH];
+
+  // Symbol name to address. It also owns the strings referred by mModules.
+  llvm::StringMap<Entry> mEntries;
+  android::Vector<Module> mModules;
+
+  // True if there're entries not yet saved to the file.
+  bool mIsDirty;
+
+  // Record the address found for pName by the fallback resolver.
+  void record(const char *pName, void *pAddr);
+
+  void clear();
+
+  // Digest the stable scopes of the resolvers in pResolver (see
+  // SymbolResolverProxy::getChainKey().) Replacing or reordering the
+  // resolvers changes the digest. Libraries dlopen()'ed by the process
+  // outside the chain don't, so the cache survives them.
+  static void ComputeChainDigest(uint8_t pResult[SHA1_DIGEST_LENGTH],
+                                 const SymbolResolverProxy &pResolver);
+
+public:
+  // Return the path of the relocation cache file for the given object file.
+  static android::String8 GetPath(const char *pObjectPath);
+
+  RelocationCache(SymbolResolverProxy &pFallback)
+    : mFallback(pFallback), mIsDirty(false) {
+    ComputeChainDigest(mChainDigest, pFallback);
+  }
+
+  // Load the addresses from a previous run. Return false if the file doesn't
+  // exist, is malformed or no longer matches the modules in this process. In
+  // either case, the cache is left empty and will be populated by the lookups.
+  bool readFromFile(const char *pPath);
+
+  // Save the recorded addresses to pPath. The file is replaced atomically so
+  // that concurrent readers never see a partial file.
+  bool writeToFile(const char *pPath) const;
+
+  inline bool isDirty() const
+  { return mIsDirty; }
+
+  inline size_t getNumEntries() const
+  { return mEntries.size(); }
+
+  virtual void *getAddress(const char *pName);
+
+  virtual size_t getAddresses(const char *const *pNames, size_t pCount,
+                              void **pAddrs);
+};
+
+} // end namespace bcc
+
+#endif // BCC_EXECUTION_ENGINE_RELOCATION_CACHE_H
@@ -32,6 +32,30 @@ public:
   // Should this be a const method?
   virtual void *getAddress(const char *pName) = 0;
 
+  // Look up pCount symbols in one call. pAddrs[i] receives the address of
+  // pNames[i], or NULL if it cannot be found. Return the number of symbols
+  // found. The default implementation calls getAddress() for each name;
+  // resolvers which can serve a bulk query more efficiently override this.
+  virtual size_t getAddresses(const char *const *pNames, size_t pCount,
+                              void **pAddrs) {
+    size_t num_found = 0;
+    for (size_t i = 0; i < pCount; i++) {
+      pAddrs[i] = getAddress(pNames[i]);
+      if (pAddrs[i] != NULL) {
+        num_found++;
+      }
+    }
+    return num_found;
+  }
+
+  // A resolver is "stable" if it always returns the same address for a given
+  // name during the lifetime of the process. Stable resolvers return a
+  // non-NULL scope name here. The addresses found through them are memoized
+  // in a process-wide table by SymbolResolverProxy and are shared by all the
+  // resolvers reporting the same scope.
+  virtual const char *getStableScope() const
+  { return NULL; }
+
   virtual ~SymbolResolverInterface() { }
 };
 
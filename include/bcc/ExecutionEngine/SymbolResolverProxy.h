@@ -22,9 +22,25 @@
 
 #include <utils/Vector.h>
 
+#include <string>
+
 namespace bcc {
 
 class SymbolResolverProxy : public SymbolResolverInterface {
+public:
+  // Statistics of the process-wide memo table shared by all the proxies. See
+  // SymbolResolverInterface::getStableScope().
+  struct MemoStatistics {
+    // Number of lookups answered from the memo table.
+    unsigned numHits;
+    // Number of lookups forwarded to a stable resolver.
+    unsigned numMisses;
+    // Number of addresses in the memo table.
+    unsigned numEntries;
+  };
+
+  static MemoStatistics GetMemoStatistics();
+
 private:
   android::Vector<SymbolResolverInterface *> mChain;
 
@@ -33,7 +49,18 @@ public:
 
   void chainResolver(SymbolResolverInterface &pResolver);
 
+  // Append to pResult the scope of each resolver in the chain, in order, each
+  // followed by a '\0'. The resolvers which aren't stable are listed as "-".
+  // Two proxies with the same key resolve through the same kinds of
+  // resolvers (see RelocationCache.)
+  void getChainKey(std::string &pResult) const;
+
   virtual void *getAddress(const char *pName);
+
+  // Each resolver in the chain receives a single bulk query containing only
+  // the symbols the resolvers before it could not find.
+  virtual size_t getAddresses(const char *const *pNames, size_t pCount,
+                              void **pAddrs);
 };
 
 } // end namespace bcc
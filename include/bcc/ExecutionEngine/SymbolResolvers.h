@@ -17,8 +17,11 @@
 #ifndef BCC_EXECUTION_ENGINE_SYMBOL_RESOLVERS_H
 #define BCC_EXECUTION_ENGINE_SYMBOL_RESOLVERS_H
 
+#include <stdint.h>
+
 #include <cstdlib>
 #include <cstring>
+#include <string>
 
 #include "SymbolResolverInterface.h"
 
@@ -35,12 +38,23 @@ private:
   HandleTy mHandle;
   char *mError;
 
+  // Non-empty if this resolver is stable (see getStableScope().)
+  std::string mStableScope;
+
 public:
   // If pFileName is NULL, it will search symbol in the current process image.
-  DyldSymbolResolver(const char *pFileName, bool pLazyBinding = true);
+  //
+  // If pStable is true, the library is kept resident after this resolver is
+  // destroyed, so that the addresses returned from getAddress() remain valid
+  // for the lifetime of the process and can be memoized.
+  DyldSymbolResolver(const char *pFileName, bool pLazyBinding = true,
+                     bool pStable = false);
 
   virtual void *getAddress(const char *pName);
 
+  virtual const char *getStableScope() const
+  { return (mStableScope.empty() ? NULL : mStableScope.c_str()); }
+
   inline bool hasError() const
   { return (mError != NULL); }
   inline const char *getError() const
@@ -50,7 +64,8 @@ public:
 };
 
 /*
- * Symbol lookup by searching through an array of SymbolMap.
+ * Symbol lookup by searching through an array of SymbolMap. For the tables
+ * known at build time, PerfectHashSymbolResolver below is faster.
  */
 template<typename Subclass>
 class ArraySymbolResolver : public SymbolResolverInterface {
@@ -100,6 +115,83 @@ public:
   }
 };
 
+/*
+ * Hash functions used by PerfectHashSymbolResolver and by bcc_symhash, the
+ * tool generating its tables. They must not be changed without regenerating
+ * all the tables.
+ */
+// 32-bit FNV-1a of the symbol name. This is the only pass over the string.
+inline uint32_t HashSymbolName(const char *pName) {
+  uint32_t hash = 0x811c9dc5;
+  for (const unsigned char *c = reinterpret_cast<const unsigned char *>(pName);
+       *c != '\0'; c++) {
+    hash = (hash ^ *c) * 0x01000193;
+  }
+  return hash;
+}
+
+// Second level hash derived from the hash of the name and a seed (the
+// finalizer of MurmurHash3.)
+inline uint32_t RehashSymbolName(uint32_t pHash, uint32_t pSeed) {
+  uint32_t hash = pHash ^ (pSeed * 0x9e3779b9);
+  hash ^= hash >> 16;
+  hash *= 0x85ebca6b;
+  hash ^= hash >> 13;
+  hash *= 0xc2b2ae35;
+  hash ^= hash >> 16;
+  return hash;
+}
+
+/*
+ * Symbol lookup through a minimal perfect hash generated at build time by
+ * bcc_symhash (hash and displace.) Subclass provides:
+ *
+ *  - SymbolArray: NumSymbols entries of SymbolMap in the order of the hash.
+ *  - HashSeeds: NumSymbols displacements indexed by the hash of the name. A
+ *    negative value -(i + 1) refers the i-th entry in SymbolArray directly.
+ *    Otherwise, it's the seed to RehashSymbolName() which gives the index in
+ *    SymbolArray.
+ *
+ * Each lookup hashes the name once and costs a single strcmp().
+ */
+template<typename Subclass>
+class PerfectHashSymbolResolver : public SymbolResolverInterface {
+public:
+  typedef struct {
+    // Symbol name
+    const char *mName;
+    // Symbol address
+    void *mAddr;
+  } SymbolMap;
+
+  static const SymbolMap *Lookup(const SymbolMap *pSymbolArray,
+                                 const int32_t *pHashSeeds,
+                                 size_t pNumSymbols,
+                                 const char *pName) {
+    if (pNumSymbols == 0) {
+      return NULL;
+    }
+
+    uint32_t hash = HashSymbolName(pName);
+    int32_t seed = pHashSeeds[hash % pNumSymbols];
+    size_t idx = (seed < 0) ?
+        static_cast<size_t>(-seed - 1) :
+        (RehashSymbolName(hash, static_cast<uint32_t>(seed)) % pNumSymbols);
+
+    // Names not in the table hash to an arbitrary entry.
+    const SymbolMap *result = &pSymbolArray[idx];
+    return ((::strcmp(result->mName, pName) == 0) ? result : NULL);
+  }
+
+  virtual void *getAddress(const char *pName) {
+    const SymbolMap *result = Lookup(Subclass::SymbolArray,
+                                     Subclass::HashSeeds,
+                                     Subclass::NumSymbols,
+                                     pName);
+    return ((result != NULL) ? result->mAddr : NULL);
+  }
+};
+
 template<typename ContextTy = void *>
 class LookupFunctionSymbolResolver : public SymbolResolverInterface {
 public:
@@ -108,16 +200,20 @@ public:
 private:
   LookupFunctionTy mLookupFunc;
   ContextTy mContext;
+  const char *mStableScope;
 
 public:
   LookupFunctionSymbolResolver(LookupFunctionTy pLookupFunc = NULL,
                                ContextTy pContext = NULL)
-    : mLookupFunc(pLookupFunc), mContext(pContext) { }
+    : mLookupFunc(pLookupFunc), mContext(pContext), mStableScope(NULL) { }
 
   virtual void *getAddress(const char *pName) {
     return ((mLookupFunc != NULL) ? mLookupFunc(mContext, pName) : NULL);
   }
 
+  virtual const char *getStableScope() const
+  { return mStableScope; }
+
   inline LookupFunctionTy getLookupFunction() const
   { return mLookupFunc; }
   inline ContextTy getContext() const
@@ -127,6 +223,12 @@ public:
   { mLookupFunc = pLookupFunc; }
   inline void setContext(ContextTy pContext)
   { mContext = pContext; }
+
+  // Declare the lookup function to be stable (see
+  // SymbolResolverInterface::getStableScope().) pScope must outlive this
+  // resolver. Passing NULL makes the resolver unstable again.
+  inline void setStableScope(const char *pScope)
+  { mStableScope = pScope; }
 };
 
 } // end namespace bcc
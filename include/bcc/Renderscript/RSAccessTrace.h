@@ -0,0 +1,140 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_RS_ACCESS_TRACE_H
+#define BCC_RS_ACCESS_TRACE_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace bcc {
+
+namespace rstrace {
+
+// Number of samples kept in the ring buffer of a script. Must be a power of 2.
+#define RSTRACE_RING_SIZE          4096
+// By default, the first 4 of every 256 elements in a row are sampled.
+#define RSTRACE_DEFAULT_MASK       255
+#define RSTRACE_DEFAULT_BURST      4
+
+// The magic number of the access trace file.
+#define RSTRACE_MAGIC              "\0rstrace"
+#define RSTRACE_MAGIC_LENGTH       8
+// Increase this when the file format changes.
+#define RSTRACE_VERSION            "001"
+#define RSTRACE_VERSION_LENGTH     4
+
+// A sample. This is also the layout of the ring buffer in the script (see
+// createRSAccessTracePass().)
+struct Record {
+  // The address accessed or 0 if it's unknown.
+  uint64_t address;
+  // Index into the names of the sources.
+  uint32_t source;
+  uint32_t x;
+  uint32_t y;
+  uint32_t padding;
+};
+
+// Followed by numRecords Records and then the names of the sources separated
+// by NUL (strPoolSize bytes.)
+struct Header {
+  uint8_t magic[RSTRACE_MAGIC_LENGTH];
+  uint8_t version[RSTRACE_VERSION_LENGTH];
+
+  uint32_t numRecords;
+  uint32_t strPoolSize;
+  // Keep the records 8-byte aligned.
+  uint32_t padding;
+};
+
+} // end namespace rstrace
+
+/*
+ * RSAccessTrace holds the memory accesses of a script sampled by
+ * createRSAccessTracePass(), oldest first. It is saved next to the object
+ * file by RSExecutable and summarized by "bcc -dump-access-trace".
+ */
+class RSAccessTrace {
+public:
+  struct SourceSummary {
+    size_t numSamples;
+    // Samples whose address is known.
+    size_t numAddressed;
+    // The most common difference between the addresses of two consecutive
+    // elements in a row (i.e., x and x + 1), and how often it was seen out of
+    // numStrides.
+    int64_t stride;
+    size_t numStrideHits;
+    size_t numStrides;
+    // Distinct cache lines touched, and the samples that hit a line touched
+    // by one of the few samples just before them.
+    size_t numCacheLines;
+    size_t numReused;
+    uint32_t minX, maxX;
+    uint32_t minY, maxY;
+  };
+
+private:
+  // Names of the sources separated by NUL.
+  std::string mSources;
+  android::Vector<uint32_t> mSourceOffsets;
+  android::Vector<rstrace::Record> mRecords;
+
+public:
+  // Return the path of the trace file for the given object file.
+  static android::String8 GetPath(const char *pObjectPath);
+
+  RSAccessTrace() { }
+
+  void clear();
+
+  void addSource(const char *pName);
+
+  void add(const rstrace::Record &pRecord);
+
+  // Return false if the file doesn't exist or is malformed. This is left
+  // empty in that case.
+  bool readFromFile(const char *pPath);
+
+  // The file is replaced atomically.
+  bool writeToFile(const char *pPath) const;
+
+  inline size_t getNumSources() const
+  { return mSourceOffsets.size(); }
+
+  inline const char *getSourceName(size_t pIdx) const
+  { return mSources.c_str() + mSourceOffsets[pIdx]; }
+
+  inline size_t size() const
+  { return mRecords.size(); }
+
+  inline const rstrace::Record &getRecord(size_t pIdx) const
+  { return mRecords[pIdx]; }
+
+  // Summarize the samples of each source. pResult is indexed by source.
+  void summarize(android::Vector<SourceSummary> &pResult,
+                 unsigned pCacheLineSize = 64,
+                 unsigned pReuseWindow = 16) const;
+};
+
+} // end namespace bcc
+
+#endif // BCC_RS_ACCESS_TRACE_H
@@ -0,0 +1,170 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_RS_CACHE_INDEX_H
+#define BCC_RS_CACHE_INDEX_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+#include <utils/String8.h>
+
+#include "bcc/Support/Sha1Util.h"
+
+namespace android {
+class FileMap;
+} // end namespace android
+
+namespace bcc {
+
+class FileBase;
+class RSInfo;
+
+namespace rsindex {
+
+/* RS cache index file magic */
+#define RSINDEX_MAGIC      "\0rsindex"
+
+/* RS cache index file version, encoded in 4 bytes of ASCII */
+#define RSINDEX_VERSION    "002\0"
+
+/* Name of the index file in a cache directory */
+#define RSINDEX_FILENAME   "rscache.index"
+
+struct __attribute__((packed)) Header {
+  uint8_t magic[8];
+  uint8_t version[4];
+
+  // Size of each entry
+  uint32_t entrySize;
+  // Number of entries following the header, sorted by nameDigest. The RS
+  // infos of the entries follow them.
+  uint32_t numEntries;
+};
+
+struct __attribute__((packed)) Entry {
+  // SHA-1 of the name of the object file in the cache directory.
+  uint8_t nameDigest[SHA1_DIGEST_LENGTH];
+  // SHA-1 of the bitcode the object was compiled from.
+  uint8_t sourceSha1[SHA1_DIGEST_LENGTH];
+  // SHA-1 of the compile command line and the build fingerprint. See
+  // RSCacheIndex::GetDependencyDigest().
+  uint8_t dependencySha1[SHA1_DIGEST_LENGTH];
+
+  // The object when it was published. A mismatch means it was replaced
+  // behind the index's back. The modification time is in nanoseconds since a
+  // script recompiled within the same second would otherwise look unchanged.
+  uint64_t objectIno;
+  uint64_t objectSize;
+  int64_t objectMTimeNs;
+
+  // The RS info of the object, in the format of the RS info file. The offset
+  // is from the beginning of the index file and is 8-byte aligned.
+  uint32_t infoOffset;
+  uint32_t infoSize;
+};
+
+} // end namespace rsindex
+
+/*
+ * RSCacheIndex is the index of the scripts compiled into a cache directory.
+ * It keeps the RS info of each published object along with what the object
+ * was compiled from, so that loading an up-to-date script needs neither its
+ * RS info file nor a comparison against it. A script the index doesn't know,
+ * or knows as stale, is still checked against its RS info file: the index is
+ * only a shortcut and may miss updates.
+ *
+ * RSCompilerDriver updates the index each time it publishes an object, and
+ * RSExecutable each time it rewrites the RS info of one. The index file is
+ * replaced atomically, so a reader sees either the old or the new one.
+ */
+class RSCacheIndex {
+public:
+  enum LookupResult {
+    // The index has no entry for the script.
+    kNotFound,
+    // The entry is for a different source or configuration.
+    kStale,
+    // The entry matches. The object is checked against it by isPublished().
+    kUpToDate,
+  };
+
+private:
+  android::FileMap *mMap;
+  const rsindex::Entry *mEntries;
+  size_t mNumEntries;
+
+  RSCacheIndex(android::FileMap *pMap, const rsindex::Entry *pEntries,
+               size_t pNumEntries)
+    : mMap(pMap), mEntries(pEntries), mNumEntries(pNumEntries) { }
+
+  const rsindex::Entry *find(const char *pObjectPath) const;
+
+  // Add or replace the entry of pObjectPath. If pSourceSha1 and
+  // pDependencySha1 are NULL, only the RS info of an existing entry is
+  // replaced.
+  static bool Write(const char *pObjectPath, const RSInfo &pInfo,
+                    const uint8_t *pSourceSha1,
+                    const uint8_t *pDependencySha1);
+
+public:
+  // Return the path of the index of the cache directory pCacheDir.
+  static android::String8 GetPath(const char *pCacheDir);
+
+  // Digest the configuration the scripts are compiled under.
+  static void GetDependencyDigest(uint8_t pResult[SHA1_DIGEST_LENGTH],
+                                  const char *pCompileCommandLine,
+                                  const char *pBuildFingerprint);
+
+  // Map the index of pCacheDir. Return NULL if there's none or it's
+  // malformed, in which case the callers validate the scripts by themselves.
+  static RSCacheIndex *Open(const char *pCacheDir);
+
+  // Record that the object pObjectPath with the RS info pInfo has just been
+  // published for the given source and configuration. The index is created
+  // if it doesn't exist.
+  static bool Update(const char *pObjectPath, const RSInfo &pInfo,
+                     const uint8_t pSourceSha1[SHA1_DIGEST_LENGTH],
+                     const uint8_t pDependencySha1[SHA1_DIGEST_LENGTH]);
+
+  // Replace the RS info recorded for the object pObjectPath, if the index
+  // has it, after its RS info file has been rewritten.
+  static bool UpdateInfo(const char *pObjectPath, const RSInfo &pInfo);
+
+  // Look up the object pObjectPath (only its file name matters.)
+  LookupResult lookup(const char *pObjectPath,
+                      const uint8_t pSourceSha1[SHA1_DIGEST_LENGTH],
+                      const uint8_t pDependencySha1[SHA1_DIGEST_LENGTH]) const;
+
+  // Return true if the opened object pObjectFile is still the one recorded
+  // in the index.
+  bool isPublished(FileBase &pObjectFile) const;
+
+  // Return the RS info recorded for the object pObjectPath, or NULL if there
+  // is none. The result refers to the mapping of the index, which it keeps
+  // alive, so it may outlive this.
+  RSInfo *readInfo(const char *pObjectPath) const;
+
+  inline size_t size() const
+  { return mNumEntries; }
+
+  ~RSCacheIndex();
+};
+
+} // end namespace bcc
+
+#endif // BCC_RS_CACHE_INDEX_H
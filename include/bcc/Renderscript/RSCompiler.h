@@ -26,6 +26,8 @@ private:
   virtual bool beforeAddLTOPasses(Script &pScript, llvm::PassManager &pPM);
   bool addInternalizeSymbolsPass(Script &pScript, llvm::PassManager &pPM);
   bool addExpandForEachPass(Script &pScript, llvm::PassManager &pPM);
+  virtual bool beforeAddCodeGenPasses(Script &pScript,
+                                      llvm::PassManager &pPM);
 };
 
 } // end namespace bcc
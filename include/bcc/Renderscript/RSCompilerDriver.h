@@ -17,6 +17,8 @@
 #ifndef BCC_RS_COMPILER_DRIVER_H
 #define BCC_RS_COMPILER_DRIVER_H
 
+#include <llvm/Support/CodeGen.h>
+
 #include "bcc/ExecutionEngine/CompilerRTSymbolResolver.h"
 #include "bcc/ExecutionEngine/SymbolResolvers.h"
 #include "bcc/ExecutionEngine/SymbolResolverProxy.h"
@@ -47,6 +49,16 @@ private:
   // Callback before linking with the runtime library.
   RSLinkRuntimeCallback mLinkRuntimeCallback;
 
+  // If set, scripts are compiled into PIC and this callback links them into
+  // shared objects in the cache, which are then loaded by the system dynamic
+  // loader instead of librsloader.
+  RSLinkSharedObjectCallback mLinkSharedObjectCallback;
+
+  // True if mConfig was switched to PIC for the shared object mode, and the
+  // relocation model it had before.
+  bool mIsPICForced;
+  llvm::Reloc::Model mRelocModelBeforePIC;
+
   // Do we merge global variables on ARM using LLVM's optimization pass?
   // Disabling LLVM's global merge pass allows static globals to be correctly
   // emitted to ELF. This can result in decreased performance due to increased
@@ -54,6 +66,16 @@ private:
   // and work with.
   bool mEnableGlobalMerge;
 
+  // Bind the calls from the scripts to the runtime on their first execution
+  // instead of at load time.
+  bool mEnableLazyBinding;
+
+  // Instrument the scripts to count the executions of their entry points.
+  bool mEnableExecutionCounters;
+
+  // Instrument the scripts to sample the memory accesses of their kernels.
+  bool mEnableAccessTrace;
+
   // Setup the compiler config for the given script. Return true if mConfig has
   // been changed and false if it remains unchanged.
   bool setupConfig(const RSScript &pScript);
@@ -69,6 +91,16 @@ private:
                                     const RSInfo::DependencyHashTy& pSourceHash,
                                     const char* commandLineToEmbed, bool saveInfoFile, bool pDumpIR);
 
+  // The body of loadScript(). It needs no driver so that RSScriptLoadBatch
+  // can call it from its workers. The uses of pResolver are serialized by
+  // RSExecutable::Create().
+  static RSExecutable* loadScriptImpl(const char* pCacheDir, const char* pResName,
+                                      const char* pBitcode, size_t pBitcodeSize,
+                                      const char* expectedCompileCommandLine,
+                                      SymbolResolverProxy& pResolver);
+
+  friend class RSScriptLoadBatch;
+
 public:
   RSCompilerDriver(bool pUseCompilerRT = true);
   ~RSCompilerDriver();
@@ -79,6 +111,7 @@ public:
 
   void setConfig(CompilerConfig *config) {
     mConfig = config;
+    mIsPICForced = false;
   }
 
   void setDebugContext(bool v) {
@@ -93,6 +126,17 @@ public:
     return mLinkRuntimeCallback;
   }
 
+  // Enable (or disable if c is NULL) the shared object mode. The shared
+  // objects are written to the same cache path as the relocatable objects.
+  // loadScript() tells them apart from the contents of the file.
+  void setLinkSharedObjectCallback(RSLinkSharedObjectCallback c) {
+    mLinkSharedObjectCallback = c;
+  }
+
+  RSLinkSharedObjectCallback getLinkSharedObjectCallback() const {
+    return mLinkSharedObjectCallback;
+  }
+
   // This function enables/disables merging of global static variables.
   // Note that it only takes effect on ARM architectures (other architectures
   // do not offer this option).
@@ -104,6 +148,39 @@ public:
     return mEnableGlobalMerge;
   }
 
+  // This function enables/disables lazy binding of the runtime functions
+  // called by the scripts built afterwards. The SymbolResolverProxy passed to
+  // loadScript() must outlive the returned RSExecutable for such scripts.
+  void setEnableLazyBinding(bool v) {
+    mEnableLazyBinding = v;
+  }
+
+  bool getEnableLazyBinding() const {
+    return mEnableLazyBinding;
+  }
+
+  // This function enables/disables the execution counters in the scripts
+  // built afterwards. RSExecutable accumulates them in a file next to the
+  // object. Dump it with "bcc -dump-counters".
+  void setEnableExecutionCounters(bool v) {
+    mEnableExecutionCounters = v;
+  }
+
+  bool getEnableExecutionCounters() const {
+    return mEnableExecutionCounters;
+  }
+
+  // This function enables/disables the sampling of the memory accesses in the
+  // kernels of the scripts built afterwards. RSExecutable saves the samples
+  // in a file next to the object. Summarize it with "bcc -dump-access-trace".
+  void setEnableAccessTrace(bool v) {
+    mEnableAccessTrace = v;
+  }
+
+  bool getEnableAccessTrace() const {
+    return mEnableAccessTrace;
+  }
+
   // FIXME: This method accompany with loadScript and compileScript should
   //        all be const-methods. They're not now because the getAddress() in
   //        SymbolResolverInterface is not a const-method.
@@ -118,7 +195,7 @@ public:
 
   // Tries to load the the compiled bit code at pCacheDir of the given name.  It checks that
   // the file has been compiled from the same bit code and with the same compile arguments as
-  // provided.
+  // provided. See RSScriptLoadBatch to load several scripts at once.
   static RSExecutable* loadScript(const char* pCacheDir, const char* pResName, const char* pBitcode,
                                   size_t pBitcodeSize, const char* expectedCompileCommandLine,
                                   SymbolResolverProxy& pResolver);
@@ -18,12 +18,15 @@
 #define BCC_RS_EXECUTABLE_H
 
 #include <cstddef>
-
+#include <stdint.h>
 
 #include "bcc/ExecutionEngine/ObjectLoader.h"
 #include "bcc/Renderscript/RSInfo.h"
+#include "bcc/Support/LoadStats.h"
 #include "bcc/Support/Log.h"
 
+#include <utils/SortedVector.h>
+#include <utils/String8.h>
 #include <utils/Vector.h>
 
 namespace bcc {
@@ -32,6 +35,10 @@ class FileBase;
 class OutputFile;
 class SymbolResolverProxy;
 
+namespace rstrace {
+struct Record;
+} // end namespace rstrace
+
 /*
  * RSExecutable holds the build results of a RSScript.
  */
@@ -55,20 +62,88 @@ private:
   android::Vector<const char *> mPragmaKeys;
   android::Vector<const char *> mPragmaValues;
 
+  // Resolver of the runtime functions bound lazily (NULL if the script was
+  // not compiled with lazy binding.) Not owned.
+  SymbolResolverProxy *mLazyResolver;
+  unsigned mNumLazyImports;
+  volatile unsigned mNumLazyResolved;
+  // Names of the runtime functions bound lazily so far. The stubs of an
+  // import racing on several threads count once. Guarded by the lock of
+  // LazyBind().
+  android::SortedVector<android::String8> mLazyResolvedNames;
+
+  // Execution counters in the object (see createRSExecutionCountersPass()),
+  // their names and their values when they were last saved to the file.
+  const volatile uint32_t *mCounters;
+  android::Vector<const char *> mCounterNames;
+  android::Vector<uint32_t> mSyncedCounters;
+
+  // Ring buffer of the sampled memory accesses in the object (see
+  // createRSAccessTracePass()), the number of the samples written to it, the
+  // sampling parameters and the names of the sources.
+  const rstrace::Record *mAccessTrace;
+  const volatile uint32_t *mAccessTraceHead;
+  uint32_t *mAccessTraceSampling;
+  android::Vector<const char *> mAccessTraceSources;
+
+  // Where the time and the memory went when this was loaded.
+  LoadStats mLoadStats;
+
+  // Symbols still available from getSymbolAddress() after compact(): the
+  // special functions and their expanded versions.
+  bool mIsCompacted;
+  android::Vector<android::String8> mRetainedSymbolNames;
+  android::Vector<void *> mRetainedSymbolAddrs;
+
   RSExecutable(RSInfo &pInfo, FileBase &pObjFile, ObjectLoader &pLoader)
-    : mInfo(&pInfo), mIsInfoDirty(false), mObjFile(&pObjFile), mLoader(&pLoader)
+    : mInfo(&pInfo), mIsInfoDirty(false), mObjFile(&pObjFile), mLoader(&pLoader),
+      mLazyResolver(NULL), mNumLazyImports(0), mNumLazyResolved(0),
+      mCounters(NULL), mAccessTrace(NULL), mAccessTraceHead(NULL),
+      mAccessTraceSampling(NULL), mIsCompacted(false)
   { }
 
+  // Locate the execution counters in the object. Return false if they're
+  // malformed.
+  bool initExecutionCounters();
+
+  // Locate the access trace in the object. Return false if it's malformed.
+  bool initAccessTrace();
+
+  // Called by the stubs created by createRSLazyBindPass() on the first call
+  // to a runtime function. pContext is the RSExecutable.
+  static void *LazyBind(void *pContext, const char *pName);
+
 public:
   // This is a NULL-terminated string array which specifies "Special" functions
   // in Renderscript (e.g., root().)
   static const char *SpecialFunctionNames[];
 
+  // Names of the variables emitted by createRSLazyBindPass().
+  static const char LazyBindHookName[];
+  static const char LazyBindContextName[];
+  static const char LazyBindCountName[];
+
+  // Names of the variables emitted by createRSExecutionCountersPass().
+  static const char ExecutionCountersName[];
+  static const char ExecutionCounterNamesName[];
+
+  // Names of the variables emitted by createRSAccessTracePass().
+  static const char AccessTraceName[];
+  static const char AccessTraceHeadName[];
+  static const char AccessTraceSamplingName[];
+  static const char AccessTraceSourcesName[];
+
   // Return NULL on error. If the return object is non-NULL, it claims the
-  // ownership of pInfo and pObjFile.
+  // ownership of pInfo and pObjFile. If the script binds the runtime functions
+  // lazily, pResolver must outlive the returned object. pPreloadStats, if
+  // given, holds the stats of the steps before (e.g., reading pInfo) and is
+  // included in getLoadStats(). The uses of pResolver are serialized with
+  // the other loads and the lazy binds in the process, so scripts can be
+  // created from several threads.
   static RSExecutable *Create(RSInfo &pInfo,
                               FileBase &pObjFile,
-                              SymbolResolverProxy &pResolver);
+                              SymbolResolverProxy &pResolver,
+                              const LoadStats *pPreloadStats = NULL);
 
   inline const RSInfo &getInfo() const
   { return *mInfo; }
@@ -86,11 +161,49 @@ public:
   }
 
   // Interfaces to ObjectLoader
-  inline void *getSymbolAddress(const char *pName) const
-  { return mLoader->getSymbolAddress(pName); }
+  void *getSymbolAddress(const char *pName) const;
+
+  // Release the symbol table and the other metadata of the loaded object once
+  // the addresses of the exports are resolved (i.e., right after Create().)
+  // Only the special functions (see SpecialFunctionNames) and their expanded
+  // versions can be looked up by getSymbolAddress() afterwards. Scripts built
+  // with debug information are left intact.
+  void compact();
 
   bool syncInfo(bool pForce = false);
 
+  // The stats of the load which created this. See also
+  // LoadStats::GetProcessTotal().
+  inline const LoadStats &getLoadStats() const
+  { return mLoadStats; }
+
+  // Interfaces to the execution counters. There're none unless the script was
+  // built with them enabled.
+  inline size_t getNumExecutionCounters() const
+  { return mCounterNames.size(); }
+  inline const char *getExecutionCounterName(size_t pIdx) const
+  { return mCounterNames[pIdx]; }
+  // The value of a counter in the object. It wraps around at 2^32; the
+  // counters file holds the full counts.
+  inline uint32_t getExecutionCounter(size_t pIdx) const
+  { return mCounters[pIdx]; }
+
+  // Add the counts since the last call to the counters file next to the
+  // object (see RSExecutionCounters::GetPath().) Called on destruction.
+  bool syncExecutionCounters();
+
+  // Interfaces to the access trace. There's none unless the script was built
+  // with it enabled.
+  inline bool hasAccessTrace() const
+  { return (mAccessTrace != NULL); }
+
+  // Sample the elements whose x satisfies (x & pMask) < pBurst from now on.
+  void setAccessTraceSampling(uint32_t pMask, uint32_t pBurst);
+
+  // Save the samples in the ring buffer to the trace file next to the object
+  // (see RSAccessTrace::GetPath().) Called on destruction.
+  bool syncAccessTrace();
+
   // Disassemble and dump the relocated functions to the pOutput.
   void dumpDisassembly(OutputFile &pOutput) const;
 
@@ -101,6 +214,13 @@ public:
   inline const android::Vector<void *> &getExportForeachFuncAddrs() const
   { return mExportForeachFuncAddrs; }
 
+  // Number of runtime functions bound lazily and how many of them have been
+  // resolved so far.
+  inline unsigned getNumLazyImports() const
+  { return mNumLazyImports; }
+  inline unsigned getNumLazyResolved() const
+  { return mNumLazyResolved; }
+
   inline const android::Vector<const char *> &getPragmaKeys() const
   { return mPragmaKeys; }
   inline const android::Vector<const char *> &getPragmaValues() const
@@ -0,0 +1,97 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_RS_EXECUTION_COUNTERS_H
+#define BCC_RS_EXECUTION_COUNTERS_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace bcc {
+
+namespace rscounters {
+
+// The magic number of the execution counters file.
+#define RSCOUNTERS_MAGIC           "\0rscount"
+#define RSCOUNTERS_MAGIC_LENGTH    8
+// Increase this when the file format changes.
+#define RSCOUNTERS_VERSION         "001"
+#define RSCOUNTERS_VERSION_LENGTH  4
+
+// Followed by numCounters uint64_t values and then the names of the counters
+// separated by NUL (strPoolSize bytes.)
+struct Header {
+  uint8_t magic[RSCOUNTERS_MAGIC_LENGTH];
+  uint8_t version[RSCOUNTERS_VERSION_LENGTH];
+
+  uint32_t numCounters;
+  uint32_t strPoolSize;
+  // Keep the values 8-byte aligned.
+  uint32_t padding;
+};
+
+} // end namespace rscounters
+
+/*
+ * RSExecutionCounters holds the values of the counters inserted by
+ * createRSExecutionCountersPass(), accumulated over the runs of a script. It
+ * is saved next to the object file by RSExecutable.
+ */
+class RSExecutionCounters {
+private:
+  // Names of the counters separated by NUL.
+  std::string mNames;
+  android::Vector<uint32_t> mNameOffsets;
+  android::Vector<uint64_t> mValues;
+
+public:
+  // Return the path of the counters file for the given object file.
+  static android::String8 GetPath(const char *pObjectPath);
+
+  RSExecutionCounters() { }
+
+  void clear();
+
+  void add(const char *pName, uint64_t pValue);
+
+  // Add the values in pOther to this if both have the same counters. Return
+  // false and leave this unchanged otherwise (e.g., the script was rebuilt.)
+  bool accumulate(const RSExecutionCounters &pOther);
+
+  // Return false if the file doesn't exist or is malformed. This is left
+  // empty in that case.
+  bool readFromFile(const char *pPath);
+
+  // The file is replaced atomically.
+  bool writeToFile(const char *pPath) const;
+
+  inline size_t size() const
+  { return mValues.size(); }
+
+  inline const char *getName(size_t pIdx) const
+  { return mNames.c_str() + mNameOffsets[pIdx]; }
+
+  inline uint64_t getValue(size_t pIdx) const
+  { return mValues[pIdx]; }
+};
+
+} // end namespace bcc
+
+#endif // BCC_RS_EXECUTION_COUNTERS_H
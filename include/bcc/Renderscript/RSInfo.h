@@ -28,6 +28,10 @@
 #include <utils/String8.h>
 #include <utils/Vector.h>
 
+namespace android {
+class FileMap;
+} // end namespace android
+
 namespace llvm {
 class Module;
 }
@@ -43,13 +47,22 @@ class RSScript;
 
 typedef llvm::Module* (*RSLinkRuntimeCallback) (bcc::RSScript *, llvm::Module *, llvm::Module *);
 
+// Links the position-independent relocatable object at the first path into a
+// shared object at the second path. Returns true on success. The second path
+// is a fresh temporary file which the driver renames over the cached shared
+// object afterwards, so the callback may write it in place.
+typedef bool (*RSLinkSharedObjectCallback) (const char *, const char *);
+
 namespace rsinfo {
 
 /* RS info file magic */
 #define RSINFO_MAGIC      "\0rsinfo\n"
 
 /* RS info file version, encoded in 4 bytes of ASCII */
-#define RSINFO_VERSION    "006\0"
+#define RSINFO_VERSION    "008\0"
+
+/* Alignment of the lists in the RS info, in bytes */
+#define RSINFO_LIST_ALIGNMENT 4
 
 struct __attribute__((packed)) ListHeader {
   // The offset from the beginning of the file of data
@@ -88,6 +101,7 @@ struct __attribute__((packed)) Header {
   struct ListHeader exportVarNameList;
   struct ListHeader exportFuncNameList;
   struct ListHeader exportForeachFuncList;
+  struct ListHeader exportSymbolList;
 };
 
 // Use value -1 as an invalid string index marker. No need to declare with
@@ -117,6 +131,18 @@ struct __attribute__((packed)) ExportForeachFuncItem {
   uint32_t signature;
 };
 
+// Location of an exported symbol in the object file. The exported variables,
+// functions and (expanded) foreach functions are listed in this order.
+struct __attribute__((packed)) ExportSymbolItem {
+  // Index of the section which defines the symbol. gInvalidSectionIndex if
+  // the location is unknown.
+  uint32_t section;
+  // Offset of the symbol from the beginning of the section.
+  uint32_t offset;
+};
+
+const uint32_t gInvalidSectionIndex = 0;
+
 // Return the human-readable name of the given rsinfo::*Item in the template
 // parameter. This is for debugging and error message.
 template<typename Item>
@@ -142,17 +168,76 @@ template<>
 inline const char *GetItemTypeName<ExportForeachFuncItem>()
 { return "rs export foreach"; }
 
+template<>
+inline const char *GetItemTypeName<ExportSymbolItem>()
+{ return "rs export symbol"; }
+
+// A list of items in the format of the RS info file. The items of an RSInfo
+// read from a file are used in place (see RSInfo::ReadFromBuffer()); the ones
+// of an RSInfo built by RSInfo::ExtractFromSource() are held by the list.
+template<typename ItemType>
+class ItemList {
+private:
+  android::Vector<ItemType> mItems;
+
+  // The items in place. NULL if they're in mItems.
+  const ItemType *mView;
+  size_t mViewSize;
+
+public:
+  ItemList() : mView(NULL), mViewSize(0) { }
+
+  inline void push(const ItemType &pItem) {
+    mItems.push(pItem);
+  }
+
+  inline void clear() {
+    mItems.clear();
+    mView = NULL;
+    mViewSize = 0;
+  }
+
+  inline ItemType &editItemAt(size_t pIdx) {
+    return mItems.editItemAt(pIdx);
+  }
+
+  // Refer to pCount items at pItems (which must outlive this) instead.
+  inline void setView(const ItemType *pItems, size_t pCount) {
+    mItems.clear();
+    mView = pItems;
+    mViewSize = pCount;
+  }
+
+  inline size_t size() const {
+    return (mView != NULL) ? mViewSize : mItems.size();
+  }
+
+  inline const ItemType *array() const {
+    return (mView != NULL) ? mView : mItems.array();
+  }
+
+  inline const ItemType &operator[](size_t pIdx) const {
+    return array()[pIdx];
+  }
+};
+
 } // end namespace rsinfo
 
 class RSInfo {
+  // RSCacheIndex::readInfo() hands out infos which retain its mapping.
+  friend class RSCacheIndex;
+
 public:
   typedef const uint8_t* DependencyHashTy;
-  typedef android::Vector<std::pair<const char*, const char*> > PragmaListTy;
-  typedef android::Vector<uint32_t> ObjectSlotListTy;
-  typedef android::Vector<const char *> ExportVarNameListTy;
-  typedef android::Vector<const char *> ExportFuncNameListTy;
-  typedef android::Vector<std::pair<const char *,
-                                    uint32_t> > ExportForeachFuncListTy;
+  // The strings in the items are indices into the string pool. They're
+  // validated on read, so getString() is safe on them.
+  typedef rsinfo::ItemList<rsinfo::PragmaItem> PragmaListTy;
+  typedef rsinfo::ItemList<rsinfo::ObjectSlotItem> ObjectSlotListTy;
+  typedef rsinfo::ItemList<rsinfo::ExportVarNameItem> ExportVarNameListTy;
+  typedef rsinfo::ItemList<rsinfo::ExportFuncNameItem> ExportFuncNameListTy;
+  typedef rsinfo::ItemList<rsinfo::ExportForeachFuncItem>
+      ExportForeachFuncListTy;
+  typedef rsinfo::ItemList<rsinfo::ExportSymbolItem> ExportSymbolListTy;
 
 public:
   // Return the path of the RS info file corresponded to the given output
@@ -168,8 +253,17 @@ private:
 
   rsinfo::Header mHeader;
 
+  // The string pool built by ExtractFromSource(). NULL if the info was read.
   char *mStringPool;
 
+  // The string pool in use. It's either mStringPool or in place in the data
+  // the info was read from.
+  const char *mStrings;
+
+  // Mapping of the file the info was read from. The string pool and the lists
+  // refer to it.
+  android::FileMap *mMap;
+
   // Pointer to the hash of the souce file, somewhere in the string pool.
   DependencyHashTy mSourceHash;
   // Pointer to the command used to compile this source, somewhere in the string pool.
@@ -183,14 +277,15 @@ private:
   ExportVarNameListTy mExportVarNames;
   ExportFuncNameListTy mExportFuncNames;
   ExportForeachFuncListTy mExportForeachFuncs;
+  ExportSymbolListTy mExportSymbols;
 
   // Initialize an empty RSInfo with its size of string pool is pStringPoolSize.
   RSInfo(size_t pStringPoolSize);
 
-  // layout() assigns value of offset in each ListHeader (i.e., it decides where
-  // data should go in the file.) It also updates fields other than offset to
-  // reflect the current RSInfo object states to mHeader.
-  bool layout(off_t initial_offset);
+  // layout() assigns value of offset in each ListHeader of pHeader (i.e., it
+  // decides where data should go in the file.) It also updates fields other
+  // than offset to reflect the current RSInfo object states to pHeader.
+  bool layout(off_t initial_offset, rsinfo::Header &pHeader) const;
 
 public:
   ~RSInfo();
@@ -201,12 +296,33 @@ public:
                                    const char* compileCommandLineToEmbed,
                                    const char* buildFingerprintToEmbed);
 
-  // Implemented in RSInfoReader.cpp.
+  // Implemented in RSInfoReader.cpp. The file is mapped and retained by the
+  // result. Nothing is copied out of it.
   static RSInfo *ReadFromFile(InputFile &pInput);
 
+  // Same as above but on an info already in memory (e.g., embedded in an
+  // object). pData must be kept alive and unchanged as long as the result.
+  // pName is used in the messages only.
+  static RSInfo *ReadFromBuffer(const uint8_t *pData, size_t pSize,
+                                const char *pName);
+
   // Implemneted in RSInfoWriter.cpp
   bool write(OutputFile &pOutput);
 
+  // Write the info to the file pPath. The file is replaced by a rename, never
+  // truncated, since it may be mapped by a loaded info (even this one.)
+  bool writeToFile(const char *pPath);
+
+  // Append the info in the format of the file to pResult. The offsets are
+  // relative to the beginning of the info, so the result can be read in place
+  // by ReadFromBuffer() wherever it ends up (see createRSEmbedInfoPass().)
+  bool write(std::string &pResult) const;
+
+  // Record the locations of the exported symbols in the compiled object so
+  // that they can be computed without looking up the symbol table at load
+  // time. Implemented in RSInfoExportSymbols.cpp.
+  bool recordExportSymbols(const void *pObject, size_t pObjectSize);
+
   void dump() const;
 
   // const getter
@@ -224,8 +340,15 @@ public:
   { return mExportFuncNames; }
   inline const ExportForeachFuncListTy &getExportForeachFuncs() const
   { return mExportForeachFuncs; }
+  inline const ExportSymbolListTy &getExportSymbols() const
+  { return mExportSymbols; }
 
   const char *getStringFromPool(rsinfo::StringIndexTy pStrIdx) const;
+
+  // Unchecked version of getStringFromPool() for the indices in the lists.
+  inline const char *getString(rsinfo::StringIndexTy pStrIdx) const
+  { return &mStrings[ pStrIdx ]; }
+
   rsinfo::StringIndexTy getStringIdxInPool(const char *pStr) const;
 
   // setter
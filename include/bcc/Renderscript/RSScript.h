@@ -21,6 +21,10 @@
 #include "bcc/Renderscript/RSInfo.h"
 #include "bcc/Support/Sha1Util.h"
 
+namespace bcinfo {
+class MetadataExtractor;
+} // end namespace bcinfo
+
 namespace bcc {
 
 class RSScript;
@@ -49,6 +53,20 @@ private:
 
   bool mEmbedInfo;
 
+  // Bind the calls to the runtime lazily. See createRSLazyBindPass().
+  bool mLazyBinding;
+
+  // Count the executions of the entry points. See
+  // createRSExecutionCountersPass().
+  bool mExecutionCounters;
+
+  // Sample the memory accesses of the kernels. See createRSAccessTracePass().
+  bool mAccessTrace;
+
+  // The RS metadata of the module, extracted on the first getMetadata() and
+  // shared by the RS passes for the rest of the compilation.
+  bcinfo::MetadataExtractor *mMetadata;
+
 private:
   // This will be invoked when the containing source has been reset.
   virtual bool doReset();
@@ -60,6 +78,7 @@ public:
 
   virtual ~RSScript() {
     delete mInfo;
+    invalidateMetadata();
   }
 
   // Set the associated RSInfo of the script.
@@ -98,6 +117,37 @@ public:
   bool getEmbedInfo() const {
     return mEmbedInfo;
   }
+
+  void setLazyBinding(bool pEnable) {
+    mLazyBinding = pEnable;
+  }
+
+  bool getLazyBinding() const {
+    return mLazyBinding;
+  }
+
+  void setExecutionCounters(bool pEnable) {
+    mExecutionCounters = pEnable;
+  }
+
+  bool getExecutionCounters() const {
+    return mExecutionCounters;
+  }
+
+  void setAccessTrace(bool pEnable) {
+    mAccessTrace = pEnable;
+  }
+
+  bool getAccessTrace() const {
+    return mAccessTrace;
+  }
+
+  // Return the RS metadata of the module, or NULL if it's malformed. The
+  // metadata is extracted only once. Call invalidateMetadata() after changing
+  // the named metadata of the module.
+  const bcinfo::MetadataExtractor *getMetadata();
+
+  void invalidateMetadata();
 };
 
 } // end namespace bcc
@@ -0,0 +1,103 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_RS_SCRIPT_LOAD_BATCH_H
+#define BCC_RS_SCRIPT_LOAD_BATCH_H
+
+#include <cstddef>
+
+#include <pthread.h>
+
+#include <utils/Vector.h>
+
+namespace bcc {
+
+class RSExecutable;
+class SymbolResolverProxy;
+
+// Arguments to RSCompilerDriver::loadScript() for one script in a batch.
+struct RSScriptLoadRequest {
+  const char *cacheDir;
+  const char *resName;
+  const char *bitcode;
+  size_t bitcodeSize;
+  const char *expectedCompileCommandLine;
+};
+
+/*
+ * RSScriptLoadBatch loads the cached objects of several scripts at once.
+ * Readahead is issued on all the object and RS info files upfront, then a
+ * small pool of threads opens, hashes and validates the scripts in parallel.
+ * The relocations, which use the shared SymbolResolverProxy, are serialized.
+ * The results are collected in any order with wait().
+ *
+ * The strings and the bitcode referenced by the requests and the resolver
+ * must stay valid until the batch is destroyed.
+ */
+class RSScriptLoadBatch {
+private:
+  struct Item {
+    RSScriptLoadRequest request;
+    RSExecutable *result;
+    bool done;
+    bool taken;
+  };
+
+  android::Vector<Item> mItems;
+  android::Vector<pthread_t> mThreads;
+
+  SymbolResolverProxy &mResolver;
+
+  // Index of the next request to be picked up by a worker.
+  volatile size_t mNextItem;
+
+  // Guards mItems once the workers are started.
+  pthread_mutex_t mItemLock;
+  pthread_cond_t mItemDone;
+
+  RSScriptLoadBatch(SymbolResolverProxy &pResolver);
+
+  // Ask the kernel to start reading the files of the script in the
+  // background.
+  static void Readahead(const RSScriptLoadRequest &pRequest);
+
+  static void *WorkerMain(void *pBatch);
+
+  void runWorker();
+
+public:
+  // Start loading pNumRequests scripts with at most pMaxThreads threads (0 to
+  // decide from the number of CPUs.) Return NULL on error.
+  static RSScriptLoadBatch *Start(const RSScriptLoadRequest *pRequests,
+                                  size_t pNumRequests,
+                                  SymbolResolverProxy &pResolver,
+                                  unsigned pMaxThreads = 0);
+
+  inline size_t size() const
+  { return mItems.size(); }
+
+  // Block until the pIdx-th script is loaded and return it, or NULL if it
+  // could not be loaded from the cache (e.g., it needs to be rebuilt.) The
+  // caller owns the returned object. Each result can be taken only once.
+  RSExecutable *wait(size_t pIdx);
+
+  // Wait for all the workers to finish. The results not taken are deleted.
+  ~RSScriptLoadBatch();
+};
+
+} // end namespace bcc
+
+#endif // BCC_RS_SCRIPT_LOAD_BATCH_H
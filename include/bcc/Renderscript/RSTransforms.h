@@ -21,12 +21,34 @@ namespace llvm {
   class ModulePass;
 }
 
+namespace bcinfo {
+  class MetadataExtractor;
+}
+
 namespace bcc {
 
+class RSInfo;
+
+// The passes taking pMetadata keep a reference to it. It must outlive them and
+// describe the module they run on (see RSScript::getMetadata().)
+llvm::ModulePass *
+createRSForEachExpandPass(const bcinfo::MetadataExtractor &pMetadata,
+                          bool pEnableStepOpt);
+
+// pInfo is embedded in binary along with the text if it's not NULL.
+llvm::ModulePass *
+createRSEmbedInfoPass(const bcinfo::MetadataExtractor &pMetadata,
+                      const RSInfo *pInfo);
+
+llvm::ModulePass * createRSLazyBindPass();
+
+llvm::ModulePass *
+createRSExecutionCountersPass(const bcinfo::MetadataExtractor &pMetadata);
+
 llvm::ModulePass *
-createRSForEachExpandPass(bool pEnableStepOpt);
+createRSAccessTracePass(const bcinfo::MetadataExtractor &pMetadata);
 
-llvm::ModulePass * createRSEmbedInfoPass();
+llvm::ModulePass * createRSSectionLayoutPass();
 
 } // end namespace bcc
 
@@ -18,6 +18,7 @@
 #define BCC_SUPPORT_FILE_BASE_H
 
 #include <fcntl.h>
+#include <sys/stat.h>
 #include <unistd.h>
 #include <string>
 #include <system_error>
@@ -128,6 +129,9 @@ public:
 
   size_t getSize();
 
+  // Get the status of the opened file (i.e., fstat().) Return false on error.
+  bool getStat(struct stat &pResult);
+
   off_t seek(off_t pOffset);
   off_t tell();
 
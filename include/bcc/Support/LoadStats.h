@@ -0,0 +1,133 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_SUPPORT_LOAD_STATS_H
+#define BCC_SUPPORT_LOAD_STATS_H
+
+#include <stdint.h>
+
+#include <cstddef>
+
+namespace bcc {
+
+/*
+ * LoadStats breaks down the time and the memory spent loading a compiled
+ * script. It's filled by RSCompilerDriver::loadScript(), RSExecutable::Create()
+ * and ObjectLoader::Load(), and kept in the resulting RSExecutable. The stats
+ * of all the loads in the process are summed up in GetProcessTotal().
+ */
+class LoadStats {
+public:
+  enum Phase {
+    kLockPhase,          // Acquiring the file locks.
+    kFileIOPhase,        // Opening and mapping the object file.
+    kSHA1Phase,          // Hashing the bitcode to validate the cache.
+    kInfoParsePhase,     // Reading the RS info file.
+    kSectionCopyPhase,   // Parsing the object and copying its sections.
+    kRelocationPhase,    // Applying the relocations (excluding the lookups.)
+    kSymbolLookupPhase,  // Resolving the undefined symbols.
+    kNumPhases
+  };
+
+  enum MemoryKind {
+    kTextMemory,         // Executable sections.
+    kDataMemory,         // Other allocated sections with contents.
+    kBSSMemory,          // Zero-initialized sections.
+    kRelocationMemory,   // Relocation tables.
+    kDebugMemory,        // Copy of the object kept for the debugger.
+    kNumMemoryKinds
+  };
+
+  // A clock for measuring the phases.
+  class Timer {
+  private:
+    uint64_t mStart;
+
+  public:
+    Timer();
+
+    // Return the nanoseconds since the timer was created or last restarted.
+    uint64_t elapsed() const;
+
+    void restart();
+  };
+
+private:
+  unsigned mNumLoads;
+  uint64_t mTimes[kNumPhases];
+  size_t mBytes[kNumMemoryKinds];
+  unsigned mNumMappings;
+
+public:
+  LoadStats();
+
+  void reset();
+
+  inline void addTime(Phase pPhase, uint64_t pNanoseconds)
+  { mTimes[pPhase] += pNanoseconds; }
+
+  // Add the time elapsed on pTimer to pPhase and restart the timer.
+  inline void addTime(Phase pPhase, Timer &pTimer) {
+    addTime(pPhase, pTimer.elapsed());
+    pTimer.restart();
+  }
+
+  inline void addBytes(MemoryKind pKind, size_t pBytes)
+  { mBytes[pKind] += pBytes; }
+
+  // Separate memory regions the object is placed in, each of which is mapped
+  // and protected on its own: the allocated sections of a relocatable object
+  // (see librsloader) or the PT_LOAD segments of a shared object.
+  inline void addMappings(unsigned pNumMappings)
+  { mNumMappings += pNumMappings; }
+
+  // Mark this as the stats of one complete load.
+  inline void setLoaded()
+  { mNumLoads = 1; }
+
+  void accumulate(const LoadStats &pOther);
+
+  inline unsigned getNumLoads() const
+  { return mNumLoads; }
+
+  // In nanoseconds.
+  inline uint64_t getTime(Phase pPhase) const
+  { return mTimes[pPhase]; }
+
+  uint64_t getTotalTime() const;
+
+  inline size_t getBytes(MemoryKind pKind) const
+  { return mBytes[pKind]; }
+
+  inline unsigned getNumMappings() const
+  { return mNumMappings; }
+
+  static const char *GetPhaseName(Phase pPhase);
+  static const char *GetMemoryKindName(MemoryKind pKind);
+
+  // Print the stats to the log (with ALOGV) prefixed by pTitle.
+  void dump(const char *pTitle) const;
+
+  // Add pStats to the process-wide total. Thread-safe.
+  static void AddToProcessTotal(const LoadStats &pStats);
+
+  // Return a snapshot of the process-wide total. Thread-safe.
+  static LoadStats GetProcessTotal();
+};
+
+} // end namespace bcc
+
+#endif // BCC_SUPPORT_LOAD_STATS_H
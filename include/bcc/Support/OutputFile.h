@@ -40,6 +40,12 @@ public:
   // returns a non-NULL object if everything goes well and user should later
   // use delete operator to destroy it by itself.
   llvm::raw_fd_ostream *dup();
+
+  // Create an empty file with a unique name next to pPath (so that it can
+  // later be rename()'d over pPath) and return its name. Unlike a name built
+  // from the pid, this is safe against other threads of the same process
+  // writing the same pPath. Return an empty string on failure.
+  static std::string CreateTemporary(const std::string &pPath);
 };
 
 } // end namespace bcc
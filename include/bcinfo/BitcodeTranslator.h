@@ -18,6 +18,8 @@
 #define __ANDROID_BCINFO_BITCODETRANSLATOR_H__
 
 #include <cstddef>
+#include <memory>
+#include <string>
 
 namespace bcinfo {
 
@@ -29,6 +31,14 @@ class BitcodeTranslator {
   size_t mTranslatedBitcodeSize;
   unsigned int mVersion;
 
+  // The translation mTranslatedBitcode points into, shared with the cache of
+  // translations. Empty if the bitcode didn't need translating.
+  std::shared_ptr<const std::string> mTranslation;
+
+  // Where to keep translations across processes. Empty if they're kept only
+  // in memory.
+  std::string mCacheDir;
+
  public:
   /**
    * Translates \p bitcode of a particular \p version to the latest version.
@@ -42,6 +52,20 @@ class BitcodeTranslator {
 
   ~BitcodeTranslator();
 
+  /**
+   * Also look up and store the translations in \p cacheDir, so that they're
+   * reused by the next processes. Translations are always cached in memory,
+   * keyed by a digest of the input bitcode and the translator version.
+   * Nothing is cached on disk unless the caller (i.e., the Renderscript
+   * runtime, which knows the cache directory of the app) calls this before
+   * translate().
+   *
+   * \param cacheDir - existing directory writable by this process.
+   */
+  void setCacheDir(const char *cacheDir) {
+    mCacheDir = cacheDir;
+  }
+
   /**
    * Translate the supplied bitcode to the latest supported version.
    *
@@ -23,6 +23,7 @@
 namespace llvm {
   class Module;
   class NamedMDNode;
+  class Value;
 }
 
 namespace bcinfo {
@@ -34,6 +35,10 @@ enum RSFloatPrecision {
 
 class MetadataExtractor {
  private:
+  // Holds all the strings extracted (see createStringFromValue()).
+  class StringArena;
+  StringArena *mStrings;
+
   const llvm::Module *mModule;
   const char *mBitcode;
   size_t mBitcodeSize;
@@ -59,6 +64,7 @@ class MetadataExtractor {
   enum RSFloatPrecision mRSFloatPrecision;
 
   // Helper functions for extraction
+  const char *createStringFromValue(llvm::Value *v);
   bool populateVarNameMetadata(const llvm::NamedMDNode *VarNameMetadata);
   bool populateFuncNameMetadata(const llvm::NamedMDNode *FuncNameMetadata);
   bool populateForEachMetadata(const llvm::NamedMDNode *Names,
@@ -70,6 +76,10 @@ class MetadataExtractor {
   /**
    * Reads metadata from \p bitcode.
    *
+   * Only the module-level metadata is read from the bitstream; the function
+   * bodies are skipped. Bitcode the fast scan doesn't understand is fully
+   * parsed instead.
+   *
    * \param bitcode - input bitcode string.
    * \param bitcodeSize - length of \p bitcode string (in bytes).
    */
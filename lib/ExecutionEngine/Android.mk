@@ -22,10 +22,14 @@ LOCAL_PATH := $(call my-dir)
 #=====================================================================
 
 libbcc_executionengine_SRC_FILES := \
+  DyldObjectLoaderImpl.cpp \
   ELFObjectLoaderImpl.cpp \
   GDBJIT.cpp \
   GDBJITRegistrar.cpp \
+  HugePageText.cpp \
   ObjectLoader.cpp \
+  PerfMap.cpp \
+  RelocationCache.cpp \
   SymbolResolverProxy.cpp \
   SymbolResolvers.cpp
 
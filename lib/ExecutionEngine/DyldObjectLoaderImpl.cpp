@@ -0,0 +1,292 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "DyldObjectLoaderImpl.h"
+
+#if !defined(_WIN32)  /* TODO create a HAVE_DLFCN_H */
+#include <dlfcn.h>
+#endif
+
+#include <cassert>
+
+#include <llvm/Support/ELF.h>
+
+#include "bcc/ExecutionEngine/HugePageText.h"
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+#ifdef __LP64__
+typedef llvm::ELF::Elf64_Ehdr ElfEhdr;
+typedef llvm::ELF::Elf64_Phdr ElfPhdr;
+typedef llvm::ELF::Elf64_Shdr ElfShdr;
+typedef llvm::ELF::Elf64_Sym ElfSym;
+#else
+typedef llvm::ELF::Elf32_Ehdr ElfEhdr;
+typedef llvm::ELF::Elf32_Phdr ElfPhdr;
+typedef llvm::ELF::Elf32_Shdr ElfShdr;
+typedef llvm::ELF::Elf32_Sym ElfSym;
+#endif
+
+bool DyldObjectLoaderImpl::IsSharedObject(const void *pMem, size_t pMemSize) {
+  if (pMemSize < sizeof(ElfEhdr)) {
+    return false;
+  }
+
+  const ElfEhdr *elf_header = reinterpret_cast<const ElfEhdr *>(pMem);
+  return (elf_header->checkMagic() &&
+          (elf_header->e_type == llvm::ELF::ET_DYN));
+}
+
+bool DyldObjectLoaderImpl::load(const void *pMem, size_t pMemSize) {
+  if (!IsSharedObject(pMem, pMemSize)) {
+    ALOGE("%s is not a shared object!", mPath.c_str());
+    return false;
+  }
+
+  const uint8_t *image = reinterpret_cast<const uint8_t *>(pMem);
+  const ElfEhdr *elf_header = reinterpret_cast<const ElfEhdr *>(pMem);
+
+  if ((elf_header->e_shoff > pMemSize) ||
+      ((pMemSize - elf_header->e_shoff) <
+          (sizeof(ElfShdr) * elf_header->e_shnum))) {
+    ALOGE("Invalid section header table in %s! (e_shoff = %lu, e_shnum = %u)",
+          mPath.c_str(), static_cast<unsigned long>(elf_header->e_shoff),
+          static_cast<unsigned>(elf_header->e_shnum));
+    return false;
+  }
+
+  const ElfShdr *section_header_table =
+      reinterpret_cast<const ElfShdr *>(image + elf_header->e_shoff);
+
+  // Only the information of the symbols are needed from the file. The
+  // contents of the sections are mapped by the dynamic loader.
+  for (unsigned i = 0; i < elf_header->e_shnum; i++) {
+    const ElfShdr &symtab = section_header_table[i];
+    if (symtab.sh_type != llvm::ELF::SHT_DYNSYM) {
+      continue;
+    }
+
+    if ((symtab.sh_link >= elf_header->e_shnum) ||
+        (symtab.sh_offset > pMemSize) ||
+        ((pMemSize - symtab.sh_offset) < symtab.sh_size)) {
+      ALOGE("Invalid .dynsym section in %s!", mPath.c_str());
+      return false;
+    }
+
+    const ElfShdr &strtab = section_header_table[symtab.sh_link];
+    if ((strtab.sh_offset > pMemSize) ||
+        ((pMemSize - strtab.sh_offset) < strtab.sh_size)) {
+      ALOGE("Invalid string table for .dynsym in %s!", mPath.c_str());
+      return false;
+    }
+
+    const ElfSym *symbols =
+        reinterpret_cast<const ElfSym *>(image + symtab.sh_offset);
+    const char *strings =
+        reinterpret_cast<const char *>(image + strtab.sh_offset);
+
+    // The first entry in the symbol table is always the undefined symbol.
+    for (size_t j = 1, e = symtab.sh_size / sizeof(ElfSym); j < e; j++) {
+      const ElfSym &symbol = symbols[j];
+      if ((symbol.st_shndx == llvm::ELF::SHN_UNDEF) ||
+          (symbol.st_name >= strtab.sh_size)) {
+        continue;
+      }
+
+      const char *name = &strings[symbol.st_name];
+      if (name[0] == '\0') {
+        continue;
+      }
+
+      SymbolInfo info = { static_cast<size_t>(symbol.st_size),
+                          symbol.getType() };
+      llvm::StringMapEntry<SymbolInfo> &entry =
+          mSymbols.GetOrCreateValue(name, info);
+
+      // dlsym() returns the load bias plus the value only for a plain
+      // function or object. The address of a TLS symbol is per thread, and
+      // the one of an IFUNC is what its resolver returns.
+      if ((mAnchorSymbol == NULL) &&
+          (symbol.st_shndx < llvm::ELF::SHN_LORESERVE) &&
+          ((symbol.getType() == llvm::ELF::STT_FUNC) ||
+           (symbol.getType() == llvm::ELF::STT_OBJECT))) {
+        mAnchorSymbol = entry.getKeyData();
+        mAnchorValue = static_cast<uintptr_t>(symbol.st_value);
+      }
+    }
+  }
+
+  // Remember where the text is for remapText().
+  if ((elf_header->e_phoff <= pMemSize) &&
+      ((pMemSize - elf_header->e_phoff) >=
+          (sizeof(ElfPhdr) * elf_header->e_phnum))) {
+    const ElfPhdr *program_header_table =
+        reinterpret_cast<const ElfPhdr *>(image + elf_header->e_phoff);
+    for (unsigned i = 0; i < elf_header->e_phnum; i++) {
+      const ElfPhdr &segment = program_header_table[i];
+      if ((segment.p_type == llvm::ELF::PT_LOAD) &&
+          ((segment.p_flags & llvm::ELF::PF_X) != 0)) {
+        Segment text = { static_cast<uintptr_t>(segment.p_vaddr),
+                         static_cast<size_t>(segment.p_memsz) };
+        mTextSegments.push_back(text);
+      }
+    }
+  }
+
+  return true;
+}
+
+void DyldObjectLoaderImpl::remapText() const {
+#if !defined(_WIN32)
+  if (mAnchorSymbol == NULL) {
+    return;
+  }
+
+  void *anchor = ::dlsym(mHandle, mAnchorSymbol);
+  if (anchor == NULL) {
+    return;
+  }
+  uintptr_t load_bias = reinterpret_cast<uintptr_t>(anchor) - mAnchorValue;
+
+  for (size_t i = 0, e = mTextSegments.size(); i != e; i++) {
+    const Segment &text = mTextSegments[i];
+    HugePageText::Remap(reinterpret_cast<void *>(load_bias + text.vaddr),
+                        text.size);
+  }
+#endif
+  return;
+}
+
+bool DyldObjectLoaderImpl::relocate(SymbolResolverInterface &pResolver) {
+#if !defined(_WIN32)
+  mHandle = ::dlopen(mPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+  if (mHandle == NULL) {
+    ALOGE("Failed to load shared object %s! (%s)", mPath.c_str(), ::dlerror());
+    return false;
+  }
+
+  if (mAnchorSymbol != NULL) {
+    Dl_info info;
+    void *anchor = ::dlsym(mHandle, mAnchorSymbol);
+    if ((anchor != NULL) && (::dladdr(anchor, &info) != 0)) {
+      mLoadBase = info.dli_fbase;
+    }
+  }
+
+  if (HugePageText::IsEnabled()) {
+    remapText();
+  }
+  return true;
+#else
+  ALOGE("Loading shared object %s is not supported on this platform!",
+        mPath.c_str());
+  return false;
+#endif
+}
+
+void *DyldObjectLoaderImpl::getSymbolAddress(const char *pName) const {
+  if (mHandle == NULL) {
+    return NULL;
+  }
+
+#if !defined(_WIN32)
+  // Only look up the symbols defined in this object. Otherwise dlsym() would
+  // return the ones from its dependencies.
+  if (mIsCompacted) {
+    Dl_info info;
+    void *addr = ::dlsym(mHandle, pName);
+    if ((addr == NULL) || (mLoadBase == NULL) ||
+        (::dladdr(addr, &info) == 0) || (info.dli_fbase != mLoadBase)) {
+      ALOGV("Request symbol '%s' is not found in the object!", pName);
+      return NULL;
+    }
+    return addr;
+  }
+
+  if (mSymbols.find(pName) == mSymbols.end()) {
+    ALOGV("Request symbol '%s' is not found in the object!", pName);
+    return NULL;
+  }
+  return ::dlsym(mHandle, pName);
+#else
+  return NULL;
+#endif
+}
+
+size_t DyldObjectLoaderImpl::getSymbolSize(const char *pName) const {
+  llvm::StringMap<SymbolInfo>::const_iterator symbol = mSymbols.find(pName);
+  if (symbol == mSymbols.end()) {
+    ALOGV("Request symbol '%s' is not found in the object!", pName);
+    return 0;
+  }
+
+  return symbol->getValue().size;
+}
+
+bool
+DyldObjectLoaderImpl::getSymbolNameList(android::Vector<const char *>& pNameList,
+                                        ObjectLoader::SymbolType pType) const {
+  if (mIsCompacted) {
+    return false;
+  }
+
+  unsigned elf_type;
+  switch (pType) {
+    case ObjectLoader::kFunctionType: {
+      elf_type = llvm::ELF::STT_FUNC;
+      break;
+    }
+    case ObjectLoader::kUnknownType: {
+      break;
+    }
+    default: {
+      assert(false && "Invalid symbol type given!");
+      return false;
+    }
+  }
+
+  for (llvm::StringMap<SymbolInfo>::const_iterator
+           symbol_iter = mSymbols.begin(), symbol_end = mSymbols.end();
+       symbol_iter != symbol_end; symbol_iter++) {
+    if ((pType == ObjectLoader::kUnknownType) ||
+        (symbol_iter->getValue().type == elf_type)) {
+      pNameList.push_back(symbol_iter->getKeyData());
+    }
+  }
+
+  return true;
+}
+
+void DyldObjectLoaderImpl::compact() {
+  if (mIsCompacted) {
+    return;
+  }
+
+  // mAnchorSymbol points to a key in mSymbols.
+  mAnchorSymbol = NULL;
+  mSymbols.clear();
+  mIsCompacted = true;
+  return;
+}
+
+DyldObjectLoaderImpl::~DyldObjectLoaderImpl() {
+#if !defined(_WIN32)
+  if (mHandle != NULL) {
+    ::dlclose(mHandle);
+  }
+#endif
+}
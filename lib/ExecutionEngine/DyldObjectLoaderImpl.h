@@ -0,0 +1,114 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef BCC_EXECUTION_ENGINE_DYLD_OBJECT_LOADER_IMPL_H
+#define BCC_EXECUTION_ENGINE_DYLD_OBJECT_LOADER_IMPL_H
+
+#include <stdint.h>
+
+#include <string>
+
+#include <llvm/ADT/StringMap.h>
+
+#include "ObjectLoaderImpl.h"
+
+namespace bcc {
+
+/*
+ * Loader for position-independent shared objects (ET_DYN) in the cache. The
+ * file is mapped by the system dynamic loader instead of being copied and
+ * relocated by librsloader: text is mapped read-only straight from the file
+ * and is shared among all processes loading it, data is copy-on-write and
+ * the relocations are confined to the GOT and the PLT.
+ */
+class DyldObjectLoaderImpl : public ObjectLoaderImpl {
+private:
+  struct SymbolInfo {
+    size_t size;
+    unsigned char type;
+  };
+
+  // Path of the shared object. dlopen() requires a file.
+  std::string mPath;
+
+  void *mHandle;
+
+  // Defined dynamic symbols of the object. Collected from .dynsym in load()
+  // since dlsym() doesn't tell the size and the type of a symbol.
+  llvm::StringMap<SymbolInfo> mSymbols;
+
+  struct Segment {
+    uintptr_t vaddr;
+    size_t size;
+  };
+
+  // Executable PT_LOAD segments of the object, relative to its load address.
+  android::Vector<Segment> mTextSegments;
+
+  // A defined function or object and its value in the object, used to find
+  // out where the object is loaded. NULL if there's none.
+  const char *mAnchorSymbol;
+  uintptr_t mAnchorValue;
+
+  // Base address of the object as reported by dladdr(). Tells the symbols of
+  // the object from the ones of its dependencies once mSymbols is released.
+  void *mLoadBase;
+
+  bool mIsCompacted;
+
+  // Back the text of the loaded object with huge pages. See HugePageText.
+  void remapText() const;
+
+public:
+  DyldObjectLoaderImpl(const char *pPath)
+    : ObjectLoaderImpl(), mPath(pPath), mHandle(NULL), mAnchorSymbol(NULL),
+      mAnchorValue(0), mLoadBase(NULL), mIsCompacted(false) { }
+
+  // Return true if the memory contains an ELF shared object.
+  static bool IsSharedObject(const void *pMem, size_t pMemSize);
+
+  virtual bool load(const void *pMem, size_t pMemSize);
+
+  // Undefined symbols are resolved by the system dynamic loader against the
+  // DT_NEEDED libraries of the object. pResolver is not consulted.
+  virtual bool relocate(SymbolResolverInterface &pResolver);
+
+  // The shared objects are reported to the debugger by the dynamic loader.
+  // No debug image is needed.
+  virtual bool prepareDebugImage(void *pDebugImg, size_t pDebugImgSize)
+  { return false; }
+
+  virtual void *getSymbolAddress(const char *pName) const;
+
+  virtual size_t getSymbolSize(const char *pName) const;
+
+  // The sections are not individually placed by the dynamic loader.
+  virtual void *getSectionAddress(unsigned pIndex) const
+  { return NULL; }
+
+  virtual bool getSymbolNameList(android::Vector<const char *>& pNameList,
+                                 ObjectLoader::SymbolType pType) const;
+
+  // Release the copy of .dynsym. getSymbolAddress() keeps working through
+  // dlsym(). The sizes and the list of the symbols become unavailable.
+  virtual void compact();
+
+  ~DyldObjectLoaderImpl();
+};
+
+} // end namespace bcc
+
+#endif // BCC_EXECUTION_ENGINE_DYLD_OBJECT_LOADER_IMPL_H
@@ -16,8 +16,11 @@
 
 #include "ELFObjectLoaderImpl.h"
 
+#include <llvm/ADT/StringMap.h>
 #include <llvm/Support/ELF.h>
 
+#include <utils/Vector.h>
+
 // The following files are included from librsloader.
 #include "ELFObject.h"
 #include "ELFSectionSymTab.h"
@@ -58,7 +61,75 @@ bool ELFObjectLoaderImpl::load(const void *pMem, size_t pMemSize) {
   return true;
 }
 
+void
+ELFObjectLoaderImpl::resolveUndefinedSymbols(SymbolResolverInterface &pResolver) {
+  if (mSymTab == NULL) {
+    return;
+  }
+
+  // Undefined symbols in the object and, for each of them, the index of its
+  // name in unique_names. The same name may be referred by more than one
+  // symbol but it is only looked up once.
+#ifdef __LP64__
+  android::Vector<ELFSymbol<64> *> symbols;
+#else
+  android::Vector<ELFSymbol<32> *> symbols;
+#endif
+  android::Vector<unsigned> name_indices;
+  android::Vector<const char *> unique_names;
+  llvm::StringMap<unsigned> name_map;
+
+  for (size_t i = 0, e = mSymTab->size(); i != e; i++) {
+#ifdef __LP64__
+    ELFSymbol<64> *symbol = (*mSymTab)[i];
+#else
+    ELFSymbol<32> *symbol = (*mSymTab)[i];
+#endif
+    if ((symbol == NULL) ||
+        (symbol->getSectionIndex() != llvm::ELF::SHN_UNDEF)) {
+      continue;
+    }
+
+    const char *symbol_name = symbol->getName();
+    if ((symbol_name == NULL) || (symbol_name[0] == '\0')) {
+      continue;
+    }
+
+    size_t num_names = name_map.size();
+    llvm::StringMapEntry<unsigned> &entry =
+        name_map.GetOrCreateValue(symbol_name, unique_names.size());
+    if (name_map.size() != num_names) {
+      unique_names.push_back(symbol_name);
+    }
+    symbols.push_back(symbol);
+    name_indices.push_back(entry.getValue());
+  }
+
+  if (unique_names.isEmpty()) {
+    return;
+  }
+
+  android::Vector<void *> addrs;
+  addrs.insertAt(NULL, 0, unique_names.size());
+  size_t num_found = pResolver.getAddresses(unique_names.array(),
+                                            unique_names.size(),
+                                            addrs.editArray());
+  ALOGV("Resolved %zu of %zu undefined symbols (%zu references) in bulk.",
+        num_found, unique_names.size(), symbols.size());
+
+  // Bind the symbols found. The ones left unbound are looked up again (and
+  // reported if still missing) by the relocator.
+  for (size_t i = 0, e = symbols.size(); i != e; i++) {
+    void *addr = addrs[name_indices[i]];
+    if (addr != NULL) {
+      symbols[i]->setAddress(addr);
+    }
+  }
+}
+
 bool ELFObjectLoaderImpl::relocate(SymbolResolverInterface &pResolver) {
+  resolveUndefinedSymbols(pResolver);
+
   mObject->relocate(SymbolResolverInterface::LookupFunction, &pResolver);
 
   if (mObject->getMissingSymbols()) {
@@ -180,6 +251,27 @@ size_t ELFObjectLoaderImpl::getSymbolSize(const char *pName) const {
 
 }
 
+void *ELFObjectLoaderImpl::getSectionAddress(unsigned pIndex) const {
+  if (pIndex >= mObject->getHeader()->getSectionHeaderNum()) {
+    return NULL;
+  }
+
+  // The callers only ask for the sections holding code or data, which are
+  // loaded by librsloader as ELFSectionBits.
+#ifdef __LP64__
+  ELFSectionBits<64> *section =
+      static_cast<ELFSectionBits<64> *>(mObject->getSectionByIndex(pIndex));
+#else
+  ELFSectionBits<32> *section =
+      static_cast<ELFSectionBits<32> *>(mObject->getSectionByIndex(pIndex));
+#endif
+  if (section == NULL) {
+    return NULL;
+  }
+
+  return section->getBuffer();
+}
+
 bool
 ELFObjectLoaderImpl::getSymbolNameList(android::Vector<const char *>& pNameList,
                                        ObjectLoader::SymbolType pType) const {
@@ -39,6 +39,10 @@ private:
   ELFSectionSymTab<32> *mSymTab;
 #endif
 
+  // Look up the addresses of all undefined symbols in the object with a
+  // single bulk query to pResolver and bind them before the relocation.
+  void resolveUndefinedSymbols(SymbolResolverInterface &pResolver);
+
 public:
   ELFObjectLoaderImpl() : ObjectLoaderImpl(), mObject(NULL), mSymTab(NULL) { }
 
@@ -52,6 +56,8 @@ public:
 
   virtual size_t getSymbolSize(const char *pName) const;
 
+  virtual void *getSectionAddress(unsigned pIndex) const;
+
   virtual bool getSymbolNameList(android::Vector<const char *>& pNameList,
                                  ObjectLoader::SymbolType pType) const;
   ~ELFObjectLoaderImpl();
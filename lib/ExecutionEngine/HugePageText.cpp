@@ -0,0 +1,144 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/ExecutionEngine/HugePageText.h"
+
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_ANDROID_OS
+#include <cutils/properties.h>
+#endif
+
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+volatile int HugePageText::sEnabled = -1;
+
+namespace {
+
+volatile size_t gTotalRemapped = 0;
+
+int ReadEnabledFromEnvironment() {
+#ifdef HAVE_ANDROID_OS
+  char value[PROPERTY_VALUE_MAX];
+  property_get("debug.bcc.hugepages", value, "0");
+  return (::atoi(value) != 0) ? 1 : 0;
+#else
+  const char *value = ::getenv("BCC_HUGE_PAGES");
+  return ((value != NULL) && (::atoi(value) != 0)) ? 1 : 0;
+#endif
+}
+
+} // end anonymous namespace
+
+bool HugePageText::ReadEnabled() {
+  // Racing with another reader or SetEnabled() is harmless. They all store
+  // either the same value or the one that was explicitly asked for.
+  int enabled = ReadEnabledFromEnvironment();
+  __sync_bool_compare_and_swap(&sEnabled, -1, enabled);
+  return (sEnabled != 0);
+}
+
+void HugePageText::SetEnabled(bool pEnabled) {
+  sEnabled = (pEnabled ? 1 : 0);
+  return;
+}
+
+size_t HugePageText::GetTotalRemapped() {
+  return gTotalRemapped;
+}
+
+size_t HugePageText::Remap(void *pStart, size_t pSize) {
+#if defined(__linux__) && defined(MADV_HUGEPAGE) && defined(MREMAP_FIXED)
+  uintptr_t start = reinterpret_cast<uintptr_t>(pStart);
+  uintptr_t begin = (start + HugePageSize - 1) & ~(HugePageSize - 1);
+  uintptr_t end = (start + pSize) & ~(HugePageSize - 1);
+  if (begin >= end) {
+    return 0;
+  }
+  size_t length = end - begin;
+
+  // Reserve one more huge page to align the copy. The faults taken when
+  // filling it are then served with huge pages, which mremap() moves as a
+  // whole to the (equally aligned) destination.
+  size_t reserved_length = length + HugePageSize;
+  void *reserved = ::mmap(NULL, reserved_length, PROT_READ | PROT_WRITE,
+                          MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (reserved == MAP_FAILED) {
+    ALOGW("Failed to reserve %zu bytes for the huge page text! (%s)",
+          reserved_length, ::strerror(errno));
+    return 0;
+  }
+
+  uintptr_t reserved_begin = reinterpret_cast<uintptr_t>(reserved);
+  uintptr_t copy_begin = (reserved_begin + HugePageSize - 1) &
+                         ~(HugePageSize - 1);
+  void *copy = reinterpret_cast<void *>(copy_begin);
+
+  // Return the unaligned head and tail of the reservation.
+  if (copy_begin > reserved_begin) {
+    ::munmap(reserved, copy_begin - reserved_begin);
+  }
+  if ((reserved_begin + reserved_length) > (copy_begin + length)) {
+    ::munmap(reinterpret_cast<void *>(copy_begin + length),
+             (reserved_begin + reserved_length) - (copy_begin + length));
+  }
+
+  if (::madvise(copy, length, MADV_HUGEPAGE) != 0) {
+    // Transparent huge pages are not supported by the kernel.
+    ALOGV("madvise(MADV_HUGEPAGE) is not supported! (%s)", ::strerror(errno));
+    ::munmap(copy, length);
+    return 0;
+  }
+
+  ::memcpy(copy, reinterpret_cast<const void *>(begin), length);
+
+  if (::mprotect(copy, length, PROT_READ | PROT_EXEC) != 0) {
+    ALOGW("Failed to protect the huge page text! (%s)", ::strerror(errno));
+    ::munmap(copy, length);
+    return 0;
+  }
+
+  // The original pages are unmapped by the move. The code is the same on both
+  // sides so nothing running in the range is disturbed.
+  if (::mremap(copy, length, length, MREMAP_MAYMOVE | MREMAP_FIXED,
+               reinterpret_cast<void *>(begin)) == MAP_FAILED) {
+    ALOGW("Failed to move the huge page text to %p! (%s)",
+          reinterpret_cast<void *>(begin), ::strerror(errno));
+    ::munmap(copy, length);
+    return 0;
+  }
+
+  // The new pages were written through the data cache.
+  __builtin___clear_cache(reinterpret_cast<char *>(begin),
+                          reinterpret_cast<char *>(end));
+
+  __sync_fetch_and_add(&gTotalRemapped, length);
+  ALOGV("Backed %zu bytes of text at %p with huge pages.", length,
+        reinterpret_cast<void *>(begin));
+  return length;
+#else
+  return 0;
+#endif
+}
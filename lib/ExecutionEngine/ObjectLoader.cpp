@@ -16,21 +16,202 @@
 
 #include "bcc/ExecutionEngine/ObjectLoader.h"
 
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <llvm/Support/ELF.h>
+
 #include <utils/FileMap.h>
 
 #include "bcc/ExecutionEngine/GDBJITRegistrar.h"
+#include "bcc/ExecutionEngine/PerfMap.h"
+#include "bcc/ExecutionEngine/SymbolResolverInterface.h"
 #include "bcc/Support/FileBase.h"
+#include "bcc/Support/LoadStats.h"
 #include "bcc/Support/Log.h"
 
+#include "DyldObjectLoaderImpl.h"
 #include "ELFObjectLoaderImpl.h"
 
 using namespace bcc;
 
+#ifdef __LP64__
+typedef llvm::ELF::Elf64_Ehdr ElfEhdr;
+typedef llvm::ELF::Elf64_Phdr ElfPhdr;
+typedef llvm::ELF::Elf64_Shdr ElfShdr;
+#else
+typedef llvm::ELF::Elf32_Ehdr ElfEhdr;
+typedef llvm::ELF::Elf32_Phdr ElfPhdr;
+typedef llvm::ELF::Elf32_Shdr ElfShdr;
+#endif
+
+namespace {
+
+// The objects loaded with GDB debugging enabled. Guarded by gDebugObjectsLock.
+android::Vector<ObjectLoader *> gDebugObjects;
+pthread_mutex_t gDebugObjectsLock = PTHREAD_MUTEX_INITIALIZER;
+
+void AddDebugObject(ObjectLoader *pLoader) {
+  pthread_mutex_lock(&gDebugObjectsLock);
+  gDebugObjects.push(pLoader);
+  pthread_mutex_unlock(&gDebugObjectsLock);
+  return;
+}
+
+void RemoveDebugObject(ObjectLoader *pLoader) {
+  pthread_mutex_lock(&gDebugObjectsLock);
+  for (size_t i = 0; i < gDebugObjects.size(); i++) {
+    if (gDebugObjects[i] == pLoader) {
+      gDebugObjects.removeAt(i);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&gDebugObjectsLock);
+  return;
+}
+
+// Return true if a debugger (or any other tracer) is attached to the process.
+bool IsBeingTraced() {
+#if defined(__linux__)
+  FILE *status = ::fopen("/proc/self/status", "r");
+  if (status == NULL) {
+    return false;
+  }
+
+  char line[128];
+  int tracer_pid = 0;
+  while (::fgets(line, sizeof(line), status) != NULL) {
+    if (::sscanf(line, "TracerPid: %d", &tracer_pid) == 1) {
+      break;
+    }
+  }
+  ::fclose(status);
+
+  return (tracer_pid != 0);
+#else
+  return false;
+#endif
+}
+
+// Forward the lookups to the wrapped resolver and measure the time spent in
+// them.
+class TimedSymbolResolver : public SymbolResolverInterface {
+private:
+  SymbolResolverInterface &mResolver;
+  uint64_t mTime;
+
+public:
+  TimedSymbolResolver(SymbolResolverInterface &pResolver)
+    : mResolver(pResolver), mTime(0) { }
+
+  inline uint64_t getTime() const
+  { return mTime; }
+
+  virtual void *getAddress(const char *pName) {
+    LoadStats::Timer timer;
+    void *addr = mResolver.getAddress(pName);
+    mTime += timer.elapsed();
+    return addr;
+  }
+
+  virtual size_t getAddresses(const char *const *pNames, size_t pCount,
+                              void **pAddrs) {
+    LoadStats::Timer timer;
+    size_t num_found = mResolver.getAddresses(pNames, pCount, pAddrs);
+    mTime += timer.elapsed();
+    return num_found;
+  }
+
+  virtual const char *getStableScope() const
+  { return mResolver.getStableScope(); }
+};
+
+// Account the sections of the object which are allocated at load time.
+void AccountSections(const void *pMem, size_t pMemSize, LoadStats &pStats) {
+  const uint8_t *image = reinterpret_cast<const uint8_t *>(pMem);
+  const ElfEhdr *elf_header = reinterpret_cast<const ElfEhdr *>(pMem);
+
+  if ((pMemSize < sizeof(ElfEhdr)) ||
+      (elf_header->e_shoff > pMemSize) ||
+      ((pMemSize - elf_header->e_shoff) <
+          (sizeof(ElfShdr) * elf_header->e_shnum))) {
+    return;
+  }
+
+  const ElfShdr *section_header_table =
+      reinterpret_cast<const ElfShdr *>(image + elf_header->e_shoff);
+  bool is_shared_object = (elf_header->e_type == llvm::ELF::ET_DYN);
+  unsigned num_mappings = 0;
+
+  for (unsigned i = 0; i < elf_header->e_shnum; i++) {
+    const ElfShdr &section = section_header_table[i];
+    if ((section.sh_type == llvm::ELF::SHT_REL) ||
+        (section.sh_type == llvm::ELF::SHT_RELA)) {
+      pStats.addBytes(LoadStats::kRelocationMemory, section.sh_size);
+      continue;
+    } else if ((section.sh_flags & llvm::ELF::SHF_ALLOC) == 0) {
+      continue;
+    } else if (section.sh_type == llvm::ELF::SHT_NOBITS) {
+      pStats.addBytes(LoadStats::kBSSMemory, section.sh_size);
+    } else if ((section.sh_flags & llvm::ELF::SHF_EXECINSTR) != 0) {
+      pStats.addBytes(LoadStats::kTextMemory, section.sh_size);
+    } else {
+      pStats.addBytes(LoadStats::kDataMemory, section.sh_size);
+    }
+
+    if (section.sh_size > 0) {
+      num_mappings++;
+    }
+  }
+
+  // The sections of a shared object are mapped by segments instead.
+  if (is_shared_object) {
+    num_mappings = 0;
+    if ((elf_header->e_phoff <= pMemSize) &&
+        ((pMemSize - elf_header->e_phoff) >=
+            (sizeof(ElfPhdr) * elf_header->e_phnum))) {
+      const ElfPhdr *program_header_table =
+          reinterpret_cast<const ElfPhdr *>(image + elf_header->e_phoff);
+      for (unsigned i = 0; i < elf_header->e_phnum; i++) {
+        if (program_header_table[i].p_type == llvm::ELF::PT_LOAD) {
+          num_mappings++;
+        }
+      }
+    }
+  }
+
+  pStats.addMappings(num_mappings);
+  return;
+}
+
+} // end anonymous namespace
+
+// Entry point for the debuggers to have the objects loaded before they were
+// attached registered. E.g., "call bccRegisterDebugImages()" in GDB.
+extern "C" void bccRegisterDebugImages() {
+  ObjectLoader::RegisterDebugImages();
+}
+
 ObjectLoader *ObjectLoader::Load(void *pMemStart, size_t pMemSize,
                                  const char *pName,
                                  SymbolResolverInterface &pResolver,
-                                 bool pEnableGDBDebug) {
+                                 bool pEnableGDBDebug,
+                                 LoadStats *pStats) {
+  return LoadRelocatable(pMemStart, pMemSize, pName, pResolver,
+                         pEnableGDBDebug, pStats, /* pResolverLock */NULL);
+}
+
+ObjectLoader *ObjectLoader::LoadRelocatable(void *pMemStart, size_t pMemSize,
+                                            const char *pName,
+                                            SymbolResolverInterface &pResolver,
+                                            bool pEnableGDBDebug,
+                                            LoadStats *pStats,
+                                            pthread_mutex_t *pResolverLock) {
   ObjectLoader *result = NULL;
+  bool relocated;
+  TimedSymbolResolver resolver(pResolver);
+  LoadStats::Timer timer;
 
   // Check parameters.
   if ((pMemStart == NULL) || (pMemSize <= 0)) {
@@ -46,9 +227,15 @@ ObjectLoader *ObjectLoader::Load(void *pMemStart, size_t pMemSize,
     goto bail;
   }
 
-  // Currently, only ELF object loader is supported. Therefore, there's no codes
-  // to detect the object file type and to select the one appropriated. Directly
-  // try out the ELF object loader.
+  // Shared objects must be loaded by the dynamic loader from a file. See
+  // Load(FileBase &, ...).
+  if (DyldObjectLoaderImpl::IsSharedObject(pMemStart, pMemSize)) {
+    ALOGE("Shared object %s can only be loaded from a file!", pName);
+    goto bail;
+  }
+
+  // Otherwise, only ELF relocatable object is supported. Directly try out the
+  // ELF object loader.
   result->mImpl = new (std::nothrow) ELFObjectLoaderImpl();
   if (result->mImpl == NULL) {
     ALOGE("Out of memory when create ELF object loader for %s", pName);
@@ -56,42 +243,127 @@ ObjectLoader *ObjectLoader::Load(void *pMemStart, size_t pMemSize,
   }
 
   // Load the object file.
+  timer.restart();
   if (!result->mImpl->load(pMemStart, pMemSize)) {
     ALOGE("Failed to load %s!", pName);
     goto bail;
   }
+  if (pStats != NULL) {
+    pStats->addTime(LoadStats::kSectionCopyPhase, timer);
+  }
 
   // Perform relocation.
-  if (!result->mImpl->relocate(pResolver)) {
+  if (pResolverLock != NULL) {
+    pthread_mutex_lock(pResolverLock);
+  }
+  relocated = result->mImpl->relocate(resolver);
+  if (pResolverLock != NULL) {
+    pthread_mutex_unlock(pResolverLock);
+  }
+  if (!relocated) {
     ALOGE("Error occurred when performs relocation on %s!", pName);
     goto bail;
   }
+  if (pStats != NULL) {
+    pStats->addTime(LoadStats::kRelocationPhase,
+                    timer.elapsed() - resolver.getTime());
+    pStats->addTime(LoadStats::kSymbolLookupPhase, resolver.getTime());
+    AccountSections(pMemStart, pMemSize, *pStats);
+  }
 
   // GDB debugging is enabled. Note that error occurrs during the setup of
   // debugging won't failed the object load. Only a warning is issued to notify
   // that the debugging is disabled due to the failure.
   if (pEnableGDBDebug) {
     // GDB's JIT debugging requires the source object file corresponded to the
-    // process image desired to debug with. And some fields in the object file
-    // must be updated to record the runtime information after it's loaded into
-    // memory. For example, GDB's JIT debugging requires an ELF file with the
-    // value of sh_addr in the section header to be the memory address that the
-    // section lives in the process image. Therefore, a writable memory with its
-    // contents initialized to the contents of pFile is created.
+    // process image desired to debug with. Preparing and registering it is
+    // deferred until a debugger shows up, since few processes are ever
+    // debugged. The source is copied now though: the memory it's loaded from
+    // may go away after the load, and the file it's mapped from may be
+    // truncated and rewritten by the next compilation of the script.
+    result->mDebugImageSize = pMemSize;
     result->mDebugImage = new (std::nothrow) uint8_t [ pMemSize ];
-    if (result->mDebugImage != NULL) {
+    if (result->mDebugImage == NULL) {
+      ALOGW("GDB debug for %s is enabled by the user but won't work due to "
+            "out of memory!", pName);
+    } else {
       ::memcpy(result->mDebugImage, pMemStart, pMemSize);
-      if (!result->mImpl->prepareDebugImage(result->mDebugImage, pMemSize)) {
-        ALOGW("GDB debug for %s is enabled by the user but won't work due to "
-              "failure debug image preparation!", pName);
-      } else {
-        registerObjectWithGDB(
-            reinterpret_cast<const ObjectBuffer *>(result->mDebugImage),
-            pMemSize);
+      // The copy is memory spent on debugging whether or not a debugger ever
+      // shows up.
+      if (pStats != NULL) {
+        pStats->addBytes(LoadStats::kDebugMemory, pMemSize);
+      }
+    }
+
+    if (result->mDebugImage != NULL) {
+      AddDebugObject(result);
+      if (IsBeingTraced()) {
+        RegisterDebugImages();
       }
     }
   }
 
+  // Shared objects need no such report since the profilers read their
+  // symbols from the files.
+  PerfMap::RecordObject(*result, pName);
+
+  return result;
+
+bail:
+  delete result;
+  return NULL;
+}
+
+ObjectLoader *ObjectLoader::LoadSharedObject(const void *pMemStart,
+                                             size_t pMemSize,
+                                             const char *pPath,
+                                             SymbolResolverInterface &pResolver,
+                                             LoadStats *pStats,
+                                             pthread_mutex_t *pResolverLock) {
+  LoadStats::Timer timer;
+  bool relocated;
+  ObjectLoader *result = new (std::nothrow) ObjectLoader();
+  if (result == NULL) {
+    ALOGE("Out of memory when create object loader for %s!", pPath);
+    goto bail;
+  }
+
+  result->mImpl = new (std::nothrow) DyldObjectLoaderImpl(pPath);
+  if (result->mImpl == NULL) {
+    ALOGE("Out of memory when create shared object loader for %s", pPath);
+    goto bail;
+  }
+
+  // Only the symbol information is read from pMemStart. The text and the data
+  // are mapped from pPath by the dynamic loader and are not copied.
+  if (!result->mImpl->load(pMemStart, pMemSize)) {
+    ALOGE("Failed to load %s!", pPath);
+    goto bail;
+  }
+  if (pStats != NULL) {
+    pStats->addTime(LoadStats::kSectionCopyPhase, timer);
+  }
+
+  // The dynamic loader maps the object and binds its symbols in one go.
+  // Account all of it as relocation.
+  if (pResolverLock != NULL) {
+    pthread_mutex_lock(pResolverLock);
+  }
+  relocated = result->mImpl->relocate(pResolver);
+  if (pResolverLock != NULL) {
+    pthread_mutex_unlock(pResolverLock);
+  }
+  if (!relocated) {
+    ALOGE("Error occurred when performs relocation on %s!", pPath);
+    goto bail;
+  }
+  if (pStats != NULL) {
+    pStats->addTime(LoadStats::kRelocationPhase, timer);
+    AccountSections(pMemStart, pMemSize, *pStats);
+  }
+
+  // No GDB JIT registration is required. The debugger learns about the shared
+  // objects from the dynamic loader.
   return result;
 
 bail:
@@ -101,7 +373,10 @@ bail:
 
 ObjectLoader *ObjectLoader::Load(FileBase &pFile,
                                  SymbolResolverInterface &pResolver,
-                                 bool pEnableGDBDebug) {
+                                 bool pEnableGDBDebug,
+                                 LoadStats *pStats,
+                                 pthread_mutex_t *pResolverLock) {
+  LoadStats::Timer timer;
   size_t file_size;
   android::FileMap *file_map = NULL;
   const char *input_filename = pFile.getName().c_str();
@@ -136,13 +411,25 @@ ObjectLoader *ObjectLoader::Load(FileBase &pFile,
     return NULL;
   }
 
+  if (pStats != NULL) {
+    pStats->addTime(LoadStats::kFileIOPhase, timer);
+  }
+
   // Delegate the load request.
-  result = Load(file_map->getDataPtr(), file_size, input_filename, pResolver,
-                pEnableGDBDebug);
+  if (DyldObjectLoaderImpl::IsSharedObject(file_map->getDataPtr(), file_size)) {
+    result = LoadSharedObject(file_map->getDataPtr(), file_size,
+                              input_filename, pResolver, pStats,
+                              pResolverLock);
+  } else {
+    result = LoadRelocatable(file_map->getDataPtr(), file_size, input_filename,
+                             pResolver, pEnableGDBDebug, pStats,
+                             pResolverLock);
+  }
 
   // No whether the load is successful or not, file_map is no longer needed. On
   // success, there's a copy of the object corresponded to the pFile in the
-  // memory. Therefore, file_map can be safely released.
+  // memory (or, for a shared object, a separate mapping owned by the dynamic
+  // loader.) Therefore, file_map can be safely released.
   file_map->release();
 
   return result;
@@ -156,12 +443,66 @@ size_t ObjectLoader::getSymbolSize(const char *pName) const {
   return mImpl->getSymbolSize(pName);
 }
 
+void *ObjectLoader::getSectionAddress(unsigned pIndex) const {
+  return mImpl->getSectionAddress(pIndex);
+}
+
 bool ObjectLoader::getSymbolNameList(android::Vector<const char *>& pNameList,
                                      SymbolType pType) const {
   return mImpl->getSymbolNameList(pNameList, pType);
 }
 
+void ObjectLoader::compact() {
+  // The debugger may ask for the symbols at any time.
+  if (mDebugImageSize > 0) {
+    return;
+  }
+  mImpl->compact();
+  return;
+}
+
+bool ObjectLoader::registerDebugImage() {
+  if (mIsDebugImageRegistered) {
+    return true;
+  }
+
+  if (mDebugImage == NULL) {
+    return false;
+  }
+
+  // GDB's JIT debugging requires an ELF file with the value of sh_addr in
+  // the section header to be the memory address that the section lives in the
+  // process image.
+  if (!mImpl->prepareDebugImage(mDebugImage, mDebugImageSize)) {
+    ALOGW("GDB debug is enabled by the user but won't work due to failure "
+          "debug image preparation!");
+    delete [] reinterpret_cast<uint8_t *>(mDebugImage);
+    mDebugImage = NULL;
+    return false;
+  }
+
+  registerObjectWithGDB(reinterpret_cast<const ObjectBuffer *>(mDebugImage),
+                        mDebugImageSize);
+  mIsDebugImageRegistered = true;
+  return true;
+}
+
+void ObjectLoader::RegisterDebugImages() {
+  pthread_mutex_lock(&gDebugObjectsLock);
+  for (size_t i = 0; i < gDebugObjects.size(); i++) {
+    gDebugObjects[i]->registerDebugImage();
+  }
+  pthread_mutex_unlock(&gDebugObjectsLock);
+  return;
+}
+
 ObjectLoader::~ObjectLoader() {
+  if (mDebugImageSize > 0) {
+    RemoveDebugObject(this);
+  }
+  if (mIsDebugImageRegistered) {
+    deregisterObjectWithGDB(reinterpret_cast<const ObjectBuffer *>(mDebugImage));
+  }
   delete mImpl;
   delete [] reinterpret_cast<uint8_t *>(mDebugImage);
 }
@@ -42,9 +42,17 @@ public:
 
   virtual size_t getSymbolSize(const char *pName) const = 0;
 
+  // Return the address where the section at index pIndex of the object is
+  // loaded, or NULL if it's unknown.
+  virtual void *getSectionAddress(unsigned pIndex) const = 0;
+
   virtual bool getSymbolNameList(android::Vector<const char *>& pNameList,
                                  ObjectLoader::SymbolType pType) const = 0;
 
+  // Release the data kept only for the symbol queries above. See
+  // ObjectLoader::compact().
+  virtual void compact() { }
+
   virtual ~ObjectLoaderImpl() { }
 };
 
@@ -0,0 +1,328 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/ExecutionEngine/PerfMap.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+#if defined(__linux__)
+#include <sys/syscall.h>
+#endif
+
+#ifdef HAVE_ANDROID_OS
+#include <cutils/properties.h>
+#endif
+
+#include <llvm/Support/ELF.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+#include "bcc/ExecutionEngine/ObjectLoader.h"
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+volatile int PerfMap::sMode = -1;
+
+namespace {
+
+#ifdef HAVE_ANDROID_OS
+const char gOutputDir[] = "/data/local/tmp";
+#else
+const char gOutputDir[] = "/tmp";
+#endif
+
+//===----------------------------------------------------------------------===//
+// jitdump file format. See tools/perf/Documentation/jitdump-specification.txt
+// in the Linux kernel tree.
+//===----------------------------------------------------------------------===//
+const uint32_t gJITDumpMagic = 0x4A695444;  // "JiTD"
+const uint32_t gJITDumpVersion = 1;
+
+enum JITDumpRecordType {
+  kJITCodeLoad = 0,
+};
+
+struct JITDumpHeader {
+  uint32_t magic;
+  uint32_t version;
+  uint32_t totalSize;
+  uint32_t elfMach;
+  uint32_t pad1;
+  uint32_t pid;
+  uint64_t timestamp;
+  uint64_t flags;
+};
+
+struct JITDumpRecordHeader {
+  uint32_t id;
+  uint32_t totalSize;
+  uint64_t timestamp;
+};
+
+// Followed by the NUL-terminated name and the code.
+struct JITDumpCodeLoad {
+  JITDumpRecordHeader header;
+  uint32_t pid;
+  uint32_t tid;
+  uint64_t vma;
+  uint64_t codeAddr;
+  uint64_t codeSize;
+  uint64_t codeIndex;
+};
+
+// Guards all the state below.
+pthread_mutex_t gLock = PTHREAD_MUTEX_INITIALIZER;
+
+FILE *gMapFile = NULL;
+bool gMapFileFailed = false;
+
+int gDumpFd = -1;
+bool gDumpFileFailed = false;
+uint64_t gDumpCodeIndex = 0;
+
+// perf recognizes the jitdump file from an executable mapping of it in the
+// recorded process.
+void *gDumpMarker = NULL;
+size_t gDumpMarkerSize = 0;
+
+int ReadModeFromEnvironment() {
+#ifdef HAVE_ANDROID_OS
+  char value[PROPERTY_VALUE_MAX];
+  property_get("debug.bcc.perfmap", value, "0");
+  return ::atoi(value);
+#else
+  const char *value = ::getenv("BCC_PERF_MAP");
+  return (value != NULL) ? ::atoi(value) : 0;
+#endif
+}
+
+uint64_t GetTimestamp() {
+  // Must be the same clock as perf record -k mono.
+  struct timespec ts;
+  if (::clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+uint32_t GetThreadId() {
+#if defined(__linux__)
+  return static_cast<uint32_t>(::syscall(__NR_gettid));
+#else
+  return static_cast<uint32_t>(::getpid());
+#endif
+}
+
+uint32_t GetELFMachine() {
+#if defined(__arm__)
+  return llvm::ELF::EM_ARM;
+#elif defined(__aarch64__)
+  return llvm::ELF::EM_AARCH64;
+#elif defined(__mips__)
+  return llvm::ELF::EM_MIPS;
+#elif defined(__x86_64__)
+  return llvm::ELF::EM_X86_64;
+#elif defined(__i386__)
+  return llvm::ELF::EM_386;
+#else
+  return llvm::ELF::EM_NONE;
+#endif
+}
+
+bool WriteFully(int pFd, const void *pBuf, size_t pSize) {
+  const uint8_t *buf = reinterpret_cast<const uint8_t *>(pBuf);
+  while (pSize > 0) {
+    ssize_t written = ::write(pFd, buf, pSize);
+    if (written < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    buf += written;
+    pSize -= written;
+  }
+  return true;
+}
+
+// Open the perf map file if it isn't. Called with gLock held.
+bool OpenMapFile() {
+  if (gMapFile != NULL) {
+    return true;
+  } else if (gMapFileFailed) {
+    return false;
+  }
+
+  android::String8 path;
+  path.appendFormat("%s/perf-%d.map", gOutputDir, ::getpid());
+  gMapFile = ::fopen(path.string(), "a");
+  if (gMapFile == NULL) {
+    ALOGW("Failed to open the perf map file %s! (%s)", path.string(),
+          ::strerror(errno));
+    gMapFileFailed = true;
+    return false;
+  }
+  return true;
+}
+
+// Open the jitdump file and write its header if it isn't. Called with gLock
+// held.
+bool OpenDumpFile() {
+  if (gDumpFd >= 0) {
+    return true;
+  } else if (gDumpFileFailed) {
+    return false;
+  }
+
+#if !defined(_WIN32)
+  android::String8 path;
+  path.appendFormat("%s/jit-%d.dump", gOutputDir, ::getpid());
+  gDumpFd = ::open(path.string(), O_CREAT | O_TRUNC | O_RDWR, 0644);
+  if (gDumpFd < 0) {
+    ALOGW("Failed to open the jitdump file %s! (%s)", path.string(),
+          ::strerror(errno));
+    gDumpFileFailed = true;
+    return false;
+  }
+
+  gDumpMarkerSize = ::sysconf(_SC_PAGESIZE);
+  gDumpMarker = ::mmap(NULL, gDumpMarkerSize, PROT_READ | PROT_EXEC,
+                       MAP_PRIVATE, gDumpFd, 0);
+  if (gDumpMarker == MAP_FAILED) {
+    gDumpMarker = NULL;
+    ALOGW("Failed to map the jitdump file %s! perf will ignore it. (%s)",
+          path.string(), ::strerror(errno));
+  }
+
+  JITDumpHeader header;
+  ::memset(&header, 0, sizeof(header));
+  header.magic = gJITDumpMagic;
+  header.version = gJITDumpVersion;
+  header.totalSize = sizeof(header);
+  header.elfMach = GetELFMachine();
+  header.pid = ::getpid();
+  header.timestamp = GetTimestamp();
+
+  if (!WriteFully(gDumpFd, &header, sizeof(header))) {
+    ALOGW("Failed to write the header of the jitdump file %s! (%s)",
+          path.string(), ::strerror(errno));
+    if (gDumpMarker != NULL) {
+      ::munmap(gDumpMarker, gDumpMarkerSize);
+      gDumpMarker = NULL;
+    }
+    ::close(gDumpFd);
+    gDumpFd = -1;
+    gDumpFileFailed = true;
+    return false;
+  }
+  return true;
+#else
+  gDumpFileFailed = true;
+  return false;
+#endif
+}
+
+void WriteCodeLoad(const char *pName, const void *pAddr, size_t pSize) {
+  size_t name_size = ::strlen(pName) + 1;
+
+  JITDumpCodeLoad record;
+  record.header.id = kJITCodeLoad;
+  record.header.totalSize = sizeof(record) + name_size + pSize;
+  record.header.timestamp = GetTimestamp();
+  record.pid = ::getpid();
+  record.tid = GetThreadId();
+  record.vma = reinterpret_cast<uintptr_t>(pAddr);
+  record.codeAddr = reinterpret_cast<uintptr_t>(pAddr);
+  record.codeSize = pSize;
+  record.codeIndex = gDumpCodeIndex++;
+
+  if (!WriteFully(gDumpFd, &record, sizeof(record)) ||
+      !WriteFully(gDumpFd, pName, name_size) ||
+      !WriteFully(gDumpFd, pAddr, pSize)) {
+    ALOGW("Failed to write the jitdump record for %s! (%s)", pName,
+          ::strerror(errno));
+  }
+  return;
+}
+
+} // end anonymous namespace
+
+void PerfMap::SetMode(unsigned pMode) {
+  pthread_mutex_lock(&gLock);
+  sMode = pMode;
+  pthread_mutex_unlock(&gLock);
+  return;
+}
+
+void PerfMap::RecordObjectImpl(const ObjectLoader &pLoader, const char *pName) {
+  pthread_mutex_lock(&gLock);
+
+  if (sMode < 0) {
+    sMode = ReadModeFromEnvironment();
+  }
+
+  bool write_map = ((sMode & kWriteMap) != 0) && OpenMapFile();
+  bool write_dump = ((sMode & kWriteDump) != 0) && OpenDumpFile();
+
+  if (write_map || write_dump) {
+    android::Vector<const char *> func_list;
+    if (!pLoader.getSymbolNameList(func_list, ObjectLoader::kFunctionType)) {
+      ALOGW("Failed to get the list of functions in %s for the profilers!",
+            pName);
+    }
+
+    // The kernels (including their .expand entry points) and the other
+    // functions in the object are all reported.
+    for (size_t i = 0; i < func_list.size(); i++) {
+      const char *func_name = func_list[i];
+      void *func = pLoader.getSymbolAddress(func_name);
+      size_t func_size = pLoader.getSymbolSize(func_name);
+      if ((func == NULL) || (func_size == 0)) {
+        continue;
+      }
+
+      if (write_map) {
+        ::fprintf(gMapFile, "%" PRIxPTR " %zx %s:%s\n",
+                  reinterpret_cast<uintptr_t>(func), func_size, pName,
+                  func_name);
+      }
+      if (write_dump) {
+        WriteCodeLoad(func_name, func, func_size);
+      }
+    }
+
+    if (write_map) {
+      ::fflush(gMapFile);
+    }
+  }
+
+  pthread_mutex_unlock(&gLock);
+  return;
+}
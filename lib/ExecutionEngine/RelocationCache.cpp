@@ -0,0 +1,361 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/ExecutionEngine/RelocationCache.h"
+
+#if !defined(_WIN32)  /* TODO create a HAVE_DLFCN_H */
+#include <dlfcn.h>
+#endif
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include "bcc/ExecutionEngine/SymbolResolverProxy.h"
+#include "bcc/Support/InputFile.h"
+#include "bcc/Support/Log.h"
+#include "bcc/Support/OutputFile.h"
+
+using namespace bcc;
+
+namespace {
+
+// Return the base address of the module containing pAddr, or NULL if it's
+// unknown.
+const void *GetModuleBase(const void *pAddr) {
+#if !defined(_WIN32)
+  Dl_info info;
+  if (::dladdr(pAddr, &info) != 0) {
+    return info.dli_fbase;
+  }
+#endif
+  return NULL;
+}
+
+} // end anonymous namespace
+
+void RelocationCache::ComputeChainDigest(uint8_t pResult[SHA1_DIGEST_LENGTH],
+                                         const SymbolResolverProxy &pResolver) {
+  std::string key;
+  pResolver.getChainKey(key);
+  Sha1Util::GetSHA1DigestFromBuffer(pResult, key.data(), key.size());
+}
+
+android::String8 RelocationCache::GetPath(const char *pObjectPath) {
+  android::String8 result(pObjectPath);
+  result.append(".reloc");
+  return result;
+}
+
+void RelocationCache::clear() {
+  mEntries.clear();
+  mModules.clear();
+  mIsDirty = false;
+}
+
+void RelocationCache::record(const char *pName, void *pAddr) {
+  if (pAddr == NULL) {
+    return;
+  }
+
+  // An address can only be reused if the module it belongs to can be
+  // validated in the later runs.
+  const void *base = GetModuleBase(pAddr);
+  if (base == NULL) {
+    return;
+  }
+
+  unsigned module = 0;
+  while ((module < mModules.size()) && (mModules[module].base != base)) {
+    module++;
+  }
+  if (module == mModules.size()) {
+    Module new_module = { base, NULL };
+    mModules.push_back(new_module);
+  }
+
+  Entry entry = { pAddr, module };
+  size_t num_entries = mEntries.size();
+  llvm::StringMapEntry<Entry> &result =
+      mEntries.GetOrCreateValue(pName, entry);
+  if (mEntries.size() == num_entries) {
+    return;
+  }
+
+  if (mModules[module].anchor == NULL) {
+    mModules.editItemAt(module).anchor = result.getKeyData();
+  }
+  mIsDirty = true;
+}
+
+void *RelocationCache::getAddress(const char *pName) {
+  llvm::StringMap<Entry>::const_iterator entry = mEntries.find(pName);
+  if (entry != mEntries.end()) {
+    return entry->getValue().addr;
+  }
+
+  void *addr = mFallback.getAddress(pName);
+  record(pName, addr);
+  return addr;
+}
+
+size_t RelocationCache::getAddresses(const char *const *pNames, size_t pCount,
+                                     void **pAddrs) {
+  android::Vector<const char *> missing_names;
+  android::Vector<size_t> missing_indices;
+  size_t num_found = 0;
+
+  for (size_t i = 0; i < pCount; i++) {
+    llvm::StringMap<Entry>::const_iterator entry = mEntries.find(pNames[i]);
+    if (entry != mEntries.end()) {
+      pAddrs[i] = entry->getValue().addr;
+      num_found++;
+    } else {
+      pAddrs[i] = NULL;
+      missing_names.push_back(pNames[i]);
+      missing_indices.push_back(i);
+    }
+  }
+
+  if (missing_names.isEmpty()) {
+    return num_found;
+  }
+
+  android::Vector<void *> missing_addrs;
+  missing_addrs.insertAt(NULL, 0, missing_names.size());
+  num_found += mFallback.getAddresses(missing_names.array(),
+                                      missing_names.size(),
+                                      missing_addrs.editArray());
+
+  for (size_t i = 0, e = missing_names.size(); i != e; i++) {
+    pAddrs[missing_indices[i]] = missing_addrs[i];
+    record(missing_names[i], missing_addrs[i]);
+  }
+
+  return num_found;
+}
+
+bool RelocationCache::readFromFile(const char *pPath) {
+  const reloccache::Header *header;
+  const reloccache::EntryItem *entries;
+  const reloccache::ModuleItem *modules;
+  const char *string_pool;
+  uint64_t expected_size;
+  size_t file_size;
+  uint8_t *buffer = NULL;
+
+  clear();
+
+  InputFile input(pPath);
+  if (input.hasError()) {
+    // This is expected for the first load of an object.
+    ALOGV("No relocation cache %s is available. (%s)", pPath,
+          input.getErrorMessage().c_str());
+    return false;
+  }
+
+  file_size = input.getSize();
+  if (input.hasError() || (file_size < sizeof(reloccache::Header))) {
+    ALOGW("Invalid relocation cache %s! (size: %u)", pPath,
+          static_cast<unsigned>(file_size));
+    goto bail;
+  }
+
+  // The cache is small. Read it at once rather than mapping it.
+  buffer = new (std::nothrow) uint8_t [ file_size ];
+  if (buffer == NULL) {
+    ALOGE("Out of memory when read relocation cache %s!", pPath);
+    goto bail;
+  }
+
+  if (input.read(buffer, file_size) != static_cast<ssize_t>(file_size)) {
+    ALOGE("Failed to read relocation cache %s! (%s)", pPath,
+          input.getErrorMessage().c_str());
+    goto bail;
+  }
+
+  header = reinterpret_cast<const reloccache::Header *>(buffer);
+  if (::memcmp(header->magic, RELOCCACHE_MAGIC,
+               RELOCCACHE_MAGIC_LENGTH) != 0) {
+    ALOGW("Invalid magic in relocation cache %s!", pPath);
+    goto bail;
+  }
+
+  if (::memcmp(header->version, RELOCCACHE_VERSION,
+               RELOCCACHE_VERSION_LENGTH) != 0) {
+    ALOGV("Mismatch the version of relocation cache %s! (expect: %s, got: %s)",
+          pPath, RELOCCACHE_VERSION, header->version);
+    goto bail;
+  }
+
+  if (::memcmp(header->chainDigest, mChainDigest, SHA1_DIGEST_LENGTH) != 0) {
+    ALOGV("Relocation cache %s is out of date! (the resolvers have changed)",
+          pPath);
+    goto bail;
+  }
+
+  expected_size = sizeof(reloccache::Header) +
+      static_cast<uint64_t>(header->numEntries) *
+          sizeof(reloccache::EntryItem) +
+      static_cast<uint64_t>(header->numModules) *
+          sizeof(reloccache::ModuleItem) +
+      header->strPoolSize;
+  if ((expected_size != file_size) || (header->strPoolSize == 0)) {
+    ALOGW("Corrupted relocation cache %s! (size: %u, expected: %llu)", pPath,
+          static_cast<unsigned>(file_size),
+          static_cast<unsigned long long>(expected_size));
+    goto bail;
+  }
+
+  entries = reinterpret_cast<const reloccache::EntryItem *>(header + 1);
+  modules = reinterpret_cast<const reloccache::ModuleItem *>(
+                entries + header->numEntries);
+  string_pool = reinterpret_cast<const char *>(modules + header->numModules);
+
+  if (string_pool[header->strPoolSize - 1] != '\0') {
+    ALOGW("String pool in relocation cache %s is not terminated!", pPath);
+    goto bail;
+  }
+
+  for (uint32_t i = 0; i < header->numEntries; i++) {
+    const reloccache::EntryItem &item = entries[i];
+    if ((item.name >= header->strPoolSize) ||
+        (item.module >= header->numModules)) {
+      ALOGW("Invalid entry #%u in relocation cache %s!", i, pPath);
+      goto bail;
+    }
+    Entry entry = {
+      reinterpret_cast<void *>(static_cast<uintptr_t>(item.addr)),
+      item.module
+    };
+    mEntries.GetOrCreateValue(&string_pool[item.name], entry);
+  }
+
+  // Validate each module by re-resolving its anchor through the fallback
+  // resolver.
+  for (uint32_t i = 0; i < header->numModules; i++) {
+    uint32_t anchor = modules[i].anchor;
+    if ((anchor >= header->numEntries) || (entries[anchor].module != i)) {
+      ALOGW("Invalid module #%u in relocation cache %s!", i, pPath);
+      goto bail;
+    }
+
+    llvm::StringMap<Entry>::iterator entry =
+        mEntries.find(&string_pool[entries[anchor].name]);
+    void *addr = mFallback.getAddress(entry->getKeyData());
+    if ((addr == NULL) || (addr != entry->getValue().addr)) {
+      ALOGV("Relocation cache %s is out of date! (%s was %p, now %p)", pPath,
+            entry->getKeyData(), entry->getValue().addr, addr);
+      goto bail;
+    }
+
+    Module module = { GetModuleBase(addr), entry->getKeyData() };
+    if (module.base == NULL) {
+      goto bail;
+    }
+    mModules.push_back(module);
+  }
+
+  delete [] buffer;
+  return true;
+
+bail:
+  delete [] buffer;
+  clear();
+  return false;
+}
+
+bool RelocationCache::writeToFile(const char *pPath) const {
+  reloccache::Header header;
+  android::Vector<reloccache::EntryItem> entries;
+  android::Vector<reloccache::ModuleItem> modules;
+  std::string string_pool;
+  size_t entries_size, modules_size;
+
+  modules.insertAt(reloccache::ModuleItem(), 0, mModules.size());
+  for (llvm::StringMap<Entry>::const_iterator entry = mEntries.begin(),
+          entry_end = mEntries.end(); entry != entry_end; entry++) {
+    const Entry &value = entry->getValue();
+    reloccache::EntryItem item;
+
+    item.name = string_pool.size();
+    item.module = value.module;
+    item.addr = reinterpret_cast<uintptr_t>(value.addr);
+
+    if (mModules[value.module].anchor == entry->getKeyData()) {
+      modules.editItemAt(value.module).anchor = entries.size();
+    }
+
+    // Append the name including its null terminator.
+    string_pool.append(entry->getKeyData(), entry->getKeyLength());
+    string_pool.push_back('\0');
+    entries.push_back(item);
+  }
+
+  ::memcpy(header.magic, RELOCCACHE_MAGIC, RELOCCACHE_MAGIC_LENGTH);
+  ::memcpy(header.version, RELOCCACHE_VERSION, RELOCCACHE_VERSION_LENGTH);
+  header.numModules = modules.size();
+  header.numEntries = entries.size();
+  header.strPoolSize = string_pool.size();
+  ::memcpy(header.chainDigest, mChainDigest, SHA1_DIGEST_LENGTH);
+  header.padding = 0;
+
+  // Write to a temporary file in the same directory first so that the rename
+  // below replaces the cache atomically.
+  const std::string tmp_path = OutputFile::CreateTemporary(pPath);
+  if (tmp_path.empty()) {
+    return false;
+  }
+
+  entries_size = entries.size() * sizeof(reloccache::EntryItem);
+  modules_size = modules.size() * sizeof(reloccache::ModuleItem);
+
+  {
+    OutputFile output(tmp_path, FileBase::kTruncate);
+    if (output.hasError()) {
+      ALOGW("Failed to open the relocation cache %s for write! (%s)",
+            tmp_path.c_str(), output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+
+    if ((output.write(&header, sizeof(header)) !=
+             static_cast<ssize_t>(sizeof(header))) ||
+        (output.write(entries.array(), entries_size) !=
+             static_cast<ssize_t>(entries_size)) ||
+        (output.write(modules.array(), modules_size) !=
+             static_cast<ssize_t>(modules_size)) ||
+        (output.write(string_pool.data(), string_pool.size()) !=
+             static_cast<ssize_t>(string_pool.size()))) {
+      ALOGW("Failed to write the relocation cache %s! (%s)", tmp_path.c_str(),
+            output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), pPath) != 0) {
+    ALOGW("Failed to rename %s to %s! (%s)", tmp_path.c_str(), pPath,
+          ::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
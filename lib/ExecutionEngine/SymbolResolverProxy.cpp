@@ -16,12 +16,143 @@
 
 #include "bcc/ExecutionEngine/SymbolResolverProxy.h"
 
+#include <cstring>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/SmallVector.h>
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/Mutex.h>
+#include <llvm/Support/MutexGuard.h>
+
 using namespace bcc;
 
+namespace {
+
+// Process-wide table of the addresses returned from stable resolvers. The key
+// of an entry is the scope of the resolver and the symbol name separated by a
+// '\0'. Only the symbols that were found are recorded since a stable resolver
+// is only required to keep the addresses it returns valid.
+class StableSymbolMemo {
+private:
+  llvm::sys::Mutex mLock;
+  llvm::StringMap<void *> mTable;
+  SymbolResolverProxy::MemoStatistics mStats;
+
+  static void BuildKey(llvm::SmallVectorImpl<char> &pKey, const char *pScope,
+                       const char *pName) {
+    pKey.append(pScope, pScope + ::strlen(pScope));
+    pKey.push_back('\0');
+    pKey.append(pName, pName + ::strlen(pName));
+  }
+
+public:
+  StableSymbolMemo() : mLock(), mTable() {
+    ::memset(&mStats, 0, sizeof(mStats));
+  }
+
+  void *getAddress(SymbolResolverInterface &pResolver, const char *pScope,
+                   const char *pName) {
+    llvm::SmallString<128> key;
+    BuildKey(key, pScope, pName);
+
+    {
+      llvm::MutexGuard locked(mLock);
+      llvm::StringMap<void *>::const_iterator entry = mTable.find(key);
+      if (entry != mTable.end()) {
+        mStats.numHits++;
+        return entry->getValue();
+      }
+      mStats.numMisses++;
+    }
+
+    // The lock is not held during the actual lookup. Two threads may resolve
+    // the same symbol concurrently but they will get the same answer.
+    void *addr = pResolver.getAddress(pName);
+    if (addr != NULL) {
+      llvm::MutexGuard locked(mLock);
+      mTable[key] = addr;
+    }
+    return addr;
+  }
+
+  // Bulk version of getAddress(). The table is locked once to collect the
+  // memoized addresses and once to record the newly found ones, and the
+  // remaining symbols are passed to pResolver in a single query.
+  void getAddresses(SymbolResolverInterface &pResolver, const char *pScope,
+                    const char *const *pNames, size_t pCount, void **pAddrs) {
+    llvm::SmallVector<size_t, 32> misses;
+    llvm::SmallVector<const char *, 32> miss_names;
+
+    {
+      llvm::MutexGuard locked(mLock);
+      for (size_t i = 0; i < pCount; i++) {
+        llvm::SmallString<128> key;
+        BuildKey(key, pScope, pNames[i]);
+
+        llvm::StringMap<void *>::const_iterator entry = mTable.find(key);
+        if (entry != mTable.end()) {
+          pAddrs[i] = entry->getValue();
+        } else {
+          pAddrs[i] = NULL;
+          misses.push_back(i);
+          miss_names.push_back(pNames[i]);
+        }
+      }
+      mStats.numHits += (pCount - misses.size());
+      mStats.numMisses += misses.size();
+    }
+
+    if (misses.empty()) {
+      return;
+    }
+
+    llvm::SmallVector<void *, 32> miss_addrs(misses.size(), NULL);
+    pResolver.getAddresses(miss_names.data(), miss_names.size(),
+                           miss_addrs.data());
+
+    llvm::MutexGuard locked(mLock);
+    for (size_t i = 0, e = misses.size(); i != e; i++) {
+      if (miss_addrs[i] != NULL) {
+        llvm::SmallString<128> key;
+        BuildKey(key, pScope, miss_names[i]);
+        mTable[key] = miss_addrs[i];
+        pAddrs[misses[i]] = miss_addrs[i];
+      }
+    }
+  }
+
+  SymbolResolverProxy::MemoStatistics getStatistics() {
+    llvm::MutexGuard locked(mLock);
+    SymbolResolverProxy::MemoStatistics result = mStats;
+    result.numEntries = mTable.size();
+    return result;
+  }
+};
+
+StableSymbolMemo &GetStableSymbolMemo() {
+  static StableSymbolMemo sMemo;
+  return sMemo;
+}
+
+} // end anonymous namespace
+
+SymbolResolverProxy::MemoStatistics SymbolResolverProxy::GetMemoStatistics() {
+  return GetStableSymbolMemo().getStatistics();
+}
+
 void *SymbolResolverProxy::getAddress(const char *pName) {
   // Search the address of the symbol by following the chain of resolvers.
   for (size_t i = 0; i < mChain.size(); i++) {
-    void *addr = mChain[i]->getAddress(pName);
+    SymbolResolverInterface *resolver = mChain[i];
+    const char *scope = resolver->getStableScope();
+    void *addr;
+
+    if (scope != NULL) {
+      addr = GetStableSymbolMemo().getAddress(*resolver, scope, pName);
+    } else {
+      addr = resolver->getAddress(pName);
+    }
+
     if (addr != NULL) {
       return addr;
     }
@@ -30,6 +161,57 @@ void *SymbolResolverProxy::getAddress(const char *pName) {
   return NULL;
 }
 
+size_t SymbolResolverProxy::getAddresses(const char *const *pNames,
+                                         size_t pCount, void **pAddrs) {
+  // Indices (in pNames) of the symbols which haven't been resolved yet.
+  llvm::SmallVector<size_t, 32> pending;
+  for (size_t i = 0; i < pCount; i++) {
+    pAddrs[i] = NULL;
+    pending.push_back(i);
+  }
+
+  llvm::SmallVector<const char *, 32> names;
+  llvm::SmallVector<void *, 32> addrs;
+  for (size_t i = 0; (i < mChain.size()) && !pending.empty(); i++) {
+    SymbolResolverInterface *resolver = mChain[i];
+    const char *scope = resolver->getStableScope();
+
+    names.clear();
+    for (size_t j = 0, e = pending.size(); j != e; j++) {
+      names.push_back(pNames[pending[j]]);
+    }
+    addrs.assign(names.size(), NULL);
+
+    if (scope != NULL) {
+      GetStableSymbolMemo().getAddresses(*resolver, scope, names.data(),
+                                         names.size(), addrs.data());
+    } else {
+      resolver->getAddresses(names.data(), names.size(), addrs.data());
+    }
+
+    // Record the symbols found and pass the rest to the next resolver.
+    size_t num_pending = 0;
+    for (size_t j = 0, e = pending.size(); j != e; j++) {
+      if (addrs[j] != NULL) {
+        pAddrs[pending[j]] = addrs[j];
+      } else {
+        pending[num_pending++] = pending[j];
+      }
+    }
+    pending.resize(num_pending);
+  }
+
+  return (pCount - pending.size());
+}
+
 void SymbolResolverProxy::chainResolver(SymbolResolverInterface &pResolver) {
   mChain.push_back(&pResolver);
 }
+
+void SymbolResolverProxy::getChainKey(std::string &pResult) const {
+  for (size_t i = 0; i < mChain.size(); i++) {
+    const char *scope = mChain[i]->getStableScope();
+    pResult.append((scope != NULL) ? scope : "-");
+    pResult.push_back('\0');
+  }
+}
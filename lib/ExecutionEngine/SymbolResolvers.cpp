@@ -54,7 +54,8 @@ using namespace bcc;
 // DyldSymbolResolver
 //===----------------------------------------------------------------------===//
 DyldSymbolResolver::DyldSymbolResolver(const char *pFileName,
-                                       bool pLazyBinding) : mError(NULL) {
+                                       bool pLazyBinding,
+                                       bool pStable) : mError(NULL) {
   int flags = (pLazyBinding) ? RTLD_LAZY : RTLD_NOW;
 
   // Make the symbol within the given library to be local such that it won't
@@ -77,6 +78,8 @@ DyldSymbolResolver::DyldSymbolResolver(const char *pFileName,
       ::snprintf(mError, error_length, DYLD_ERROR_MSG_PATTERN, pFileName,
                  ((err != NULL) ? err : ""));
     }
+  } else if (pStable) {
+    mStableScope = ((pFileName != NULL) ? pFileName : "<process>");
   }
 #undef DYLD_ERROR_MSG_PATTERN
 }
@@ -87,7 +90,9 @@ void *DyldSymbolResolver::getAddress(const char *pName) {
 }
 
 DyldSymbolResolver::~DyldSymbolResolver() {
-  if (mHandle != NULL) {
+  // A stable resolver leaves the library loaded since the addresses it handed
+  // out may have been memoized.
+  if ((mHandle != NULL) && mStableScope.empty()) {
     ::dlclose(mHandle);
     mHandle = NULL;
   }
@@ -22,16 +22,25 @@ LOCAL_PATH := $(call my-dir)
 #=====================================================================
 
 libbcc_renderscript_SRC_FILES := \
+  RSAccessTrace.cpp \
+  RSAccessTracePass.cpp \
+  RSCacheIndex.cpp \
   RSCompiler.cpp \
   RSCompilerDriver.cpp \
   RSEmbedInfo.cpp \
   RSExecutable.cpp \
+  RSExecutionCounters.cpp \
+  RSExecutionCountersPass.cpp \
   RSForEachExpand.cpp \
   RSInfo.cpp \
+  RSInfoExportSymbols.cpp \
   RSInfoExtractor.cpp \
   RSInfoReader.cpp \
   RSInfoWriter.cpp \
-  RSScript.cpp
+  RSLazyBind.cpp \
+  RSScript.cpp \
+  RSScriptLoadBatch.cpp \
+  RSSectionLayout.cpp
 
 #=====================================================================
 # Device Static Library: libbccRenderscript
@@ -0,0 +1,269 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Renderscript/RSAccessTrace.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <map>
+#include <new>
+#include <set>
+#include <vector>
+
+#include "bcc/Support/InputFile.h"
+#include "bcc/Support/Log.h"
+#include "bcc/Support/OutputFile.h"
+
+using namespace bcc;
+
+android::String8 RSAccessTrace::GetPath(const char *pObjectPath) {
+  android::String8 result(pObjectPath);
+  result.append(".trace");
+  return result;
+}
+
+void RSAccessTrace::clear() {
+  mSources.clear();
+  mSourceOffsets.clear();
+  mRecords.clear();
+}
+
+void RSAccessTrace::addSource(const char *pName) {
+  mSourceOffsets.push_back(mSources.size());
+  mSources.append(pName);
+  mSources.push_back('\0');
+}
+
+void RSAccessTrace::add(const rstrace::Record &pRecord) {
+  mRecords.push_back(pRecord);
+}
+
+bool RSAccessTrace::readFromFile(const char *pPath) {
+  const rstrace::Header *header;
+  const rstrace::Record *records;
+  const char *string_pool;
+  uint64_t expected_size;
+  size_t file_size;
+  size_t name_offset;
+  uint8_t *buffer = NULL;
+
+  clear();
+
+  InputFile input(pPath);
+  if (input.hasError()) {
+    ALOGV("No access trace %s is available. (%s)", pPath,
+          input.getErrorMessage().c_str());
+    return false;
+  }
+
+  file_size = input.getSize();
+  if (input.hasError() || (file_size < sizeof(rstrace::Header))) {
+    ALOGW("Invalid access trace %s! (size: %u)", pPath,
+          static_cast<unsigned>(file_size));
+    goto bail;
+  }
+
+  buffer = new (std::nothrow) uint8_t [ file_size ];
+  if (buffer == NULL) {
+    ALOGE("Out of memory when read access trace %s!", pPath);
+    goto bail;
+  }
+
+  if (input.read(buffer, file_size) != static_cast<ssize_t>(file_size)) {
+    ALOGE("Failed to read access trace %s! (%s)", pPath,
+          input.getErrorMessage().c_str());
+    goto bail;
+  }
+
+  header = reinterpret_cast<const rstrace::Header *>(buffer);
+  if (::memcmp(header->magic, RSTRACE_MAGIC, RSTRACE_MAGIC_LENGTH) != 0) {
+    ALOGW("Invalid magic in access trace %s!", pPath);
+    goto bail;
+  }
+
+  if (::memcmp(header->version, RSTRACE_VERSION,
+               RSTRACE_VERSION_LENGTH) != 0) {
+    ALOGV("Mismatch the version of access trace %s! (expect: %s, got: %s)",
+          pPath, RSTRACE_VERSION, header->version);
+    goto bail;
+  }
+
+  expected_size = sizeof(rstrace::Header) +
+      static_cast<uint64_t>(header->numRecords) * sizeof(rstrace::Record) +
+      header->strPoolSize;
+  if ((expected_size != file_size) || (header->strPoolSize == 0)) {
+    ALOGW("Corrupted access trace %s! (size: %u, expected: %llu)", pPath,
+          static_cast<unsigned>(file_size),
+          static_cast<unsigned long long>(expected_size));
+    goto bail;
+  }
+
+  records = reinterpret_cast<const rstrace::Record *>(header + 1);
+  string_pool = reinterpret_cast<const char *>(records + header->numRecords);
+
+  if (string_pool[header->strPoolSize - 1] != '\0') {
+    ALOGW("String pool in access trace %s is not terminated!", pPath);
+    goto bail;
+  }
+
+  for (name_offset = 0; name_offset < header->strPoolSize;
+       name_offset += ::strlen(&string_pool[name_offset]) + 1) {
+    addSource(&string_pool[name_offset]);
+  }
+
+  for (uint32_t i = 0; i < header->numRecords; i++) {
+    if (records[i].source >= getNumSources()) {
+      ALOGW("Unknown source #%u of sample #%u in access trace %s!",
+            records[i].source, i, pPath);
+      goto bail;
+    }
+    add(records[i]);
+  }
+
+  delete [] buffer;
+  return true;
+
+bail:
+  delete [] buffer;
+  clear();
+  return false;
+}
+
+bool RSAccessTrace::writeToFile(const char *pPath) const {
+  rstrace::Header header;
+  size_t records_size = mRecords.size() * sizeof(rstrace::Record);
+
+  ::memcpy(header.magic, RSTRACE_MAGIC, RSTRACE_MAGIC_LENGTH);
+  ::memcpy(header.version, RSTRACE_VERSION, RSTRACE_VERSION_LENGTH);
+  header.numRecords = mRecords.size();
+  header.strPoolSize = mSources.size();
+  header.padding = 0;
+
+  // Write to a temporary file in the same directory first so that the rename
+  // below replaces the file atomically.
+  const std::string tmp_path = OutputFile::CreateTemporary(pPath);
+  if (tmp_path.empty()) {
+    return false;
+  }
+
+  {
+    OutputFile output(tmp_path, FileBase::kTruncate);
+    if (output.hasError()) {
+      ALOGW("Failed to open the access trace %s for write! (%s)",
+            tmp_path.c_str(), output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+
+    if ((output.write(&header, sizeof(header)) !=
+             static_cast<ssize_t>(sizeof(header))) ||
+        (output.write(mRecords.array(), records_size) !=
+             static_cast<ssize_t>(records_size)) ||
+        (output.write(mSources.data(), mSources.size()) !=
+             static_cast<ssize_t>(mSources.size()))) {
+      ALOGW("Failed to write the access trace %s! (%s)", tmp_path.c_str(),
+            output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), pPath) != 0) {
+    ALOGW("Failed to rename %s to %s! (%s)", tmp_path.c_str(), pPath,
+          ::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+void RSAccessTrace::summarize(android::Vector<SourceSummary> &pResult,
+                              unsigned pCacheLineSize,
+                              unsigned pReuseWindow) const {
+  SourceSummary empty;
+  ::memset(&empty, 0, sizeof(empty));
+  empty.minX = empty.minY = 0xFFFFFFFFu;
+
+  pResult.clear();
+  pResult.insertAt(empty, 0, getNumSources());
+
+  // Per source: the last sample, the histogram of the strides, the lines
+  // touched and the lines touched by the latest samples (oldest first.)
+  android::Vector<const rstrace::Record *> last;
+  last.insertAt(NULL, 0, getNumSources());
+  std::vector<std::map<int64_t, size_t> > strides(getNumSources());
+  std::vector<std::set<uint64_t> > lines(getNumSources());
+  std::vector<std::vector<uint64_t> > recent_lines(getNumSources());
+
+  for (size_t i = 0; i < mRecords.size(); i++) {
+    const rstrace::Record &record = mRecords[i];
+    SourceSummary &summary = pResult.editItemAt(record.source);
+
+    summary.numSamples++;
+    if (record.x < summary.minX) summary.minX = record.x;
+    if (record.x > summary.maxX) summary.maxX = record.x;
+    if (record.y < summary.minY) summary.minY = record.y;
+    if (record.y > summary.maxY) summary.maxY = record.y;
+
+    const rstrace::Record *prev = last[record.source];
+    last.editItemAt(record.source) = &record;
+
+    if (record.address == 0) {
+      continue;
+    }
+    summary.numAddressed++;
+
+    if ((prev != NULL) && (prev->address != 0) && (prev->y == record.y) &&
+        (prev->x + 1 == record.x)) {
+      int64_t stride = static_cast<int64_t>(record.address - prev->address);
+      strides[record.source][stride]++;
+      summary.numStrides++;
+    }
+
+    uint64_t line = record.address / pCacheLineSize;
+    lines[record.source].insert(line);
+
+    std::vector<uint64_t> &recent = recent_lines[record.source];
+    for (size_t j = 0; j < recent.size(); j++) {
+      if (recent[j] == line) {
+        summary.numReused++;
+        break;
+      }
+    }
+    recent.push_back(line);
+    if (recent.size() > pReuseWindow) {
+      recent.erase(recent.begin());
+    }
+  }
+
+  for (size_t i = 0; i < getNumSources(); i++) {
+    SourceSummary &summary = pResult.editItemAt(i);
+    summary.numCacheLines = lines[i].size();
+    for (std::map<int64_t, size_t>::const_iterator
+             stride_iter = strides[i].begin(), stride_end = strides[i].end();
+         stride_iter != stride_end; stride_iter++) {
+      if (stride_iter->second > summary.numStrideHits) {
+        summary.stride = stride_iter->first;
+        summary.numStrideHits = stride_iter->second;
+      }
+    }
+  }
+  return;
+}
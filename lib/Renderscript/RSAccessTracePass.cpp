@@ -0,0 +1,406 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Assert.h"
+#include "bcc/Renderscript/RSTransforms.h"
+
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringExtras.h>
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/IR/Type.h>
+#include <llvm/Transforms/Utils/BasicBlockUtils.h>
+
+#include "bcc/Renderscript/RSAccessTrace.h"
+#include "bcc/Renderscript/RSExecutable.h"
+#include "bcc/Support/Log.h"
+#include "bcinfo/MetadataExtractor.h"
+
+using namespace bcc;
+
+namespace {
+
+/* RSAccessTracePass - This pass samples the memory accesses made by the
+ * kernels of a script into a ring buffer (.rs.trace) for finding out their
+ * access patterns. A sample (see rstrace::Record) tells the accessed address,
+ * the source of the access and the x and the y of the element being
+ * processed. The following are traced:
+ *
+ *   - "<kernel>:in", "<kernel>:in<N>" and "<kernel>:out": the input and the
+ *     output elements of each expanded foreach kernel.
+ *   - "<function>:rsGetElementAt": calls to the rsGetElementAt*() family.
+ *     Only the untyped rsGetElementAt() returns the address. It's 0 for the
+ *     others.
+ *
+ * The elements with (x & mask) < burst are sampled so that the runs of
+ * consecutive elements, hence the strides, are seen. mask and burst are in
+ * .rs.trace.sampling and can be changed by the runtime before the kernels are
+ * launched. The names of the sources are listed in .rs.trace.sources.
+ *
+ * This must run after RSForEachExpandPass.
+ */
+class RSAccessTracePass : public llvm::ModulePass {
+private:
+  static char ID;
+
+  // Fields of RsForEachStubParamStruct (see RSForEachExpandPass.)
+  enum {
+    kStubFieldIn = 0,
+    kStubFieldOut = 1,
+    kStubFieldY = 5,
+    kStubFieldIns = 10,
+  };
+
+  llvm::Module *M;
+  llvm::LLVMContext *C;
+
+  // The metadata of the module, shared with the other RS passes.
+  const bcinfo::MetadataExtractor &mMetadata;
+
+  llvm::GlobalVariable *SamplingGV;
+  llvm::Function *RecordFn;
+
+  std::vector<std::string> Sources;
+
+  unsigned addSource(const std::string &Name) {
+    Sources.push_back(Name);
+    return Sources.size() - 1;
+  }
+
+  static bool isGetElementAt(const llvm::Function *F) {
+    // Both the C and the C++ mangled names, e.g., _Z14rsGetElementAt13rs_
+    // allocationj.
+    return (F != NULL) &&
+           (F->getName().find("rsGetElementAt") != llvm::StringRef::npos) &&
+           (F->getName().find("rsGetElementAtYuv") == llvm::StringRef::npos);
+  }
+
+  // Create the function which appends a sample to the ring buffer.
+  void createRecordFunction(llvm::GlobalVariable *RingGV,
+                            llvm::GlobalVariable *HeadGV) {
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(*C);
+    llvm::Type *ParamTys[] = { Int64Ty, Int32Ty, Int32Ty, Int32Ty };
+    llvm::FunctionType *FTy =
+        llvm::FunctionType::get(llvm::Type::getVoidTy(*C), ParamTys, false);
+
+    // Keep the sampling out of the kernels' loops.
+    RecordFn = llvm::Function::Create(FTy, llvm::GlobalValue::InternalLinkage,
+                                      ".rs.trace.record", M);
+    RecordFn->addFnAttr(llvm::Attribute::NoInline);
+
+    llvm::Function::arg_iterator AI = RecordFn->arg_begin();
+    llvm::Value *Address = AI++;
+    llvm::Value *Source = AI++;
+    llvm::Value *X = AI++;
+    llvm::Value *Y = AI;
+
+    llvm::BasicBlock *BB = llvm::BasicBlock::Create(*C, "entry", RecordFn);
+    llvm::IRBuilder<> Builder(BB);
+
+    llvm::Value *Idx = Builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, HeadGV,
+                                               Builder.getInt32(1),
+                                               llvm::Monotonic);
+    Idx = Builder.CreateAnd(Idx, Builder.getInt32(RSTRACE_RING_SIZE - 1));
+
+    llvm::Value *Indices[] = { Builder.getInt32(0), Idx };
+    llvm::Value *Record = Builder.CreateInBoundsGEP(RingGV, Indices);
+    Builder.CreateStore(Address, Builder.CreateStructGEP(Record, 0));
+    Builder.CreateStore(Source, Builder.CreateStructGEP(Record, 1));
+    Builder.CreateStore(X, Builder.CreateStructGEP(Record, 2));
+    Builder.CreateStore(Y, Builder.CreateStructGEP(Record, 3));
+    Builder.CreateRetVoid();
+  }
+
+  // Return (X & mask) < burst.
+  llvm::Value *createSampleCondition(llvm::IRBuilder<> &Builder,
+                                     llvm::Value *X) {
+    llvm::Value *Mask = Builder.CreateLoad(
+        Builder.CreateConstInBoundsGEP2_32(SamplingGV, 0, 0));
+    llvm::Value *Burst = Builder.CreateLoad(
+        Builder.CreateConstInBoundsGEP2_32(SamplingGV, 0, 1));
+    return Builder.CreateICmpULT(Builder.CreateAnd(X, Mask), Burst);
+  }
+
+  // Name the source of the element pointer Ptr computed in an expanded
+  // kernel, or return false if Ptr isn't one.
+  bool getElementSourceName(llvm::GetElementPtrInst *Ptr,
+                            const std::string &Kernel, std::string &Name) {
+    llvm::LoadInst *Base = llvm::dyn_cast<llvm::LoadInst>(
+        Ptr->getPointerOperand()->stripPointerCasts());
+    if (Base == NULL) {
+      return false;
+    }
+
+    // p->in or p->out.
+    llvm::GetElementPtrInst *Field =
+        llvm::dyn_cast<llvm::GetElementPtrInst>(Base->getPointerOperand());
+    if ((Field != NULL) && (Field->getNumIndices() == 2)) {
+      llvm::ConstantInt *Idx =
+          llvm::dyn_cast<llvm::ConstantInt>(Field->getOperand(2));
+      if (Idx != NULL) {
+        if (Idx->getZExtValue() == kStubFieldIn) {
+          Name = Kernel + ":in";
+          return true;
+        } else if (Idx->getZExtValue() == kStubFieldOut) {
+          Name = Kernel + ":out";
+          return true;
+        }
+      }
+      return false;
+    }
+
+    // p->ins[N].
+    if ((Field != NULL) && (Field->getNumIndices() == 1)) {
+      llvm::ConstantInt *Idx =
+          llvm::dyn_cast<llvm::ConstantInt>(Field->getOperand(1));
+      llvm::LoadInst *Ins =
+          llvm::dyn_cast<llvm::LoadInst>(Field->getPointerOperand());
+      llvm::GetElementPtrInst *InsField = NULL;
+      if (Ins != NULL) {
+        InsField =
+            llvm::dyn_cast<llvm::GetElementPtrInst>(Ins->getPointerOperand());
+      }
+      if ((Idx != NULL) && (InsField != NULL) &&
+          (InsField->getNumIndices() == 2)) {
+        llvm::ConstantInt *InsIdx =
+            llvm::dyn_cast<llvm::ConstantInt>(InsField->getOperand(2));
+        if ((InsIdx != NULL) && (InsIdx->getZExtValue() == kStubFieldIns)) {
+          Name = Kernel + ":in" + llvm::utostr(Idx->getZExtValue());
+          return true;
+        }
+      }
+    }
+
+    return false;
+  }
+
+  void instrumentExpanded(llvm::Function *F, const std::string &Kernel) {
+    // The loop over x created by RSForEachExpandPass::createLoop().
+    llvm::PHINode *X = NULL;
+    for (llvm::Function::iterator BI = F->begin(), BE = F->end();
+         (BI != BE) && (X == NULL); ++BI) {
+      llvm::PHINode *PN = llvm::dyn_cast<llvm::PHINode>(BI->begin());
+      if ((PN != NULL) && (PN->getName() == "X")) {
+        X = PN;
+      }
+    }
+    if (X == NULL) {
+      return;
+    }
+
+    llvm::BasicBlock *Loop = X->getParent();
+    std::vector<std::pair<llvm::Value *, unsigned> > Accesses;
+    for (llvm::BasicBlock::iterator II = Loop->begin(), IE = Loop->end();
+         II != IE; ++II) {
+      llvm::GetElementPtrInst *Ptr =
+          llvm::dyn_cast<llvm::GetElementPtrInst>(II);
+      std::string Name;
+      if ((Ptr != NULL) && getElementSourceName(Ptr, Kernel, Name)) {
+        Accesses.push_back(std::make_pair(Ptr, addSource(Name)));
+      }
+    }
+    if (Accesses.empty()) {
+      return;
+    }
+
+    // Load p->y up front. The expanded kernel only does if the kernel takes y.
+    llvm::IRBuilder<> Builder(F->getEntryBlock().getFirstInsertionPt());
+    llvm::Value *P = &*F->arg_begin();
+    llvm::Value *Y =
+        Builder.CreateLoad(Builder.CreateStructGEP(P, kStubFieldY));
+
+    Builder.SetInsertPoint(Loop->getTerminator());
+    llvm::Value *Cond = createSampleCondition(Builder, X);
+    llvm::TerminatorInst *Then =
+        llvm::SplitBlockAndInsertIfThen(Cond, Loop->getTerminator(), false);
+
+    Builder.SetInsertPoint(Then);
+    for (size_t i = 0; i < Accesses.size(); i++) {
+      llvm::Value *Args[] = {
+        Builder.CreatePtrToInt(Accesses[i].first, Builder.getInt64Ty()),
+        Builder.getInt32(Accesses[i].second),
+        X,
+        Y
+      };
+      Builder.CreateCall(RecordFn, Args);
+    }
+  }
+
+  void instrumentGetElementAt(llvm::CallInst *Call) {
+    // The allocation is followed by x and, optionally, y and z.
+    llvm::Value *X = NULL;
+    llvm::Value *Y = NULL;
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+    for (unsigned i = 1; i < Call->getNumArgOperands(); i++) {
+      llvm::Value *Arg = Call->getArgOperand(i);
+      if (Arg->getType() != Int32Ty) {
+        continue;
+      }
+      if (X == NULL) {
+        X = Arg;
+      } else if (Y == NULL) {
+        Y = Arg;
+      }
+    }
+    if (X == NULL) {
+      return;
+    }
+
+    std::string Caller = Call->getParent()->getParent()->getName();
+    unsigned Source = addSource(Caller + ":rsGetElementAt");
+
+    llvm::BasicBlock::iterator Next = Call;
+    ++Next;
+    llvm::IRBuilder<> Builder(Next);
+    llvm::Value *Cond = createSampleCondition(Builder, X);
+    llvm::TerminatorInst *Then =
+        llvm::SplitBlockAndInsertIfThen(Cond, &*Next, false);
+
+    Builder.SetInsertPoint(Then);
+    llvm::Value *Address = Builder.getInt64(0);
+    if (Call->getType()->isPointerTy()) {
+      Address = Builder.CreatePtrToInt(Call, Builder.getInt64Ty());
+    }
+    llvm::Value *Args[] = {
+      Address,
+      Builder.getInt32(Source),
+      X,
+      (Y != NULL) ? Y : Builder.getInt32(0)
+    };
+    Builder.CreateCall(RecordFn, Args);
+  }
+
+public:
+  RSAccessTracePass(const bcinfo::MetadataExtractor &pMetadata)
+      : ModulePass(ID), M(NULL), C(NULL), mMetadata(pMetadata),
+        SamplingGV(NULL), RecordFn(NULL) {
+  }
+
+  virtual bool runOnModule(llvm::Module &Module) {
+    M = &Module;
+    C = &Module.getContext();
+    Sources.clear();
+
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+    llvm::Type *Int64Ty = llvm::Type::getInt64Ty(*C);
+
+    // See rstrace::Record.
+    llvm::Type *RecordFieldTys[] = { Int64Ty, Int32Ty, Int32Ty, Int32Ty,
+                                     Int32Ty };
+    llvm::StructType *RecordTy =
+        llvm::StructType::create(RecordFieldTys, "RSAccessTraceRecord");
+    llvm::ArrayType *RingTy = llvm::ArrayType::get(RecordTy, RSTRACE_RING_SIZE);
+
+    llvm::GlobalVariable *RingGV = new llvm::GlobalVariable(
+        *M, RingTy, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantAggregateZero::get(RingTy),
+        RSExecutable::AccessTraceName);
+    RingGV->setAlignment(64);
+
+    llvm::GlobalVariable *HeadGV = new llvm::GlobalVariable(
+        *M, Int32Ty, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantInt::get(Int32Ty, 0), RSExecutable::AccessTraceHeadName);
+
+    llvm::Constant *Sampling[] = {
+      llvm::ConstantInt::get(Int32Ty, RSTRACE_DEFAULT_MASK),
+      llvm::ConstantInt::get(Int32Ty, RSTRACE_DEFAULT_BURST)
+    };
+    llvm::ArrayType *SamplingTy = llvm::ArrayType::get(Int32Ty, 2);
+    SamplingGV = new llvm::GlobalVariable(
+        *M, SamplingTy, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantArray::get(SamplingTy, Sampling),
+        RSExecutable::AccessTraceSamplingName);
+
+    createRecordFunction(RingGV, HeadGV);
+
+    // Collect the call sites first. Instrumenting them splits the blocks.
+    std::vector<llvm::CallInst *> Calls;
+    for (llvm::Module::iterator FI = M->begin(), FE = M->end(); FI != FE;
+         ++FI) {
+      if (FI->isDeclaration() || (&*FI == RecordFn) || isGetElementAt(&*FI)) {
+        continue;
+      }
+      for (llvm::Function::iterator BI = FI->begin(), BE = FI->end();
+           BI != BE; ++BI) {
+        for (llvm::BasicBlock::iterator II = BI->begin(), IE = BI->end();
+             II != IE; ++II) {
+          llvm::CallInst *Call = llvm::dyn_cast<llvm::CallInst>(II);
+          if ((Call != NULL) && isGetElementAt(Call->getCalledFunction())) {
+            Calls.push_back(Call);
+          }
+        }
+      }
+    }
+
+    for (size_t i = 0; i < Calls.size(); i++) {
+      instrumentGetElementAt(Calls[i]);
+    }
+
+    size_t exportForEachCount = mMetadata.getExportForEachSignatureCount();
+    const char **exportForEachNameList = mMetadata.getExportForEachNameList();
+    for (size_t i = 0; i < exportForEachCount; i++) {
+      llvm::Function *F =
+          M->getFunction(std::string(exportForEachNameList[i]) + ".expand");
+      if ((F != NULL) && !F->isDeclaration()) {
+        instrumentExpanded(F, exportForEachNameList[i]);
+      }
+    }
+
+    // Names of the sources separated by NUL, indexed by Record::source.
+    std::string Names;
+    for (size_t i = 0; i < Sources.size(); i++) {
+      Names.append(Sources[i]);
+      Names.push_back('\0');
+    }
+    if (Names.empty()) {
+      Names.push_back('\0');
+    }
+    llvm::Constant *NamesInit =
+        llvm::ConstantDataArray::getString(*C, Names, /* AddNull */false);
+    new llvm::GlobalVariable(*M, NamesInit->getType(), true,
+                             llvm::GlobalValue::ExternalLinkage, NamesInit,
+                             RSExecutable::AccessTraceSourcesName);
+
+    ALOGV("Traced %zu sources of memory accesses.", Sources.size());
+    return true;
+  }
+
+  virtual const char *getPassName() const {
+    return "Renderscript Access Trace";
+  }
+
+};  // end RSAccessTracePass
+
+}  // end anonymous namespace
+
+char RSAccessTracePass::ID = 0;
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSAccessTracePass(const bcinfo::MetadataExtractor &pMetadata) {
+  return new RSAccessTracePass(pMetadata);
+}
+
+}  // end namespace bcc
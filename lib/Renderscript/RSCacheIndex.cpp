@@ -0,0 +1,396 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Renderscript/RSCacheIndex.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+#include <string>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/ADT/StringRef.h>
+#include <llvm/Support/Path.h>
+
+#include <utils/FileMap.h>
+#include <utils/Vector.h>
+
+#include "bcc/Renderscript/RSInfo.h"
+#include "bcc/Support/FileMutex.h"
+#include "bcc/Support/InputFile.h"
+#include "bcc/Support/Log.h"
+#include "bcc/Support/OutputFile.h"
+
+using namespace bcc;
+
+namespace {
+
+// The RS infos in the index are 8-byte aligned so that they can be read in
+// place.
+const size_t kInfoAlignment = 8;
+
+void helper_digest_name(uint8_t pResult[SHA1_DIGEST_LENGTH],
+                        const char *pObjectPath) {
+  llvm::StringRef name = llvm::sys::path::filename(pObjectPath);
+  Sha1Util::GetSHA1DigestFromBuffer(pResult, name.data(), name.size());
+}
+
+void helper_set_object(rsindex::Entry &pEntry, const struct stat &pStat) {
+  pEntry.objectIno = static_cast<uint64_t>(pStat.st_ino);
+  pEntry.objectSize = static_cast<uint64_t>(pStat.st_size);
+#if defined(__APPLE__)
+  pEntry.objectMTimeNs = static_cast<int64_t>(pStat.st_mtimespec.tv_sec) *
+                             1000000000LL + pStat.st_mtimespec.tv_nsec;
+#else
+  pEntry.objectMTimeNs = static_cast<int64_t>(pStat.st_mtim.tv_sec) *
+                             1000000000LL + pStat.st_mtim.tv_nsec;
+#endif
+}
+
+int helper_compare_entry(const rsindex::Entry *pLHS,
+                         const rsindex::Entry *pRHS) {
+  return ::memcmp(pLHS->nameDigest, pRHS->nameDigest, SHA1_DIGEST_LENGTH);
+}
+
+} // end anonymous namespace
+
+android::String8 RSCacheIndex::GetPath(const char *pCacheDir) {
+  llvm::SmallString<80> path(pCacheDir);
+  llvm::sys::path::append(path, RSINDEX_FILENAME);
+  return android::String8(path.c_str());
+}
+
+void RSCacheIndex::GetDependencyDigest(uint8_t pResult[SHA1_DIGEST_LENGTH],
+                                       const char *pCompileCommandLine,
+                                       const char *pBuildFingerprint) {
+  std::string dependencies(pCompileCommandLine);
+  dependencies.push_back('\0');
+  dependencies.append(pBuildFingerprint);
+  Sha1Util::GetSHA1DigestFromBuffer(pResult, dependencies.data(),
+                                    dependencies.size());
+}
+
+RSCacheIndex *RSCacheIndex::Open(const char *pCacheDir) {
+  android::String8 index_path = GetPath(pCacheDir);
+  android::FileMap *map = NULL;
+  const rsindex::Header *header;
+  const rsindex::Entry *entries;
+  RSCacheIndex *result;
+  size_t index_size;
+
+  InputFile index_file(index_path.string());
+  if (index_file.hasError()) {
+    ALOGV("No cache index %s is available. (%s)", index_path.string(),
+          index_file.getErrorMessage().c_str());
+    return NULL;
+  }
+
+  index_size = index_file.getSize();
+  if (index_file.hasError() || (index_size < sizeof(rsindex::Header))) {
+    ALOGW("Invalid cache index %s! (size: %u)", index_path.string(),
+          static_cast<unsigned>(index_size));
+    return NULL;
+  }
+
+  map = index_file.createMap(0, index_size, /* pIsReadOnly */true);
+  if (map == NULL) {
+    ALOGE("Failed to map cache index %s to the memory! (%s)",
+          index_path.string(), index_file.getErrorMessage().c_str());
+    return NULL;
+  }
+
+  header = reinterpret_cast<const rsindex::Header *>(map->getDataPtr());
+
+  if ((::memcmp(header->magic, RSINDEX_MAGIC, sizeof(header->magic)) != 0) ||
+      (::memcmp(header->version, RSINDEX_VERSION,
+                sizeof(header->version)) != 0)) {
+    ALOGV("Mismatch the magic or the version of cache index %s. Ignore it.",
+          index_path.string());
+    goto bail;
+  }
+
+  if ((header->entrySize != sizeof(rsindex::Entry)) ||
+      ((index_size - sizeof(rsindex::Header)) <
+          (static_cast<uint64_t>(header->numEntries) * sizeof(rsindex::Entry)))) {
+    ALOGW("Corrupted cache index %s! (unexpected size found)",
+          index_path.string());
+    goto bail;
+  }
+
+  // Check that every RS info is within the file so readInfo() doesn't need
+  // to.
+  entries = reinterpret_cast<const rsindex::Entry *>(header + 1);
+  for (uint32_t i = 0; i < header->numEntries; i++) {
+    if ((entries[i].infoOffset % kInfoAlignment) != 0 ||
+        (static_cast<uint64_t>(entries[i].infoOffset) + entries[i].infoSize >
+             index_size)) {
+      ALOGW("Corrupted cache index %s! (invalid RS info at entry %u)",
+            index_path.string(), i);
+      goto bail;
+    }
+  }
+
+  result = new (std::nothrow) RSCacheIndex(map, entries, header->numEntries);
+  if (result == NULL) {
+    ALOGE("Out of memory when open cache index %s!", index_path.string());
+    goto bail;
+  }
+
+  return result;
+
+bail:
+  map->release();
+  return NULL;
+}
+
+const rsindex::Entry *RSCacheIndex::find(const char *pObjectPath) const {
+  rsindex::Entry key;
+  helper_digest_name(key.nameDigest, pObjectPath);
+
+  // Binary search. The entries are sorted by Write().
+  size_t low = 0, high = mNumEntries;
+  while (low < high) {
+    size_t mid = low + (high - low) / 2;
+    int cmp = helper_compare_entry(&mEntries[mid], &key);
+    if (cmp == 0) {
+      return &mEntries[mid];
+    } else if (cmp < 0) {
+      low = mid + 1;
+    } else {
+      high = mid;
+    }
+  }
+  return NULL;
+}
+
+RSCacheIndex::LookupResult
+RSCacheIndex::lookup(const char *pObjectPath,
+                     const uint8_t pSourceSha1[SHA1_DIGEST_LENGTH],
+                     const uint8_t pDependencySha1[SHA1_DIGEST_LENGTH]) const {
+  const rsindex::Entry *entry = find(pObjectPath);
+  if (entry == NULL) {
+    return kNotFound;
+  }
+
+  if ((::memcmp(entry->sourceSha1, pSourceSha1, SHA1_DIGEST_LENGTH) != 0) ||
+      (::memcmp(entry->dependencySha1, pDependencySha1,
+                SHA1_DIGEST_LENGTH) != 0)) {
+    return kStale;
+  }
+
+  return kUpToDate;
+}
+
+bool RSCacheIndex::isPublished(FileBase &pObjectFile) const {
+  const rsindex::Entry *entry = find(pObjectFile.getName().c_str());
+  if (entry == NULL) {
+    return false;
+  }
+
+  struct stat object_stat;
+  if (!pObjectFile.getStat(object_stat)) {
+    return false;
+  }
+
+  rsindex::Entry current;
+  helper_set_object(current, object_stat);
+  return (entry->objectIno == current.objectIno) &&
+         (entry->objectSize == current.objectSize) &&
+         (entry->objectMTimeNs == current.objectMTimeNs);
+}
+
+RSInfo *RSCacheIndex::readInfo(const char *pObjectPath) const {
+  const rsindex::Entry *entry = find(pObjectPath);
+  if ((entry == NULL) || (entry->infoSize == 0)) {
+    return NULL;
+  }
+
+  const uint8_t *base = reinterpret_cast<const uint8_t *>(mMap->getDataPtr());
+  RSInfo *result = RSInfo::ReadFromBuffer(base + entry->infoOffset,
+                                          entry->infoSize, pObjectPath);
+  if (result == NULL) {
+    return NULL;
+  }
+
+  // The result refers to the mapping from now on.
+  result->mMap = mMap->acquire();
+  return result;
+}
+
+bool RSCacheIndex::Update(const char *pObjectPath, const RSInfo &pInfo,
+                          const uint8_t pSourceSha1[SHA1_DIGEST_LENGTH],
+                          const uint8_t pDependencySha1[SHA1_DIGEST_LENGTH]) {
+  return Write(pObjectPath, pInfo, pSourceSha1, pDependencySha1);
+}
+
+bool RSCacheIndex::UpdateInfo(const char *pObjectPath, const RSInfo &pInfo) {
+  return Write(pObjectPath, pInfo, NULL, NULL);
+}
+
+bool RSCacheIndex::Write(const char *pObjectPath, const RSInfo &pInfo,
+                         const uint8_t *pSourceSha1,
+                         const uint8_t *pDependencySha1) {
+  std::string cache_dir = llvm::sys::path::parent_path(pObjectPath).str();
+  android::String8 index_path = GetPath(cache_dir.c_str());
+  android::Vector<rsindex::Entry> entries;
+  android::Vector<const uint8_t *> infos;
+  std::string info;
+  std::string tmp_path;
+  rsindex::Entry entry;
+  rsindex::Header header;
+  struct stat object_stat;
+
+  ::memset(&entry, 0, sizeof(entry));
+  helper_digest_name(entry.nameDigest, pObjectPath);
+  if (pSourceSha1 != NULL) {
+    ::memcpy(entry.sourceSha1, pSourceSha1, SHA1_DIGEST_LENGTH);
+    ::memcpy(entry.dependencySha1, pDependencySha1, SHA1_DIGEST_LENGTH);
+  }
+  if (::stat(pObjectPath, &object_stat) != 0) {
+    ALOGW("Failed to stat %s for cache index %s! (%s)", pObjectPath,
+          index_path.string(), ::strerror(errno));
+    return false;
+  }
+  helper_set_object(entry, object_stat);
+
+  if (!pInfo.write(info)) {
+    ALOGW("Failed to serialize the RS info of %s for cache index %s!",
+          pObjectPath, index_path.string());
+    return false;
+  }
+  entry.infoSize = info.size();
+
+  // Serialize the updates to the index. Readers don't need the lock since the
+  // index is replaced by a rename.
+  FileMutex<FileBase::kWriteLock> write_index_mutex(index_path.string());
+  if (write_index_mutex.hasError() || !write_index_mutex.lock()) {
+    ALOGE("Unable to acquire the lock for writing %s! (%s)",
+          index_path.string(), write_index_mutex.getErrorMessage().c_str());
+    return false;
+  }
+
+  // Carry over the other entries of the current index with their RS infos,
+  // and put the new one in order among them.
+  bool inserted = false;
+  RSCacheIndex *current = Open(cache_dir.c_str());
+  const uint8_t *current_base = NULL;
+  if ((pSourceSha1 == NULL) &&
+      ((current == NULL) || (current->find(pObjectPath) == NULL))) {
+    // An RS info alone doesn't make an entry: only the publication of the
+    // object does.
+    delete current;
+    return true;
+  }
+  if (current != NULL) {
+    current_base = reinterpret_cast<const uint8_t *>(
+        current->mMap->getDataPtr());
+    entries.setCapacity(current->mNumEntries + 1);
+    infos.setCapacity(current->mNumEntries + 1);
+    for (size_t i = 0; i < current->mNumEntries; i++) {
+      const rsindex::Entry &current_entry = current->mEntries[i];
+      int cmp = helper_compare_entry(&current_entry, &entry);
+      if (cmp == 0) {
+        if (pSourceSha1 == NULL) {
+          ::memcpy(entry.sourceSha1, current_entry.sourceSha1,
+                   SHA1_DIGEST_LENGTH);
+          ::memcpy(entry.dependencySha1, current_entry.dependencySha1,
+                   SHA1_DIGEST_LENGTH);
+        }
+        continue;
+      }
+      if ((cmp > 0) && !inserted) {
+        entries.push(entry);
+        infos.push(reinterpret_cast<const uint8_t *>(info.data()));
+        inserted = true;
+      }
+      entries.push(current_entry);
+      infos.push(current_base + current_entry.infoOffset);
+    }
+  }
+  if (!inserted) {
+    entries.push(entry);
+    infos.push(reinterpret_cast<const uint8_t *>(info.data()));
+  }
+
+  ::memcpy(header.magic, RSINDEX_MAGIC, sizeof(header.magic));
+  ::memcpy(header.version, RSINDEX_VERSION, sizeof(header.version));
+  header.entrySize = sizeof(rsindex::Entry);
+  header.numEntries = entries.size();
+
+  // Lay the RS infos out after the entries.
+  size_t offset = sizeof(header) + entries.size() * sizeof(rsindex::Entry);
+  for (size_t i = 0; i < entries.size(); i++) {
+    offset = (offset + kInfoAlignment - 1) & ~(kInfoAlignment - 1);
+    entries.editItemAt(i).infoOffset = offset;
+    offset += entries[i].infoSize;
+  }
+
+  // Write to a temporary file in the same directory first so that the rename
+  // below replaces the index atomically.
+  tmp_path = OutputFile::CreateTemporary(index_path.string());
+  if (tmp_path.empty()) {
+    delete current;
+    return false;
+  }
+
+  {
+    static const uint8_t padding[kInfoAlignment] = { 0 };
+    size_t entries_size = entries.size() * sizeof(rsindex::Entry);
+    size_t written = sizeof(header) + entries_size;
+    OutputFile output(tmp_path, FileBase::kTruncate);
+    bool failed = output.hasError() ||
+        (output.write(&header, sizeof(header)) !=
+             static_cast<ssize_t>(sizeof(header))) ||
+        (output.write(entries.array(), entries_size) !=
+             static_cast<ssize_t>(entries_size));
+    for (size_t i = 0; !failed && (i < entries.size()); i++) {
+      size_t padding_size = entries[i].infoOffset - written;
+      failed = ((padding_size > 0) &&
+                (output.write(padding, padding_size) !=
+                     static_cast<ssize_t>(padding_size))) ||
+               (output.write(infos[i], entries[i].infoSize) !=
+                    static_cast<ssize_t>(entries[i].infoSize));
+      written = entries[i].infoOffset + entries[i].infoSize;
+    }
+    delete current;
+
+    if (failed) {
+      ALOGW("Failed to write the cache index %s! (%s)", tmp_path.c_str(),
+            output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), index_path.string()) != 0) {
+    ALOGW("Failed to rename %s to %s! (%s)", tmp_path.c_str(),
+          index_path.string(), ::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+RSCacheIndex::~RSCacheIndex() {
+  if (mMap != NULL) {
+    mMap->release();
+  }
+}
@@ -34,12 +34,12 @@ bool RSCompiler::addInternalizeSymbolsPass(Script &pScript, llvm::PassManager &p
   // Add a pass to internalize the symbols that don't need to have global
   // visibility.
   RSScript &script = static_cast<RSScript &>(pScript);
-  llvm::Module &module = script.getSource().getModule();
-  bcinfo::MetadataExtractor me(&module);
-  if (!me.extract()) {
+  const bcinfo::MetadataExtractor *metadata = script.getMetadata();
+  if (metadata == NULL) {
     bccAssert(false && "Could not extract metadata for module!");
     return false;
   }
+  const bcinfo::MetadataExtractor &me = *metadata;
 
   // The vector contains the symbols that should not be internalized.
   std::vector<const char *> export_symbols;
@@ -83,6 +83,27 @@ bool RSCompiler::addInternalizeSymbolsPass(Script &pScript, llvm::PassManager &p
       export_symbols.push_back(expanded_foreach_funcs[i].c_str());
   }
 
+  // The lazy binding hook is set by RSExecutable::Create().
+  if (script.getLazyBinding()) {
+    export_symbols.push_back(RSExecutable::LazyBindHookName);
+    export_symbols.push_back(RSExecutable::LazyBindContextName);
+    export_symbols.push_back(RSExecutable::LazyBindCountName);
+  }
+
+  // So are the execution counters read by RSExecutable.
+  if (script.getExecutionCounters()) {
+    export_symbols.push_back(RSExecutable::ExecutionCountersName);
+    export_symbols.push_back(RSExecutable::ExecutionCounterNamesName);
+  }
+
+  // And the access trace.
+  if (script.getAccessTrace()) {
+    export_symbols.push_back(RSExecutable::AccessTraceName);
+    export_symbols.push_back(RSExecutable::AccessTraceHeadName);
+    export_symbols.push_back(RSExecutable::AccessTraceSamplingName);
+    export_symbols.push_back(RSExecutable::AccessTraceSourcesName);
+  }
+
   pPM.add(llvm::createInternalizePass(export_symbols));
 
   return true;
@@ -92,11 +113,24 @@ bool RSCompiler::addExpandForEachPass(Script &pScript, llvm::PassManager &pPM) {
   // Script passed to RSCompiler must be a RSScript.
   RSScript &script = static_cast<RSScript &>(pScript);
 
+  // The RS passes share the metadata extracted here. None of them changes the
+  // named metadata of the module, so it stays valid until they are done.
+  const bcinfo::MetadataExtractor *metadata = script.getMetadata();
+  if (metadata == NULL) {
+    return false;
+  }
+
   // Expand ForEach on CPU path to reduce launch overhead.
   bool pEnableStepOpt = true;
-  pPM.add(createRSForEachExpandPass(pEnableStepOpt));
+  pPM.add(createRSForEachExpandPass(*metadata, pEnableStepOpt));
   if (script.getEmbedInfo())
-    pPM.add(createRSEmbedInfoPass());
+    pPM.add(createRSEmbedInfoPass(*metadata, script.getInfo()));
+  if (script.getLazyBinding())
+    pPM.add(createRSLazyBindPass());
+  if (script.getExecutionCounters())
+    pPM.add(createRSExecutionCountersPass(*metadata));
+  if (script.getAccessTrace())
+    pPM.add(createRSAccessTracePass(*metadata));
 
   return true;
 }
@@ -110,3 +144,12 @@ bool RSCompiler::beforeAddLTOPasses(Script &pScript, llvm::PassManager &pPM) {
 
   return true;
 }
+
+bool RSCompiler::beforeAddCodeGenPasses(Script &pScript,
+                                        llvm::PassManager &pPM) {
+  // Keep the number of sections, hence the allocations made by librsloader
+  // on load, down.
+  pPM.add(createRSSectionLayoutPass());
+
+  return true;
+}
@@ -25,6 +25,7 @@
 
 #include "bcc/Compiler.h"
 #include "bcc/Config/Config.h"
+#include "bcc/Renderscript/RSCacheIndex.h"
 #include "bcc/Renderscript/RSExecutable.h"
 #include "bcc/Renderscript/RSInfo.h"
 #include "bcc/Renderscript/RSScript.h"
@@ -34,15 +35,22 @@
 #include "bcc/Support/Log.h"
 #include "bcc/Support/InputFile.h"
 #include "bcc/Support/Initialization.h"
+#include "bcc/Support/LoadStats.h"
 #include "bcc/Support/Sha1Util.h"
 #include "bcc/Support/OutputFile.h"
 
 #ifdef HAVE_ANDROID_OS
 #include <cutils/properties.h>
 #endif
+#include <utils/FileMap.h>
 #include <utils/String8.h>
 #include <utils/StopWatch.h>
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+
 using namespace bcc;
 
 // Get the build fingerprint of the Android device we are running on.
@@ -58,7 +66,10 @@ static std::string getBuildFingerPrint() {
 
 RSCompilerDriver::RSCompilerDriver(bool pUseCompilerRT) :
     mConfig(NULL), mCompiler(), mDebugContext(false),
-    mLinkRuntimeCallback(NULL), mEnableGlobalMerge(true) {
+    mLinkRuntimeCallback(NULL), mLinkSharedObjectCallback(NULL),
+    mIsPICForced(false), mRelocModelBeforePIC(llvm::Reloc::Default),
+    mEnableGlobalMerge(true), mEnableLazyBinding(false),
+    mEnableExecutionCounters(false), mEnableAccessTrace(false) {
   init::Initialize();
 }
 
@@ -70,7 +81,18 @@ RSExecutable* RSCompilerDriver::loadScript(const char* pCacheDir, const char* pR
                                            const char* pBitcode, size_t pBitcodeSize,
                                            const char* expectedCompileCommandLine,
                                            SymbolResolverProxy& pResolver) {
+  return loadScriptImpl(pCacheDir, pResName, pBitcode, pBitcodeSize,
+                        expectedCompileCommandLine, pResolver);
+}
+
+RSExecutable* RSCompilerDriver::loadScriptImpl(const char* pCacheDir, const char* pResName,
+                                               const char* pBitcode, size_t pBitcodeSize,
+                                               const char* expectedCompileCommandLine,
+                                               SymbolResolverProxy& pResolver) {
   // android::StopWatch load_time("bcc: RSCompilerDriver::loadScript time");
+  LoadStats stats;
+  LoadStats::Timer timer;
+
   if ((pCacheDir == NULL) || (pResName == NULL)) {
     ALOGE("Missing pCacheDir and/or pResName");
     return NULL;
@@ -87,6 +109,20 @@ RSExecutable* RSCompilerDriver::loadScript(const char* pCacheDir, const char* pR
   llvm::sys::path::append(output_path, pResName);
   llvm::sys::path::replace_extension(output_path, ".o");
 
+  //===--------------------------------------------------------------------===//
+  // Compute what the cached object has to be compiled from.
+  //===--------------------------------------------------------------------===//
+  timer.restart();
+  uint8_t expectedSourceHash[SHA1_DIGEST_LENGTH];
+  Sha1Util::GetSHA1DigestFromBuffer(expectedSourceHash, pBitcode, pBitcodeSize);
+  stats.addTime(LoadStats::kSHA1Phase, timer);
+
+  std::string expectedBuildFingerprint = getBuildFingerPrint();
+  uint8_t expectedDependencyHash[SHA1_DIGEST_LENGTH];
+  RSCacheIndex::GetDependencyDigest(expectedDependencyHash,
+                                    expectedCompileCommandLine,
+                                    expectedBuildFingerprint.c_str());
+
   //===--------------------------------------------------------------------===//
   // Acquire the read lock for reading the Script object file.
   //===--------------------------------------------------------------------===//
@@ -97,6 +133,24 @@ RSExecutable* RSCompilerDriver::loadScript(const char* pCacheDir, const char* pR
           read_output_mutex.getErrorMessage().c_str());
     return NULL;
   }
+  stats.addTime(LoadStats::kLockPhase, timer);
+
+  //===--------------------------------------------------------------------===//
+  // Look up the index of the cache directory.
+  //===--------------------------------------------------------------------===//
+  // This is done under the read lock so that the object can't be replaced
+  // between the lookup and the load. The RS info of an object found up to
+  // date in the index is read from the index, unless the object has been
+  // replaced since it was published. Otherwise the RS info file decides: the
+  // index may predate the object or have missed its update.
+  RSCacheIndex *index = RSCacheIndex::Open(pCacheDir);
+  if ((index != NULL) &&
+      (index->lookup(output_path.c_str(), expectedSourceHash,
+                     expectedDependencyHash) != RSCacheIndex::kUpToDate)) {
+    delete index;
+    index = NULL;
+  }
+  stats.addTime(LoadStats::kInfoParsePhase, timer);
 
   //===--------------------------------------------------------------------===//
   // Read the output object file.
@@ -107,60 +161,74 @@ RSExecutable* RSCompilerDriver::loadScript(const char* pCacheDir, const char* pR
       //      ALOGE("Unable to open the %s for read! (%s)", output_path.c_str(),
       //            object_file->getErrorMessage().c_str());
     delete object_file;
+    delete index;
     return NULL;
   }
+  stats.addTime(LoadStats::kFileIOPhase, timer);
 
-  //===--------------------------------------------------------------------===//
-  // Acquire the read lock on object_file for reading its RS info file.
-  //===--------------------------------------------------------------------===//
-  android::String8 info_path = RSInfo::GetPath(output_path.c_str());
-
-  if (!object_file->lock()) {
-    ALOGE("Unable to acquire the read lock on %s for reading %s! (%s)",
-          output_path.c_str(), info_path.string(),
-          object_file->getErrorMessage().c_str());
-    delete object_file;
-    return NULL;
+  RSInfo *info = NULL;
+  if (index != NULL) {
+    if (index->isPublished(*object_file)) {
+      info = index->readInfo(output_path.c_str());
+    }
+    delete index;
+    stats.addTime(LoadStats::kInfoParsePhase, timer);
   }
 
-  //===---------------------------------------------------------------------===//
-  // Open and load the RS info file.
-  //===--------------------------------------------------------------------===//
-  InputFile info_file(info_path.string());
-  RSInfo *info = RSInfo::ReadFromFile(info_file);
+  if (info == NULL) {
+    //===------------------------------------------------------------------===//
+    // Acquire the read lock on object_file for reading its RS info file.
+    //===------------------------------------------------------------------===//
+    android::String8 info_path = RSInfo::GetPath(output_path.c_str());
 
-  // Release the lock on object_file.
-  object_file->unlock();
+    if (!object_file->lock()) {
+      ALOGE("Unable to acquire the read lock on %s for reading %s! (%s)",
+            output_path.c_str(), info_path.string(),
+            object_file->getErrorMessage().c_str());
+      delete object_file;
+      return NULL;
+    }
+    stats.addTime(LoadStats::kLockPhase, timer);
 
-  if (info == NULL) {
-    delete object_file;
-    return NULL;
-  }
+    //===------------------------------------------------------------------===//
+    // Open and load the RS info file.
+    //===------------------------------------------------------------------===//
+    InputFile info_file(info_path.string());
+    info = RSInfo::ReadFromFile(info_file);
 
-  //===---------------------------------------------------------------------===//
-  // Check that the info in the RS info file is consistent we what we want.
-  //===--------------------------------------------------------------------===//
+    // Release the lock on object_file.
+    object_file->unlock();
+    stats.addTime(LoadStats::kInfoParsePhase, timer);
 
-  uint8_t expectedSourceHash[SHA1_DIGEST_LENGTH];
-  Sha1Util::GetSHA1DigestFromBuffer(expectedSourceHash, pBitcode, pBitcodeSize);
+    if (info == NULL) {
+      delete object_file;
+      return NULL;
+    }
 
-  std::string expectedBuildFingerprint = getBuildFingerPrint();
+    //===------------------------------------------------------------------===//
+    // Check that the info in the RS info file is consistent we what we want.
+    //===------------------------------------------------------------------===//
 
-  // If the info file contains different hash for the source than what we are
-  // looking for, bail.  Do the same if the command line used when compiling or the
-  // build fingerprint of Android has changed.  The compiled code found on disk is
-  // out of date and needs to be recompiled first.
-  if (!info->IsConsistent(output_path.c_str(), expectedSourceHash, expectedCompileCommandLine,
-                          expectedBuildFingerprint.c_str())) {
+    // If the info file contains different hash for the source than what we
+    // are looking for, bail.  Do the same if the command line used when
+    // compiling or the build fingerprint of Android has changed.  The compiled
+    // code found on disk is out of date and needs to be recompiled first.
+    if (!info->IsConsistent(output_path.c_str(), expectedSourceHash,
+                            expectedCompileCommandLine,
+                            expectedBuildFingerprint.c_str())) {
       delete object_file;
       delete info;
       return NULL;
+    }
   }
 
   //===--------------------------------------------------------------------===//
   // Create the RSExecutable.
   //===--------------------------------------------------------------------===//
-  RSExecutable *executable = RSExecutable::Create(*info, *object_file, pResolver);
+  // The symbol resolvers are not thread-safe. Create() serializes the uses of
+  // them with the other loads and the lazy binds in the process.
+  RSExecutable *executable = RSExecutable::Create(*info, *object_file, pResolver,
+                                                  &stats);
   if (executable == NULL) {
     delete object_file;
     delete info;
@@ -202,6 +270,21 @@ bool RSCompilerDriver::setupConfig(const RSScript &pScript) {
     changed = true;
   }
 
+  // Shared objects require position-independent code. Once the shared object
+  // mode is turned off, put back the relocation model PIC replaced, which
+  // librsloader can handle. A config set to PIC by the user is left as is.
+  if ((mLinkSharedObjectCallback != NULL) &&
+      (mConfig->getRelocationModel() != llvm::Reloc::PIC_)) {
+    mRelocModelBeforePIC = mConfig->getRelocationModel();
+    mIsPICForced = true;
+    mConfig->setRelocationModel(llvm::Reloc::PIC_);
+    changed = true;
+  } else if ((mLinkSharedObjectCallback == NULL) && mIsPICForced) {
+    mConfig->setRelocationModel(mRelocModelBeforePIC);
+    mIsPICForced = false;
+    changed = true;
+  }
+
 #if defined(PROVIDE_ARM_CODEGEN)
   assert((pScript.getInfo() != NULL) && "NULL RS info!");
   bool script_full_prec = (pScript.getInfo()->getFloatPrecisionRequirement() ==
@@ -266,12 +349,19 @@ Compiler::ErrorCode RSCompilerDriver::compileScript(RSScript& pScript, const cha
     }
 #endif
 
+    // In the shared object mode, the compiler output is an intermediate object
+    // which is linked into pOutputPath afterwards.
+    android::String8 object_path(pOutputPath);
+    if (mLinkSharedObjectCallback != NULL) {
+      object_path.append(".pic.o");
+    }
+
     // Open the output file for write.
-    OutputFile output_file(pOutputPath,
+    OutputFile output_file(object_path.string(),
                            FileBase::kTruncate | FileBase::kBinary);
 
     if (output_file.hasError()) {
-        ALOGE("Unable to open %s for write! (%s)", pOutputPath,
+        ALOGE("Unable to open %s for write! (%s)", object_path.string(),
               output_file.getErrorMessage().c_str());
       return Compiler::kErrInvalidSource;
     }
@@ -317,18 +407,56 @@ Compiler::ErrorCode RSCompilerDriver::compileScript(RSScript& pScript, const cha
             Compiler::GetErrorString(compile_result));
       return Compiler::kErrInvalidSource;
     }
+
+    if (mLinkSharedObjectCallback != NULL) {
+      // The shared object at pOutputPath may be mapped by the dynamic loader
+      // in this or another process. Link to a new file and rename it over
+      // pOutputPath so that the mappings keep the old contents.
+      output_file.close();
+      std::string so_path = OutputFile::CreateTemporary(pOutputPath);
+      bool linked = !so_path.empty() &&
+                    mLinkSharedObjectCallback(object_path.string(),
+                                              so_path.c_str());
+      ::unlink(object_path.string());
+      if (!linked) {
+        ALOGE("Unable to link %s into shared object %s!", object_path.string(),
+              pOutputPath);
+        if (!so_path.empty()) {
+          ::unlink(so_path.c_str());
+        }
+        return Compiler::kErrInvalidSource;
+      }
+      if (::rename(so_path.c_str(), pOutputPath) != 0) {
+        ALOGE("Failed to rename %s to %s! (%s)", so_path.c_str(), pOutputPath,
+              ::strerror(errno));
+        ::unlink(so_path.c_str());
+        return Compiler::kErrInvalidSource;
+      }
+    }
   }
 
   if (saveInfoFile) {
-    android::String8 info_path = RSInfo::GetPath(pOutputPath);
-    OutputFile info_file(info_path.string(), FileBase::kTruncate);
-
-    if (info_file.hasError()) {
-      ALOGE("Failed to open the info file %s for write! (%s)",
-            info_path.string(), info_file.getErrorMessage().c_str());
-      return Compiler::kErrInvalidSource;
+    // Record where the exported symbols are in the object so that loading it
+    // doesn't need to search the symbol table for them. This is only an
+    // optimization and failure doesn't fail the compilation.
+    InputFile object_file(pOutputPath);
+    size_t object_size = object_file.getSize();
+    android::FileMap *object_map = NULL;
+    if (!object_file.hasError() && (object_size > 0)) {
+      object_map = object_file.createMap(0, object_size,
+                                         /* pIsReadOnly */true);
+    }
+    if ((object_map == NULL) ||
+        !info->recordExportSymbols(object_map->getDataPtr(), object_size)) {
+      ALOGW("Failed to record the locations of RS export symbols in %s!",
+            pOutputPath);
+    }
+    if (object_map != NULL) {
+      object_map->release();
     }
 
+    android::String8 info_path = RSInfo::GetPath(pOutputPath);
+
     FileMutex<FileBase::kWriteLock> write_info_mutex(info_path.string());
     if (write_info_mutex.hasError() || !write_info_mutex.lock()) {
       ALOGE("Unable to acquire the lock for writing %s! (%s)",
@@ -336,11 +464,23 @@ Compiler::ErrorCode RSCompilerDriver::compileScript(RSScript& pScript, const cha
       return Compiler::kErrInvalidSource;
     }
 
-    // Perform the write.
-    if (!info->write(info_file)) {
+    // Perform the write. The file is replaced rather than truncated since the
+    // scripts loaded from it have it mapped.
+    if (!info->writeToFile(info_path.string())) {
       ALOGE("Failed to sync the RS info file %s!", info_path.string());
       return Compiler::kErrInvalidSource;
     }
+
+    // Publish the script in the index of the cache directory. Without it,
+    // loadScript() validates the script against its RS info file instead.
+    uint8_t dependency_hash[SHA1_DIGEST_LENGTH];
+    RSCacheIndex::GetDependencyDigest(dependency_hash,
+                                      compileCommandLineToEmbed,
+                                      getBuildFingerPrint().c_str());
+    if (!RSCacheIndex::Update(pOutputPath, *info, pSourceHash,
+                              dependency_hash)) {
+      ALOGW("Failed to update the cache index for %s!", pOutputPath);
+    }
   }
 
   return Compiler::kSuccess;
@@ -401,6 +541,9 @@ bool RSCompilerDriver::build(BCCContext &pContext,
   }
 
   script.setLinkRuntimeCallback(getLinkRuntimeCallback());
+  script.setLazyBinding(mEnableLazyBinding);
+  script.setExecutionCounters(mEnableExecutionCounters);
+  script.setAccessTrace(mEnableAccessTrace);
 
   // Read information from bitcode wrapper.
   bcinfo::BitcodeWrapper wrapper(pBitcode, pBitcodeSize);
@@ -30,6 +30,7 @@
 #include <llvm/IR/Type.h>
 
 #include "bcc/Config/Config.h"
+#include "bcc/Renderscript/RSInfo.h"
 #include "bcc/Support/Log.h"
 #include "bcinfo/MetadataExtractor.h"
 
@@ -43,6 +44,13 @@ namespace {
  * because the standalone compiler + compatibility driver or system driver
  * will be using the same format (i.e. bcc_compat + libRSSupport.so or
  * bcc + libRSCpuRef are always paired together for installation).
+ *
+ * Given the RSInfo of the script, the pass also embeds it in the format of
+ * the RS info file as .rs.info.bin, with its size in .rs.info.bin.size. The
+ * offsets in it are relative to its beginning, so the runtime can read it in
+ * place with RSInfo::ReadFromBuffer() instead of parsing .rs.info. The text
+ * is still embedded for the runtimes that don't know the binary info or that
+ * reject its version.
  */
 class RSEmbedInfoPass : public llvm::ModulePass {
 private:
@@ -51,20 +59,47 @@ private:
   llvm::Module *M;
   llvm::LLVMContext *C;
 
+  // The metadata of the module, shared with the other RS passes.
+  const bcinfo::MetadataExtractor &mMetadata;
+
+  // NULL if only the text is embedded.
+  const RSInfo *mInfo;
+
+  void embedBinaryInfo() {
+    std::string Data;
+    if (!mInfo->write(Data)) {
+      ALOGW("Failed to encode the RS info of %s! Only the text is embedded.",
+            M->getModuleIdentifier().c_str());
+      return;
+    }
+
+    llvm::Constant *Init =
+        llvm::ConstantDataArray::getString(*C, Data, /* AddNull */false);
+    llvm::GlobalVariable *InfoGV =
+        new llvm::GlobalVariable(*M, Init->getType(), true,
+                                 llvm::GlobalValue::ExternalLinkage, Init,
+                                 ".rs.info.bin");
+    // The lists in the info are aligned relative to its beginning (see
+    // RSInfo::layout()), so aligning the beginning aligns the items.
+    InfoGV->setAlignment(RSINFO_LIST_ALIGNMENT);
+
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+    new llvm::GlobalVariable(*M, Int32Ty, true,
+                             llvm::GlobalValue::ExternalLinkage,
+                             llvm::ConstantInt::get(Int32Ty, Data.size()),
+                             ".rs.info.bin.size");
+  }
+
 public:
-  RSEmbedInfoPass()
+  RSEmbedInfoPass(const bcinfo::MetadataExtractor &pMetadata,
+                  const RSInfo *pInfo)
       : ModulePass(ID),
-        M(NULL) {
+        M(NULL), mMetadata(pMetadata), mInfo(pInfo) {
   }
 
-  static std::string getRSInfoString(const llvm::Module *module) {
+  static std::string getRSInfoString(const bcinfo::MetadataExtractor &me) {
     std::string str;
     llvm::raw_string_ostream s(str);
-    bcinfo::MetadataExtractor me(module);
-    if (!me.extract()) {
-      bccAssert(false && "Could not extract RS metadata for module!");
-      return std::string("");
-    }
 
     size_t exportVarCount = me.getExportVarCount();
     size_t exportFuncCount = me.getExportFuncCount();
@@ -117,13 +152,17 @@ public:
     // Embed this as the global variable .rs.info so that it will be
     // accessible from the shared object later.
     llvm::Constant *Init = llvm::ConstantDataArray::getString(*C,
-                                                              getRSInfoString(&M));
+                                                              getRSInfoString(mMetadata));
     llvm::GlobalVariable *InfoGV =
         new llvm::GlobalVariable(M, Init->getType(), true,
                                  llvm::GlobalValue::ExternalLinkage, Init,
                                  ".rs.info");
     (void) InfoGV;
 
+    if (mInfo != NULL) {
+      embedBinaryInfo();
+    }
+
     return true;
   }
 
@@ -140,8 +179,9 @@ char RSEmbedInfoPass::ID = 0;
 namespace bcc {
 
 llvm::ModulePass *
-createRSEmbedInfoPass() {
-  return new RSEmbedInfoPass();
+createRSEmbedInfoPass(const bcinfo::MetadataExtractor &pMetadata,
+                      const RSInfo *pInfo) {
+  return new RSEmbedInfoPass(pMetadata, pInfo);
 }
 
 }  // end namespace bcc
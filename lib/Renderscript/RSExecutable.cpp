@@ -16,11 +16,19 @@
 
 #include "bcc/Renderscript/RSExecutable.h"
 
+#include <pthread.h>
+
+#include <cstring>
+
 #include "bcc/Config/Config.h"
+#include "bcc/Renderscript/RSAccessTrace.h"
+#include "bcc/Renderscript/RSCacheIndex.h"
+#include "bcc/Renderscript/RSExecutionCounters.h"
 #include "bcc/Support/Disassembler.h"
 #include "bcc/Support/FileBase.h"
 #include "bcc/Support/Log.h"
 #include "bcc/Support/OutputFile.h"
+#include "bcc/ExecutionEngine/RelocationCache.h"
 #include "bcc/ExecutionEngine/SymbolResolverProxy.h"
 
 #include <utils/String8.h>
@@ -32,21 +40,120 @@ const char *RSExecutable::SpecialFunctionNames[] = {
   "init",      // Initialization routine called implicitly on startup.
   ".rs.dtor",  // Static global destructor for a script instance.
   ".rs.info",  // Variable containing string of RS metadata info.
+  ".rs.info.bin",  // Same as .rs.info in the RS info file format.
+  ".rs.info.bin.size",  // Size of .rs.info.bin.
   NULL         // Must be NULL-terminated.
 };
 
+const char RSExecutable::LazyBindHookName[] = ".rs.lazy.hook";
+const char RSExecutable::LazyBindContextName[] = ".rs.lazy.context";
+const char RSExecutable::LazyBindCountName[] = ".rs.lazy.count";
+
+const char RSExecutable::ExecutionCountersName[] = ".rs.counters";
+const char RSExecutable::ExecutionCounterNamesName[] = ".rs.counters.names";
+
+const char RSExecutable::AccessTraceName[] = ".rs.trace";
+const char RSExecutable::AccessTraceHeadName[] = ".rs.trace.head";
+const char RSExecutable::AccessTraceSamplingName[] = ".rs.trace.sampling";
+const char RSExecutable::AccessTraceSourcesName[] = ".rs.trace.sources";
+
+namespace {
+
+// The resolvers are not thread-safe, and the same ones are shared by all the
+// executables of the process. Every use of them takes this lock: the
+// relocations done by Create(), whichever thread loads the script, and the
+// lazy binds done by LazyBind() for the stubs of all the executables.
+pthread_mutex_t gResolverLock = PTHREAD_MUTEX_INITIALIZER;
+
+// Return the address of the pIdx-th symbol in RSInfo::getExportSymbols()
+// computed from its recorded location, or NULL if the location is unknown.
+void *GetExportSymbolAddress(const ObjectLoader &pLoader, const RSInfo &pInfo,
+                             unsigned pIdx) {
+  const RSInfo::ExportSymbolListTy &export_symbols = pInfo.getExportSymbols();
+  if ((pIdx >= export_symbols.size()) ||
+      (export_symbols[pIdx].section == rsinfo::gInvalidSectionIndex)) {
+    return NULL;
+  }
+
+  uint8_t *section_addr = reinterpret_cast<uint8_t *>(
+      pLoader.getSectionAddress(export_symbols[pIdx].section));
+  if (section_addr == NULL) {
+    return NULL;
+  }
+
+  return section_addr + export_symbols[pIdx].offset;
+}
+
+// Cross-check the address computed by GetExportSymbolAddress() against the
+// one found by name. Only enabled in debug build.
+inline void CheckExportSymbolAddress(const ObjectLoader &pLoader,
+                                     const char *pName, void *pAddr) {
+#if !LOG_NDEBUG
+  void *addr_by_name = pLoader.getSymbolAddress(pName);
+  if (addr_by_name != pAddr) {
+    ALOGE("Mismatched address of RS export symbol %s! (recorded: %p, by name: "
+          "%p)", pName, pAddr, addr_by_name);
+  }
+#endif
+}
+
+} // end anonymous namespace
+
 RSExecutable *RSExecutable::Create(RSInfo &pInfo,
                                    FileBase &pObjFile,
-                                   SymbolResolverProxy &pResolver) {
+                                   SymbolResolverProxy &pResolver,
+                                   const LoadStats *pPreloadStats) {
+  LoadStats stats;
+  if (pPreloadStats != NULL) {
+    stats = *pPreloadStats;
+  }
+
+  // Reuse the symbol addresses resolved by the previous load of the same
+  // object if the runtime libraries are still where they were. Validating
+  // the cache takes a few lookups.
+  LoadStats::Timer timer;
+  android::String8 reloc_cache_path =
+      RelocationCache::GetPath(pObjFile.getName().c_str());
+  RelocationCache reloc_cache(pResolver);
+  pthread_mutex_lock(&gResolverLock);
+  reloc_cache.readFromFile(reloc_cache_path.string());
+  pthread_mutex_unlock(&gResolverLock);
+  stats.addTime(LoadStats::kSymbolLookupPhase, timer);
+
   // Load the object file. Enable the GDB's JIT debugging if the script contains
   // debug information.
   ObjectLoader *loader = ObjectLoader::Load(pObjFile,
-                                            pResolver,
-                                            pInfo.hasDebugInformation());
+                                            reloc_cache,
+                                            pInfo.hasDebugInformation(),
+                                            &stats,
+                                            &gResolverLock);
   if (loader == NULL) {
     return NULL;
   }
 
+  // Failure to update the cache only costs the next load a full resolution.
+  if (reloc_cache.isDirty()) {
+    reloc_cache.writeToFile(reloc_cache_path.string());
+  }
+
+  // Check the variables for lazy binding if the script was compiled with it.
+  void **lazy_hook =
+      reinterpret_cast<void **>(loader->getSymbolAddress(LazyBindHookName));
+  void **lazy_context = NULL;
+  const unsigned *lazy_count = NULL;
+  if (lazy_hook != NULL) {
+    lazy_context =
+        reinterpret_cast<void **>(loader->getSymbolAddress(LazyBindContextName));
+    lazy_count = reinterpret_cast<const unsigned *>(
+        loader->getSymbolAddress(LazyBindCountName));
+    if ((lazy_context == NULL) || (lazy_count == NULL)) {
+      ALOGE("Incomplete lazy binding information in %s!",
+            pObjFile.getName().c_str());
+      delete loader;
+      return NULL;
+    }
+  }
+
   // Now, all things required to build a RSExecutable object are ready.
   RSExecutable *result = new (std::nothrow) RSExecutable(pInfo,
                                                          pObjFile,
@@ -57,17 +164,48 @@ RSExecutable *RSExecutable::Create(RSInfo &pInfo,
     return NULL;
   }
 
+  stats.setLoaded();
+  result->mLoadStats = stats;
+  LoadStats::AddToProcessTotal(stats);
+  stats.dump(pObjFile.getName().c_str());
+
+  // Install the hook for the stubs if the runtime functions are bound lazily.
+  // Writing the variables directly is fine since no code in the script has
+  // run yet.
+  if (lazy_hook != NULL) {
+    result->mLazyResolver = &pResolver;
+    result->mNumLazyImports = *lazy_count;
+    *lazy_hook = reinterpret_cast<void *>(&RSExecutable::LazyBind);
+    *lazy_context = result;
+  }
+
+  // The counters are only for diagnosis. Don't fail the load on them.
+  if (!result->initExecutionCounters()) {
+    ALOGW("Execution counters in %s are ignored!", pObjFile.getName().c_str());
+  }
+  if (!result->initAccessTrace()) {
+    ALOGW("Access trace in %s is ignored!", pObjFile.getName().c_str());
+  }
+
   unsigned idx;
+  // Index into pInfo.getExportSymbols(). It lists the locations of the vars,
+  // the funcs and the expanded foreach funcs in order. The locations are
+  // unavailable if the object was not compiled with them recorded (e.g., it's
+  // a shared object.) Fall back to look up the symbols by name in that case.
+  unsigned symbol_idx = 0;
+
   // Resolve addresses of RS export vars.
   idx = 0;
   const RSInfo::ExportVarNameListTy &export_var_names =
       pInfo.getExportVarNames();
-  for (RSInfo::ExportVarNameListTy::const_iterator
-           var_iter = export_var_names.begin(),
-           var_end = export_var_names.end(); var_iter != var_end;
-       var_iter++, idx++) {
-    const char *name = *var_iter;
-    void *addr = result->getSymbolAddress(name);
+  for (; idx < export_var_names.size(); idx++) {
+    const char *name = pInfo.getString(export_var_names[idx].name);
+    void *addr = GetExportSymbolAddress(*loader, pInfo, symbol_idx++);
+    if (addr != NULL) {
+      CheckExportSymbolAddress(*loader, name, addr);
+    } else {
+      addr = result->getSymbolAddress(name);
+    }
     if (addr == NULL) {
         //ALOGW("RS export var at entry #%u named %s cannot be found in the result "
         //"object!", idx, name);
@@ -79,12 +217,14 @@ RSExecutable *RSExecutable::Create(RSInfo &pInfo,
   idx = 0;
   const RSInfo::ExportFuncNameListTy &export_func_names =
       pInfo.getExportFuncNames();
-  for (RSInfo::ExportFuncNameListTy::const_iterator
-           func_iter = export_func_names.begin(),
-           func_end = export_func_names.end(); func_iter != func_end;
-       func_iter++, idx++) {
-    const char *name = *func_iter;
-    void *addr = result->getSymbolAddress(name);
+  for (; idx < export_func_names.size(); idx++) {
+    const char *name = pInfo.getString(export_func_names[idx].name);
+    void *addr = GetExportSymbolAddress(*loader, pInfo, symbol_idx++);
+    if (addr != NULL) {
+      CheckExportSymbolAddress(*loader, name, addr);
+    } else {
+      addr = result->getSymbolAddress(name);
+    }
     if (addr == NULL) {
         //      ALOGW("RS export func at entry #%u named %s cannot be found in the result"
         //" object!", idx, name);
@@ -96,14 +236,21 @@ RSExecutable *RSExecutable::Create(RSInfo &pInfo,
   idx = 0;
   const RSInfo::ExportForeachFuncListTy &export_foreach_funcs =
       pInfo.getExportForeachFuncs();
-  for (RSInfo::ExportForeachFuncListTy::const_iterator
-           foreach_iter = export_foreach_funcs.begin(),
-           foreach_end = export_foreach_funcs.end();
-       foreach_iter != foreach_end; foreach_iter++, idx++) {
-    const char *func_name = foreach_iter->first;
-    android::String8 expanded_func_name(func_name);
-    expanded_func_name.append(".expand");
-    void *addr = result->getSymbolAddress(expanded_func_name.string());
+  for (; idx < export_foreach_funcs.size(); idx++) {
+    const char *name = pInfo.getString(export_foreach_funcs[idx].name);
+    void *addr = GetExportSymbolAddress(*loader, pInfo, symbol_idx++);
+#if !LOG_NDEBUG
+    if (addr != NULL) {
+      android::String8 expanded_func_name(name);
+      expanded_func_name.append(".expand");
+      CheckExportSymbolAddress(*loader, expanded_func_name.string(), addr);
+    }
+#endif
+    if (addr == NULL) {
+      android::String8 expanded_func_name(name);
+      expanded_func_name.append(".expand");
+      addr = result->getSymbolAddress(expanded_func_name.string());
+    }
     if (addr == NULL) {
         //      ALOGW("Expanded RS foreach at entry #%u named %s cannot be found in the "
         //            "result object!", idx, expanded_func_name.string());
@@ -114,46 +261,263 @@ RSExecutable *RSExecutable::Create(RSInfo &pInfo,
   // Copy pragma key/value pairs from RSInfo::getPragmas() into mPragmaKeys and
   // mPragmaValues, respectively.
   const RSInfo::PragmaListTy &pragmas = pInfo.getPragmas();
-  for (RSInfo::PragmaListTy::const_iterator pragma_iter = pragmas.begin(),
-          pragma_end = pragmas.end(); pragma_iter != pragma_end;
-       pragma_iter++){
-    result->mPragmaKeys.push_back(pragma_iter->first);
-    result->mPragmaValues.push_back(pragma_iter->second);
+  for (size_t i = 0; i < pragmas.size(); i++) {
+    result->mPragmaKeys.push_back(pInfo.getString(pragmas[i].key));
+    result->mPragmaValues.push_back(pInfo.getString(pragmas[i].value));
   }
 
   return result;
 }
 
-bool RSExecutable::syncInfo(bool pForce) {
-  if (!pForce && !mIsInfoDirty) {
+void *RSExecutable::getSymbolAddress(const char *pName) const {
+  if (!mIsCompacted) {
+    return mLoader->getSymbolAddress(pName);
+  }
+
+  for (size_t i = 0, e = mRetainedSymbolNames.size(); i != e; i++) {
+    if (::strcmp(mRetainedSymbolNames[i].string(), pName) == 0) {
+      return mRetainedSymbolAddrs[i];
+    }
+  }
+
+  ALOGW("Symbol '%s' in %s is unavailable after compaction!", pName,
+        mObjFile->getName().c_str());
+  return NULL;
+}
+
+void RSExecutable::compact() {
+  if (mIsCompacted || mInfo->hasDebugInformation()) {
+    return;
+  }
+
+  for (const char **special_function = SpecialFunctionNames;
+       *special_function != NULL; special_function++) {
+    android::String8 names[2];
+    names[0] = *special_function;
+    names[1] = *special_function;
+    names[1].append(".expand");
+
+    for (unsigned i = 0; i < 2; i++) {
+      void *addr = mLoader->getSymbolAddress(names[i].string());
+      if (addr != NULL) {
+        mRetainedSymbolNames.push_back(names[i]);
+        mRetainedSymbolAddrs.push_back(addr);
+      }
+    }
+  }
+
+  mLoader->compact();
+  mIsCompacted = true;
+  return;
+}
+
+void *RSExecutable::LazyBind(void *pContext, const char *pName) {
+  RSExecutable *executable = reinterpret_cast<RSExecutable *>(pContext);
+
+  pthread_mutex_lock(&gResolverLock);
+  void *addr = executable->mLazyResolver->getAddress(pName);
+  if (addr != NULL) {
+    android::String8 name(pName);
+    if (executable->mLazyResolvedNames.indexOf(name) < 0) {
+      executable->mLazyResolvedNames.add(name);
+      executable->mNumLazyResolved++;
+    }
+  }
+  pthread_mutex_unlock(&gResolverLock);
+
+  if (addr == NULL) {
+    // There's no way to report the failure to the caller of the stub.
+    LOG_ALWAYS_FATAL("Failed to lazily resolve %s required by %s!", pName,
+                     executable->mObjFile->getName().c_str());
+  }
+
+  return addr;
+}
+
+bool RSExecutable::initExecutionCounters() {
+  const char *names = reinterpret_cast<const char *>(
+      mLoader->getSymbolAddress(ExecutionCounterNamesName));
+  if (names == NULL) {
     return true;
   }
 
-  android::String8 info_path = RSInfo::GetPath(mObjFile->getName().c_str());
-  OutputFile info_file(info_path.string(), FileBase::kTruncate);
+  const volatile uint32_t *counters = reinterpret_cast<const volatile uint32_t *>(
+      mLoader->getSymbolAddress(ExecutionCountersName));
+  size_t num_counters = mLoader->getSymbolSize(ExecutionCountersName) /
+                        sizeof(uint32_t);
+  size_t names_size = mLoader->getSymbolSize(ExecutionCounterNamesName);
+  if ((counters == NULL) || (names_size == 0) ||
+      (names[names_size - 1] != '\0')) {
+    return false;
+  }
+
+  android::Vector<const char *> counter_names;
+  for (size_t offset = 0; offset < names_size;
+       offset += ::strlen(names + offset) + 1) {
+    counter_names.push_back(names + offset);
+  }
+  if (counter_names.size() != num_counters) {
+    return false;
+  }
+
+  mCounters = counters;
+  mCounterNames = counter_names;
+  mSyncedCounters.insertAt(0, 0, num_counters);
+  return true;
+}
+
+bool RSExecutable::syncExecutionCounters() {
+  if (mCounterNames.isEmpty()) {
+    return true;
+  }
+
+  RSExecutionCounters counts;
+  for (size_t i = 0; i < mCounterNames.size(); i++) {
+    // The counters in the object may have wrapped around since the last
+    // sync. The difference is still right if they did at most once.
+    uint32_t value = mCounters[i];
+    counts.add(mCounterNames[i],
+               static_cast<uint32_t>(value - mSyncedCounters[i]));
+    mSyncedCounters.editItemAt(i) = value;
+  }
+
+  android::String8 counters_path =
+      RSExecutionCounters::GetPath(mObjFile->getName().c_str());
 
-  if (info_file.hasError()) {
-    ALOGE("Failed to open the info file %s for write! (%s)", info_path.string(),
-          info_file.getErrorMessage().c_str());
+  // Other processes running the same script update the file, too.
+  if (!mObjFile->lock(FileBase::kWriteLock)) {
+    ALOGE("Write to execution counters %s required the acquisition of the "
+          "write lock on %s but got failure!", counters_path.string(),
+          mObjFile->getName().c_str());
     return false;
   }
 
+  // Start over if the counters in the file are from a previous build of the
+  // script.
+  RSExecutionCounters file_counts;
+  if (file_counts.readFromFile(counters_path.string())) {
+    counts.accumulate(file_counts);
+  }
+
+  bool result = counts.writeToFile(counters_path.string());
+  mObjFile->unlock();
+  return result;
+}
+
+bool RSExecutable::initAccessTrace() {
+  const char *sources = reinterpret_cast<const char *>(
+      mLoader->getSymbolAddress(AccessTraceSourcesName));
+  if (sources == NULL) {
+    return true;
+  }
+
+  const rstrace::Record *trace = reinterpret_cast<const rstrace::Record *>(
+      mLoader->getSymbolAddress(AccessTraceName));
+  const volatile uint32_t *head = reinterpret_cast<const volatile uint32_t *>(
+      mLoader->getSymbolAddress(AccessTraceHeadName));
+  uint32_t *sampling = reinterpret_cast<uint32_t *>(
+      mLoader->getSymbolAddress(AccessTraceSamplingName));
+  size_t sources_size = mLoader->getSymbolSize(AccessTraceSourcesName);
+  if ((trace == NULL) || (head == NULL) || (sampling == NULL) ||
+      (mLoader->getSymbolSize(AccessTraceName) !=
+          (RSTRACE_RING_SIZE * sizeof(rstrace::Record))) ||
+      (sources_size == 0) || (sources[sources_size - 1] != '\0')) {
+    return false;
+  }
+
+  for (size_t offset = 0; offset < sources_size;
+       offset += ::strlen(sources + offset) + 1) {
+    mAccessTraceSources.push_back(sources + offset);
+  }
+
+  mAccessTrace = trace;
+  mAccessTraceHead = head;
+  mAccessTraceSampling = sampling;
+  return true;
+}
+
+void RSExecutable::setAccessTraceSampling(uint32_t pMask, uint32_t pBurst) {
+  if (mAccessTraceSampling != NULL) {
+    mAccessTraceSampling[0] = pMask;
+    mAccessTraceSampling[1] = pBurst;
+  }
+  return;
+}
+
+bool RSExecutable::syncAccessTrace() {
+  if ((mAccessTrace == NULL) || (*mAccessTraceHead == 0)) {
+    return true;
+  }
+
+  RSAccessTrace trace;
+  for (size_t i = 0; i < mAccessTraceSources.size(); i++) {
+    trace.addSource(mAccessTraceSources[i]);
+  }
+
+  // The ring buffer has wrapped around if more samples than it holds were
+  // taken. The oldest one is at the head then.
+  uint32_t head = *mAccessTraceHead;
+  uint32_t num_samples = head;
+  uint32_t first = 0;
+  if (head > RSTRACE_RING_SIZE) {
+    num_samples = RSTRACE_RING_SIZE;
+    first = head & (RSTRACE_RING_SIZE - 1);
+  }
+  for (uint32_t i = 0; i < num_samples; i++) {
+    const rstrace::Record &record =
+        mAccessTrace[(first + i) & (RSTRACE_RING_SIZE - 1)];
+    if (record.source < mAccessTraceSources.size()) {
+      trace.add(record);
+    }
+  }
+
+  android::String8 trace_path =
+      RSAccessTrace::GetPath(mObjFile->getName().c_str());
+
+  // The trace of the last run replaces the one of the run before.
+  if (!mObjFile->lock(FileBase::kWriteLock)) {
+    ALOGE("Write to access trace %s required the acquisition of the write "
+          "lock on %s but got failure!", trace_path.string(),
+          mObjFile->getName().c_str());
+    return false;
+  }
+
+  bool result = trace.writeToFile(trace_path.string());
+  mObjFile->unlock();
+  return result;
+}
+
+bool RSExecutable::syncInfo(bool pForce) {
+  if (!pForce && !mIsInfoDirty) {
+    return true;
+  }
+
+  android::String8 info_path = RSInfo::GetPath(mObjFile->getName().c_str());
+
   // Operation to the RS info file need to acquire the lock on the output file
   // first.
   if (!mObjFile->lock(FileBase::kWriteLock)) {
     ALOGE("Write to RS info file %s required the acquisition of the write lock "
-          "on %s but got failure! (%s)", info_path.string(),
-          mObjFile->getName().c_str(), info_file.getErrorMessage().c_str());
+          "on %s but got failure!", info_path.string(),
+          mObjFile->getName().c_str());
     return false;
   }
 
-  // Perform the write.
-  if (!mInfo->write(info_file)) {
+  // Perform the write. mInfo is read from the mapping of the file it
+  // replaces, so the file must not be rewritten in place.
+  if (!mInfo->writeToFile(info_path.string())) {
     ALOGE("Failed to sync the RS info file %s!", info_path.string());
     mObjFile->unlock();
     return false;
   }
 
+  // The cache index has its own copy of the info, which is what the next
+  // load reads if the index knows the object.
+  if (!RSCacheIndex::UpdateInfo(mObjFile->getName().c_str(), *mInfo)) {
+    ALOGW("Failed to update the cache index for %s!",
+          mObjFile->getName().c_str());
+  }
+
   mObjFile->unlock();
   mIsInfoDirty = false;
   return true;
@@ -202,7 +566,13 @@ void RSExecutable::dumpDisassembly(OutputFile &pOutput) const {
 }
 
 RSExecutable::~RSExecutable() {
+  if (mNumLazyImports > 0) {
+    ALOGV("%u of %u runtime function(s) bound lazily by %s.",
+          mNumLazyResolved, mNumLazyImports, mObjFile->getName().c_str());
+  }
   syncInfo();
+  syncExecutionCounters();
+  syncAccessTrace();
   delete mInfo;
   delete mObjFile;
   delete mLoader;
@@ -0,0 +1,202 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Renderscript/RSExecutionCounters.h"
+
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <new>
+
+#include "bcc/Support/InputFile.h"
+#include "bcc/Support/Log.h"
+#include "bcc/Support/OutputFile.h"
+
+using namespace bcc;
+
+android::String8 RSExecutionCounters::GetPath(const char *pObjectPath) {
+  android::String8 result(pObjectPath);
+  result.append(".counters");
+  return result;
+}
+
+void RSExecutionCounters::clear() {
+  mNames.clear();
+  mNameOffsets.clear();
+  mValues.clear();
+}
+
+void RSExecutionCounters::add(const char *pName, uint64_t pValue) {
+  mNameOffsets.push_back(mNames.size());
+  mNames.append(pName);
+  mNames.push_back('\0');
+  mValues.push_back(pValue);
+}
+
+bool RSExecutionCounters::accumulate(const RSExecutionCounters &pOther) {
+  if ((pOther.size() != size()) || (pOther.mNames != mNames)) {
+    return false;
+  }
+
+  for (size_t i = 0; i < mValues.size(); i++) {
+    mValues.editItemAt(i) += pOther.mValues[i];
+  }
+  return true;
+}
+
+bool RSExecutionCounters::readFromFile(const char *pPath) {
+  const rscounters::Header *header;
+  const uint64_t *values;
+  const char *string_pool;
+  uint64_t expected_size;
+  size_t file_size;
+  size_t name_offset;
+  uint8_t *buffer = NULL;
+
+  clear();
+
+  InputFile input(pPath);
+  if (input.hasError()) {
+    // This is expected before the first run of the script ends.
+    ALOGV("No execution counters %s are available. (%s)", pPath,
+          input.getErrorMessage().c_str());
+    return false;
+  }
+
+  file_size = input.getSize();
+  if (input.hasError() || (file_size < sizeof(rscounters::Header))) {
+    ALOGW("Invalid execution counters %s! (size: %u)", pPath,
+          static_cast<unsigned>(file_size));
+    goto bail;
+  }
+
+  buffer = new (std::nothrow) uint8_t [ file_size ];
+  if (buffer == NULL) {
+    ALOGE("Out of memory when read execution counters %s!", pPath);
+    goto bail;
+  }
+
+  if (input.read(buffer, file_size) != static_cast<ssize_t>(file_size)) {
+    ALOGE("Failed to read execution counters %s! (%s)", pPath,
+          input.getErrorMessage().c_str());
+    goto bail;
+  }
+
+  header = reinterpret_cast<const rscounters::Header *>(buffer);
+  if (::memcmp(header->magic, RSCOUNTERS_MAGIC,
+               RSCOUNTERS_MAGIC_LENGTH) != 0) {
+    ALOGW("Invalid magic in execution counters %s!", pPath);
+    goto bail;
+  }
+
+  if (::memcmp(header->version, RSCOUNTERS_VERSION,
+               RSCOUNTERS_VERSION_LENGTH) != 0) {
+    ALOGV("Mismatch the version of execution counters %s! (expect: %s, got: "
+          "%s)", pPath, RSCOUNTERS_VERSION, header->version);
+    goto bail;
+  }
+
+  expected_size = sizeof(rscounters::Header) +
+      static_cast<uint64_t>(header->numCounters) * sizeof(uint64_t) +
+      header->strPoolSize;
+  if ((expected_size != file_size) ||
+      ((header->strPoolSize == 0) && (header->numCounters > 0))) {
+    ALOGW("Corrupted execution counters %s! (size: %u, expected: %llu)", pPath,
+          static_cast<unsigned>(file_size),
+          static_cast<unsigned long long>(expected_size));
+    goto bail;
+  }
+
+  values = reinterpret_cast<const uint64_t *>(header + 1);
+  string_pool = reinterpret_cast<const char *>(values + header->numCounters);
+
+  if ((header->strPoolSize > 0) &&
+      (string_pool[header->strPoolSize - 1] != '\0')) {
+    ALOGW("String pool in execution counters %s is not terminated!", pPath);
+    goto bail;
+  }
+
+  name_offset = 0;
+  for (uint32_t i = 0; i < header->numCounters; i++) {
+    if (name_offset >= header->strPoolSize) {
+      ALOGW("Missing the name of counter #%u in execution counters %s!", i,
+            pPath);
+      goto bail;
+    }
+    const char *name = &string_pool[name_offset];
+    add(name, values[i]);
+    name_offset += ::strlen(name) + 1;
+  }
+
+  delete [] buffer;
+  return true;
+
+bail:
+  delete [] buffer;
+  clear();
+  return false;
+}
+
+bool RSExecutionCounters::writeToFile(const char *pPath) const {
+  rscounters::Header header;
+  size_t values_size = mValues.size() * sizeof(uint64_t);
+
+  ::memcpy(header.magic, RSCOUNTERS_MAGIC, RSCOUNTERS_MAGIC_LENGTH);
+  ::memcpy(header.version, RSCOUNTERS_VERSION, RSCOUNTERS_VERSION_LENGTH);
+  header.numCounters = mValues.size();
+  header.strPoolSize = mNames.size();
+  header.padding = 0;
+
+  // Write to a temporary file in the same directory first so that the rename
+  // below replaces the file atomically.
+  const std::string tmp_path = OutputFile::CreateTemporary(pPath);
+  if (tmp_path.empty()) {
+    return false;
+  }
+
+  {
+    OutputFile output(tmp_path, FileBase::kTruncate);
+    if (output.hasError()) {
+      ALOGW("Failed to open the execution counters %s for write! (%s)",
+            tmp_path.c_str(), output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+
+    if ((output.write(&header, sizeof(header)) !=
+             static_cast<ssize_t>(sizeof(header))) ||
+        (output.write(mValues.array(), values_size) !=
+             static_cast<ssize_t>(values_size)) ||
+        (output.write(mNames.data(), mNames.size()) !=
+             static_cast<ssize_t>(mNames.size()))) {
+      ALOGW("Failed to write the execution counters %s! (%s)",
+            tmp_path.c_str(), output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), pPath) != 0) {
+    ALOGW("Failed to rename %s to %s! (%s)", tmp_path.c_str(), pPath,
+          ::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
@@ -0,0 +1,199 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Assert.h"
+#include "bcc/Renderscript/RSTransforms.h"
+
+#include <iterator>
+#include <string>
+#include <vector>
+
+#include <llvm/IR/Constants.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/IR/Type.h>
+
+#include "bcc/Renderscript/RSExecutable.h"
+#include "bcc/Support/Log.h"
+#include "bcinfo/MetadataExtractor.h"
+
+using namespace bcc;
+
+namespace {
+
+/* RSExecutionCountersPass - This pass counts how often the entry points of a
+ * script run. It appends to the module a zero-initialized array of 32-bit
+ * counters (.rs.counters) in its own section, and a constant listing the
+ * names of the counters (.rs.counters.names) for RSExecutable to read them
+ * out. The following are counted:
+ *
+ *   - "invoke:<name>": calls to each exported function.
+ *   - "launch:<name>": calls to each expanded foreach kernel. Each launch is
+ *     split into several calls by the driver, one per slice of the work.
+ *   - "elements:<name>": the elements (i.e., loop iterations) processed by
+ *     the expanded foreach kernel.
+ *
+ * Only one atomic add is performed per call so that it's cheap enough to be
+ * left on in the field. The per-element code isn't touched. The counters are
+ * 32-bit since some 32-bit targets (e.g., MIPS32) have no native 64-bit
+ * atomics, and the __sync_* libcall they lower to isn't resolved at load.
+ * RSExecutable accumulates them in 64 bits, so they only need not to wrap
+ * twice between two of its syncs.
+ *
+ * This must run after RSForEachExpandPass.
+ */
+class RSExecutionCountersPass : public llvm::ModulePass {
+private:
+  static char ID;
+
+  // Index of the expanded function's x1 and x2 parameters.
+  enum {
+    kExpandedArgX1 = 1,
+    kExpandedArgX2 = 2,
+  };
+
+  llvm::Module *M;
+  llvm::LLVMContext *C;
+
+  // The metadata of the module, shared with the other RS passes.
+  const bcinfo::MetadataExtractor &mMetadata;
+
+  struct Counter {
+    llvm::Function *F;
+    std::string Name;
+    // Count the elements processed by an expanded kernel instead of calls.
+    bool IsElementCounter;
+  };
+
+  std::vector<Counter> Counters;
+
+  void addCounter(llvm::Function *F, const std::string &Name,
+                  bool IsElementCounter) {
+    Counter Entry = { F, Name, IsElementCounter };
+    Counters.push_back(Entry);
+  }
+
+  void instrument(const Counter &Entry, llvm::GlobalVariable *CountersGV,
+                  unsigned Idx) {
+    llvm::Function *F = Entry.F;
+    llvm::IRBuilder<> Builder(F->getEntryBlock().getFirstInsertionPt());
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+
+    llvm::Value *Amount;
+    if (Entry.IsElementCounter) {
+      llvm::Function::arg_iterator AI = F->arg_begin();
+      std::advance(AI, kExpandedArgX1);
+      llvm::Value *X1 = AI++;
+      llvm::Value *X2 = AI;
+      Amount = Builder.CreateZExtOrTrunc(Builder.CreateSub(X2, X1), Int32Ty);
+    } else {
+      Amount = llvm::ConstantInt::get(Int32Ty, 1);
+    }
+
+    llvm::Value *Ptr = Builder.CreateConstInBoundsGEP2_32(CountersGV, 0, Idx);
+    Builder.CreateAtomicRMW(llvm::AtomicRMWInst::Add, Ptr, Amount,
+                            llvm::Monotonic);
+  }
+
+public:
+  RSExecutionCountersPass(const bcinfo::MetadataExtractor &pMetadata)
+      : ModulePass(ID), M(NULL), C(NULL), mMetadata(pMetadata) {
+  }
+
+  virtual bool runOnModule(llvm::Module &Module) {
+    M = &Module;
+    C = &Module.getContext();
+    Counters.clear();
+
+    size_t exportFuncCount = mMetadata.getExportFuncCount();
+    const char **exportFuncNameList = mMetadata.getExportFuncNameList();
+    for (size_t i = 0; i < exportFuncCount; i++) {
+      llvm::Function *F = M->getFunction(exportFuncNameList[i]);
+      if ((F != NULL) && !F->isDeclaration()) {
+        addCounter(F, std::string("invoke:") + exportFuncNameList[i], false);
+      }
+    }
+
+    size_t exportForEachCount = mMetadata.getExportForEachSignatureCount();
+    const char **exportForEachNameList = mMetadata.getExportForEachNameList();
+    for (size_t i = 0; i < exportForEachCount; i++) {
+      llvm::Function *F =
+          M->getFunction(std::string(exportForEachNameList[i]) + ".expand");
+      if ((F == NULL) || F->isDeclaration()) {
+        continue;
+      }
+      bccAssert(F->arg_size() > kExpandedArgX2);
+      addCounter(F, std::string("launch:") + exportForEachNameList[i], false);
+      addCounter(F, std::string("elements:") + exportForEachNameList[i], true);
+    }
+
+    if (Counters.empty()) {
+      return false;
+    }
+
+    // Counters are laid out in a section of their own, aligned to the cache
+    // line, so that they neither share a line with the script's data nor
+    // have to be copied to be exported.
+    llvm::ArrayType *CountersTy =
+        llvm::ArrayType::get(llvm::Type::getInt32Ty(*C), Counters.size());
+    llvm::GlobalVariable *CountersGV = new llvm::GlobalVariable(
+        *M, CountersTy, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantAggregateZero::get(CountersTy),
+        RSExecutable::ExecutionCountersName);
+    CountersGV->setSection(".rs.counters");
+    CountersGV->setAlignment(64);
+
+    // Names of the counters separated by NUL, in the order of .rs.counters.
+    std::string Names;
+    for (size_t i = 0; i < Counters.size(); i++) {
+      Names.append(Counters[i].Name);
+      Names.push_back('\0');
+    }
+    llvm::Constant *NamesInit =
+        llvm::ConstantDataArray::getString(*C, Names, /* AddNull */false);
+    new llvm::GlobalVariable(*M, NamesInit->getType(), true,
+                             llvm::GlobalValue::ExternalLinkage, NamesInit,
+                             RSExecutable::ExecutionCounterNamesName);
+
+    for (size_t i = 0; i < Counters.size(); i++) {
+      instrument(Counters[i], CountersGV, i);
+    }
+
+    return true;
+  }
+
+  virtual const char *getPassName() const {
+    return "Renderscript Execution Counters";
+  }
+
+};  // end RSExecutionCountersPass
+
+}  // end anonymous namespace
+
+char RSExecutionCountersPass::ID = 0;
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSExecutionCountersPass(const bcinfo::MetadataExtractor &pMetadata) {
+  return new RSExecutionCountersPass(pMetadata);
+}
+
+}  // end namespace bcc
@@ -68,6 +68,9 @@ private:
   llvm::StructType   *ForEachStubType;
   llvm::FunctionType *ExpandedFunctionType;
 
+  // The metadata of the module, shared with the other RS passes.
+  const bcinfo::MetadataExtractor &mMetadata;
+
   uint32_t mExportForEachCount;
   const char **mExportForEachNameList;
   const uint32_t *mExportForEachSignatureList;
@@ -331,8 +334,9 @@ private:
   }
 
 public:
-  RSForEachExpandPass(bool pEnableStepOpt)
-      : ModulePass(ID), Module(NULL), Context(NULL),
+  RSForEachExpandPass(const bcinfo::MetadataExtractor &pMetadata,
+                      bool pEnableStepOpt)
+      : ModulePass(ID), Module(NULL), Context(NULL), mMetadata(pMetadata),
         mEnableStepOpt(pEnableStepOpt) {
 
   }
@@ -836,14 +840,9 @@ public:
 
     this->buildTypes();
 
-    bcinfo::MetadataExtractor me(&Module);
-    if (!me.extract()) {
-      ALOGE("Could not extract metadata from module!");
-      return false;
-    }
-    mExportForEachCount = me.getExportForEachSignatureCount();
-    mExportForEachNameList = me.getExportForEachNameList();
-    mExportForEachSignatureList = me.getExportForEachSignatureList();
+    mExportForEachCount = mMetadata.getExportForEachSignatureCount();
+    mExportForEachNameList = mMetadata.getExportForEachNameList();
+    mExportForEachSignatureList = mMetadata.getExportForEachSignatureList();
 
     bool AllocsExposed = allocPointersExposed(Module);
 
@@ -886,8 +885,9 @@ char RSForEachExpandPass::ID = 0;
 namespace bcc {
 
 llvm::ModulePass *
-createRSForEachExpandPass(bool pEnableStepOpt){
-  return new RSForEachExpandPass(pEnableStepOpt);
+createRSForEachExpandPass(const bcinfo::MetadataExtractor &pMetadata,
+                          bool pEnableStepOpt){
+  return new RSForEachExpandPass(pMetadata, pEnableStepOpt);
 }
 
 } // end namespace bcc
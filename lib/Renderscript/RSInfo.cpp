@@ -25,6 +25,8 @@
 #include <new>
 #include <string>
 
+#include <utils/FileMap.h>
+
 #include "bcc/Support/FileBase.h"
 #include "bcc/Support/Log.h"
 
@@ -88,7 +90,8 @@ bool RSInfo::IsConsistent(const char* pInputFilename, const DependencyHashTy& ex
     return true;
 }
 
-RSInfo::RSInfo(size_t pStringPoolSize) : mStringPool(NULL) {
+RSInfo::RSInfo(size_t pStringPoolSize) : mStringPool(NULL), mStrings(NULL),
+                                          mMap(NULL) {
   ::memset(&mHeader, 0, sizeof(mHeader));
 
   ::memcpy(mHeader.magic, RSINFO_MAGIC, sizeof(mHeader.magic));
@@ -101,6 +104,7 @@ RSInfo::RSInfo(size_t pStringPoolSize) : mStringPool(NULL) {
   mHeader.exportVarNameList.itemSize = sizeof(rsinfo::ExportVarNameItem);
   mHeader.exportFuncNameList.itemSize = sizeof(rsinfo::ExportFuncNameItem);
   mHeader.exportForeachFuncList.itemSize = sizeof(rsinfo::ExportForeachFuncItem);
+  mHeader.exportSymbolList.itemSize = sizeof(rsinfo::ExportSymbolItem);
 
   if (pStringPoolSize > 0) {
     mHeader.strPoolSize = pStringPoolSize;
@@ -111,6 +115,7 @@ RSInfo::RSInfo(size_t pStringPoolSize) : mStringPool(NULL) {
     }
     ::memset(mStringPool, 0, mHeader.strPoolSize);
   }
+  mStrings = mStringPool;
   mSourceHash = NULL;
   mCompileCommandLine = NULL;
   mBuildFingerprint = NULL;
@@ -118,26 +123,38 @@ RSInfo::RSInfo(size_t pStringPoolSize) : mStringPool(NULL) {
 
 RSInfo::~RSInfo() {
   delete [] mStringPool;
+  if (mMap != NULL) {
+    mMap->release();
+  }
 }
 
-bool RSInfo::layout(off_t initial_offset) {
-  mHeader.pragmaList.offset = initial_offset +
-                              mHeader.headerSize +
-                              mHeader.strPoolSize;
-  mHeader.pragmaList.count = mPragmas.size();
+bool RSInfo::layout(off_t initial_offset, rsinfo::Header &pHeader) const {
+  // The lists are used in place, so they start on a 4-byte boundary after the
+  // string pool. All the items are multiples of 4 bytes in size, so the lists
+  // after the first one stay aligned.
+  pHeader.pragmaList.offset = initial_offset +
+                              pHeader.headerSize +
+                              pHeader.strPoolSize;
+  pHeader.pragmaList.offset =
+      (pHeader.pragmaList.offset + RSINFO_LIST_ALIGNMENT - 1) &
+      ~(RSINFO_LIST_ALIGNMENT - 1);
+  pHeader.pragmaList.count = mPragmas.size();
 
 #define AFTER(_list) ((_list).offset + (_list).itemSize * (_list).count)
-  mHeader.objectSlotList.offset = AFTER(mHeader.pragmaList);
-  mHeader.objectSlotList.count = mObjectSlots.size();
+  pHeader.objectSlotList.offset = AFTER(pHeader.pragmaList);
+  pHeader.objectSlotList.count = mObjectSlots.size();
+
+  pHeader.exportVarNameList.offset = AFTER(pHeader.objectSlotList);
+  pHeader.exportVarNameList.count = mExportVarNames.size();
 
-  mHeader.exportVarNameList.offset = AFTER(mHeader.objectSlotList);
-  mHeader.exportVarNameList.count = mExportVarNames.size();
+  pHeader.exportFuncNameList.offset = AFTER(pHeader.exportVarNameList);
+  pHeader.exportFuncNameList.count = mExportFuncNames.size();
 
-  mHeader.exportFuncNameList.offset = AFTER(mHeader.exportVarNameList);
-  mHeader.exportFuncNameList.count = mExportFuncNames.size();
+  pHeader.exportForeachFuncList.offset = AFTER(pHeader.exportFuncNameList);
+  pHeader.exportForeachFuncList.count = mExportForeachFuncs.size();
 
-  mHeader.exportForeachFuncList.offset = AFTER(mHeader.exportFuncNameList);
-  mHeader.exportForeachFuncList.count = mExportForeachFuncs.size();
+  pHeader.exportSymbolList.offset = AFTER(pHeader.exportForeachFuncList);
+  pHeader.exportSymbolList.count = mExportSymbols.size();
 #undef AFTER
 
   return true;
@@ -170,36 +187,36 @@ void RSInfo::dump() const {
 } while (false)
 
   DUMP_LIST_HEADER("Pragma list", mHeader.pragmaList);
-  for (PragmaListTy::const_iterator pragma_iter = mPragmas.begin(),
-        pragma_end = mPragmas.end(); pragma_iter != pragma_end; pragma_iter++) {
-    ALOGV("\tkey: %s, value: %s", pragma_iter->first, pragma_iter->second);
+  for (size_t i = 0; i < mPragmas.size(); i++) {
+    ALOGV("\tkey: %s, value: %s", getString(mPragmas[i].key),
+          getString(mPragmas[i].value));
   }
 
   DUMP_LIST_HEADER("RS object slots", mHeader.objectSlotList);
-  for (ObjectSlotListTy::const_iterator slot_iter = mObjectSlots.begin(),
-          slot_end = mObjectSlots.end(); slot_iter != slot_end; slot_iter++) {
-    ALOGV("slot: %u", *slot_iter);
+  for (size_t i = 0; i < mObjectSlots.size(); i++) {
+    ALOGV("slot: %u", mObjectSlots[i].slot);
   }
 
   DUMP_LIST_HEADER("RS export variables", mHeader.exportVarNameList);
-  for (ExportVarNameListTy::const_iterator var_iter = mExportVarNames.begin(),
-          var_end = mExportVarNames.end(); var_iter != var_end; var_iter++) {
-    ALOGV("name: %s", *var_iter);
+  for (size_t i = 0; i < mExportVarNames.size(); i++) {
+    ALOGV("name: %s", getString(mExportVarNames[i].name));
   }
 
   DUMP_LIST_HEADER("RS export functions", mHeader.exportFuncNameList);
-  for (ExportFuncNameListTy::const_iterator func_iter = mExportFuncNames.begin(),
-        func_end = mExportFuncNames.end(); func_iter != func_end; func_iter++) {
-    ALOGV("name: %s", *func_iter);
+  for (size_t i = 0; i < mExportFuncNames.size(); i++) {
+    ALOGV("name: %s", getString(mExportFuncNames[i].name));
   }
 
   DUMP_LIST_HEADER("RS foreach list", mHeader.exportForeachFuncList);
-  for (ExportForeachFuncListTy::const_iterator
-          foreach_iter = mExportForeachFuncs.begin(),
-          foreach_end = mExportForeachFuncs.end(); foreach_iter != foreach_end;
-          foreach_iter++) {
-    ALOGV("name: %s, signature: %05x", foreach_iter->first,
-                                       foreach_iter->second);
+  for (size_t i = 0; i < mExportForeachFuncs.size(); i++) {
+    ALOGV("name: %s, signature: %05x", getString(mExportForeachFuncs[i].name),
+                                       mExportForeachFuncs[i].signature);
+  }
+
+  DUMP_LIST_HEADER("RS export symbols", mHeader.exportSymbolList);
+  for (size_t i = 0; i < mExportSymbols.size(); i++) {
+    ALOGV("section: %u, offset: %u", mExportSymbols[i].section,
+          mExportSymbols[i].offset);
   }
 #undef DUMP_LIST_HEADER
 
@@ -215,17 +232,17 @@ const char *RSInfo::getStringFromPool(rsinfo::StringIndexTy pStrIdx) const {
           pStrIdx, mHeader.strPoolSize);
     return NULL;
   }
-  return &mStringPool[ pStrIdx ];
+  return &mStrings[ pStrIdx ];
 }
 
 rsinfo::StringIndexTy RSInfo::getStringIdxInPool(const char *pStr) const {
   // Assume we are on the flat memory architecture (i.e., the memory space is
   // continuous.)
-  if ((mStringPool + mHeader.strPoolSize) < pStr) {
+  if ((mStrings + mHeader.strPoolSize) < pStr) {
     ALOGE("String %s does not in the string pool!", pStr);
     return rsinfo::gInvalidStringIndex;
   }
-  return (pStr - mStringPool);
+  return (pStr - mStrings);
 }
 
 RSInfo::FloatPrecision RSInfo::getFloatPrecisionRequirement() const {
@@ -236,10 +253,8 @@ RSInfo::FloatPrecision RSInfo::getFloatPrecisionRequirement() const {
   bool relaxed_pragma_seen = false;
   bool full_pragma_seen = false;
 
-  for (PragmaListTy::const_iterator pragma_iter = mPragmas.begin(),
-           pragma_end = mPragmas.end(); pragma_iter != pragma_end;
-       pragma_iter++) {
-    const char *pragma_key = pragma_iter->first;
+  for (size_t i = 0; i < mPragmas.size(); i++) {
+    const char *pragma_key = getString(mPragmas[i].key);
     if (!relaxed_pragma.compare(pragma_key)) {
       relaxed_pragma_seen = true;
     } else if (!imprecise_pragma.compare(pragma_key)) {
@@ -0,0 +1,191 @@
+/*
+ * Copyright 2012, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===----------------------------------------------------------------------===//
+// This file implements RSInfo::recordExportSymbols()
+//===----------------------------------------------------------------------===//
+
+#include "bcc/Renderscript/RSInfo.h"
+
+#include <string>
+
+#include <llvm/ADT/StringMap.h>
+#include <llvm/Support/ELF.h>
+
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+namespace {
+
+typedef llvm::StringMap<std::pair<uint32_t, uint32_t> > SymbolLocationMapTy;
+
+// Collect the locations of the symbols defined in the sections which will be
+// allocated at load time. The object may be compiled for a target whose word
+// size differs from the host's one, hence the template.
+template<typename ElfEhdr, typename ElfShdr, typename ElfSym>
+bool helper_collect_symbol_locations(const uint8_t *pImage,
+                                     size_t pImageSize,
+                                     SymbolLocationMapTy &pResult) {
+  const ElfEhdr *elf_header = reinterpret_cast<const ElfEhdr *>(pImage);
+
+  if ((pImageSize < sizeof(ElfEhdr)) ||
+      (elf_header->e_shoff > pImageSize) ||
+      ((pImageSize - elf_header->e_shoff) <
+          (sizeof(ElfShdr) * elf_header->e_shnum))) {
+    ALOGE("Invalid section header table in the object!");
+    return false;
+  }
+
+  const ElfShdr *section_header_table =
+      reinterpret_cast<const ElfShdr *>(pImage + elf_header->e_shoff);
+
+  for (unsigned i = 0; i < elf_header->e_shnum; i++) {
+    const ElfShdr &symtab = section_header_table[i];
+    if (symtab.sh_type != llvm::ELF::SHT_SYMTAB) {
+      continue;
+    }
+
+    if ((symtab.sh_link >= elf_header->e_shnum) ||
+        (symtab.sh_offset > pImageSize) ||
+        ((pImageSize - symtab.sh_offset) < symtab.sh_size)) {
+      ALOGE("Invalid symbol table in the object!");
+      return false;
+    }
+
+    const ElfShdr &strtab = section_header_table[symtab.sh_link];
+    if ((strtab.sh_offset > pImageSize) ||
+        ((pImageSize - strtab.sh_offset) < strtab.sh_size)) {
+      ALOGE("Invalid string table in the object!");
+      return false;
+    }
+
+    const ElfSym *symbols =
+        reinterpret_cast<const ElfSym *>(pImage + symtab.sh_offset);
+    const char *strings =
+        reinterpret_cast<const char *>(pImage + strtab.sh_offset);
+
+    for (size_t j = 1, e = symtab.sh_size / sizeof(ElfSym); j < e; j++) {
+      const ElfSym &symbol = symbols[j];
+
+      // Common and absolute symbols are not in any section. Leave them to be
+      // looked up by name.
+      if ((symbol.st_shndx == llvm::ELF::SHN_UNDEF) ||
+          (symbol.st_shndx >= llvm::ELF::SHN_LORESERVE) ||
+          (symbol.st_shndx >= elf_header->e_shnum) ||
+          (symbol.st_name >= strtab.sh_size)) {
+        continue;
+      }
+
+      // Only the sections holding code or data are loaded.
+      const ElfShdr &section = section_header_table[symbol.st_shndx];
+      if (((section.sh_flags & llvm::ELF::SHF_ALLOC) == 0) ||
+          ((section.sh_type != llvm::ELF::SHT_PROGBITS) &&
+           (section.sh_type != llvm::ELF::SHT_NOBITS))) {
+        continue;
+      }
+
+      pResult[&strings[symbol.st_name]] =
+          std::make_pair(static_cast<uint32_t>(symbol.st_shndx),
+                         static_cast<uint32_t>(symbol.st_value));
+    }
+  }
+
+  return true;
+}
+
+inline rsinfo::ExportSymbolItem
+helper_find_symbol_location(const SymbolLocationMapTy &pLocations,
+                            llvm::StringRef pName) {
+  rsinfo::ExportSymbolItem item;
+  SymbolLocationMapTy::const_iterator location = pLocations.find(pName);
+  if (location != pLocations.end()) {
+    item.section = location->getValue().first;
+    item.offset = location->getValue().second;
+  } else {
+    item.section = rsinfo::gInvalidSectionIndex;
+    item.offset = 0;
+  }
+  return item;
+}
+
+} // end anonymous namespace
+
+bool RSInfo::recordExportSymbols(const void *pObject, size_t pObjectSize) {
+  const uint8_t *image = reinterpret_cast<const uint8_t *>(pObject);
+  SymbolLocationMapTy locations;
+
+  mExportSymbols.clear();
+
+  // e_ident is the same in both ELF32 and ELF64.
+  if ((pObjectSize < sizeof(llvm::ELF::Elf32_Ehdr)) ||
+      !reinterpret_cast<const llvm::ELF::Elf32_Ehdr *>(image)->checkMagic()) {
+    ALOGE("Invalid ELF object to record RS export symbols from!");
+    return false;
+  }
+
+  bool success;
+  if (image[llvm::ELF::EI_CLASS] == llvm::ELF::ELFCLASS64) {
+    const llvm::ELF::Elf64_Ehdr *elf_header =
+        reinterpret_cast<const llvm::ELF::Elf64_Ehdr *>(image);
+    if ((pObjectSize < sizeof(*elf_header)) ||
+        (elf_header->e_type != llvm::ELF::ET_REL)) {
+      // The symbols in a shared object are looked up through the dynamic
+      // loader instead.
+      return true;
+    }
+    success = helper_collect_symbol_locations<llvm::ELF::Elf64_Ehdr,
+                                              llvm::ELF::Elf64_Shdr,
+                                              llvm::ELF::Elf64_Sym>(
+                  image, pObjectSize, locations);
+  } else {
+    const llvm::ELF::Elf32_Ehdr *elf_header =
+        reinterpret_cast<const llvm::ELF::Elf32_Ehdr *>(image);
+    if ((pObjectSize < sizeof(*elf_header)) ||
+        (elf_header->e_type != llvm::ELF::ET_REL)) {
+      return true;
+    }
+    success = helper_collect_symbol_locations<llvm::ELF::Elf32_Ehdr,
+                                              llvm::ELF::Elf32_Shdr,
+                                              llvm::ELF::Elf32_Sym>(
+                  image, pObjectSize, locations);
+  }
+
+  if (!success) {
+    return false;
+  }
+
+  // Record in the order of RSExecutable::Create() resolving them. Symbols
+  // not found (e.g., optimized out) are marked with gInvalidSectionIndex.
+  for (size_t i = 0; i < mExportVarNames.size(); i++) {
+    mExportSymbols.push(helper_find_symbol_location(
+        locations, getString(mExportVarNames[i].name)));
+  }
+
+  for (size_t i = 0; i < mExportFuncNames.size(); i++) {
+    mExportSymbols.push(helper_find_symbol_location(
+        locations, getString(mExportFuncNames[i].name)));
+  }
+
+  for (size_t i = 0; i < mExportForeachFuncs.size(); i++) {
+    std::string expanded_func_name(getString(mExportForeachFuncs[i].name));
+    expanded_func_name.append(".expand");
+    mExportSymbols.push(helper_find_symbol_location(locations,
+                                                    expanded_func_name));
+  }
+
+  return true;
+}
@@ -19,6 +19,8 @@
 //===----------------------------------------------------------------------===//
 #include "bcc/Renderscript/RSInfo.h"
 
+#include <string>
+
 #include <llvm/IR/Constants.h>
 #include <llvm/IR/Metadata.h>
 #include <llvm/IR/Module.h>
@@ -60,50 +62,21 @@ inline llvm::StringRef getStringFromOperand(const llvm::Value *pString) {
   return llvm::StringRef();
 }
 
-template<size_t NumOperands>
-inline size_t getMetadataStringLength(const llvm::NamedMDNode *pMetadata) {
-  if (pMetadata == NULL) {
-    return 0;
-  }
-
-  size_t string_size = 0;
-  for (unsigned i = 0, e = pMetadata->getNumOperands(); i < e; i++) {
-    llvm::MDNode *node = pMetadata->getOperand(i);
-    if ((node != NULL) && (node->getNumOperands() >= NumOperands)) {
-      // Compiler try its best to unroll this loop since NumOperands is a
-      // template parameter (therefore the number of iteration can be determined
-      // at compile-time and it's usually small.)
-      for (unsigned j = 0; j < NumOperands; j++) {
-        llvm::StringRef s = getStringFromOperand(node->getOperand(j));
-        if (s.size() > 0) {
-          // +1 is for the null-terminator at the end of string.
-          string_size += (s.size() + 1);
-        }
-      }
-    }
-  }
-
-  return string_size;
-}
-
-// Write a string pString to the string pool pStringPool at offset pWriteStart.
-// Return the pointer the pString resides within the string pool.
-// Updates pWriteStart to the next available spot.
-const char *writeString(const llvm::StringRef &pString, char *pStringPool,
-                        off_t *pWriteStart) {
+// Append a string pString to the string pool pStringPool. Return the index
+// where the pString resides within the string pool.
+rsinfo::StringIndexTy writeString(const llvm::StringRef &pString,
+                                  std::string &pStringPool) {
   if (pString.empty()) {
-    return pStringPool;
+    // The first byte of the string pool is an empty string.
+    return 0;
   }
 
-  char *pStringWriteStart = pStringPool + *pWriteStart;
-  // Copy the string.
-  ::memcpy(pStringWriteStart, pString.data(), pString.size());
+  rsinfo::StringIndexTy index = pStringPool.size();
+  pStringPool.append(pString.data(), pString.size());
   // Write null-terminator at the end of the string.
-  pStringWriteStart[ pString.size() ] = '\0';
-  // Update pWriteStart.
-  *pWriteStart += (pString.size() + 1);
+  pStringPool.push_back('\0');
 
-  return pStringWriteStart;
+  return index;
 }
 
 } // end anonymous namespace
@@ -127,9 +100,10 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
   const llvm::NamedMDNode *object_slots =
       module.getNamedMetadata(object_slot_metadata_name);
 
-  // Always write a byte 0x0 at the beginning of the string pool.
-  size_t string_pool_size = 1;
-  off_t cur_string_pool_offset = 0;
+  // The string pool is built up while the metadata is walked and copied into
+  // the result at the end, so the metadata is only visited once. Always write
+  // a byte 0x0 at the beginning of the string pool.
+  std::string string_pool(1, '\0');
 
   RSInfo *result = NULL;
 
@@ -138,36 +112,16 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
   if ((export_foreach_name == NULL) || (export_foreach_signature == NULL)) {
     export_foreach_name = NULL;
     export_foreach_signature = NULL;
-    string_pool_size += 5;  // insert "root\0" for #rs_export_foreach_name
   }
 
-  string_pool_size += getMetadataStringLength<2>(pragma);
-  string_pool_size += getMetadataStringLength<1>(export_var);
-  string_pool_size += getMetadataStringLength<1>(export_func);
-  string_pool_size += getMetadataStringLength<1>(export_foreach_name);
-
-  // Reserve the space for the source hash, command line, and fingerprint
-  string_pool_size += SHA1_DIGEST_LENGTH;
-  string_pool_size += strlen(compileCommandLineToEmbed) + 1;
-  string_pool_size += strlen(buildFingerprintToEmbed) + 1;
-
-  // Allocate result object
-  result = new (std::nothrow) RSInfo(string_pool_size);
+  // Allocate result object. Its string pool is allocated once its size is
+  // known.
+  result = new (std::nothrow) RSInfo(0);
   if (result == NULL) {
     ALOGE("Out of memory when create RSInfo object for %s!", module_name);
     goto bail;
   }
 
-  // Check string pool.
-  if (result->mStringPool == NULL) {
-    ALOGE("Out of memory when allocate string pool in RSInfo object for %s!",
-          module_name);
-    goto bail;
-  }
-
-  // First byte of string pool should be an empty string
-  result->mStringPool[ cur_string_pool_offset++ ] = '\0';
-
   // Populate all the strings and data.
 #define FOR_EACH_NODE_IN(_metadata, _node)  \
   for (unsigned i = 0, e = (_metadata)->getNumOperands(); i != e; i++)  \
@@ -186,9 +140,10 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
           ALOGW("%s contains pragma metadata with empty key (skip)!",
                 module_name);
         } else {
-          result->mPragmas.push(std::make_pair(
-              writeString(key, result->mStringPool, &cur_string_pool_offset),
-              writeString(val, result->mStringPool, &cur_string_pool_offset)));
+          rsinfo::PragmaItem item;
+          item.key = writeString(key, string_pool);
+          item.value = writeString(val, string_pool);
+          result->mPragmas.push(item);
         } // key.empty()
     } // FOR_EACH_NODE_IN
   } // pragma != NULL
@@ -204,8 +159,9 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
         ALOGW("%s contains empty entry in #rs_export_var metadata (skip)!",
               module_name);
       } else {
-          result->mExportVarNames.push(
-              writeString(name, result->mStringPool, &cur_string_pool_offset));
+          rsinfo::ExportVarNameItem item;
+          item.name = writeString(name, string_pool);
+          result->mExportVarNames.push(item);
       }
     }
   }
@@ -221,8 +177,9 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
         ALOGW("%s contains empty entry in #rs_export_func metadata (skip)!",
               module_name);
       } else {
-        result->mExportFuncNames.push(
-            writeString(name, result->mStringPool, &cur_string_pool_offset));
+        rsinfo::ExportFuncNameItem item;
+        item.name = writeString(name, string_pool);
+        result->mExportFuncNames.push(item);
       }
     }
   }
@@ -279,9 +236,10 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
                 signature_string.str().c_str(), name.str().c_str(), module_name);
           goto bail;
         }
-        result->mExportForeachFuncs.push(std::make_pair(
-              writeString(name, result->mStringPool, &cur_string_pool_offset),
-              signature));
+        rsinfo::ExportForeachFuncItem item;
+        item.name = writeString(name, string_pool);
+        item.signature = signature;
+        result->mExportForeachFuncs.push(item);
       } else {
         // One or both of the name and signature value are empty. It's safe only
         // if both of them are empty.
@@ -301,9 +259,10 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
     // To handle the legacy case, we generate a full signature for a "root"
     // function which means that we need to set the bottom 5 bits (0x1f) in the
     // mask.
-    result->mExportForeachFuncs.push(std::make_pair(
-          writeString(llvm::StringRef("root"), result->mStringPool,
-                      &cur_string_pool_offset), 0x1f));
+    rsinfo::ExportForeachFuncItem item;
+    item.name = writeString(llvm::StringRef("root"), string_pool);
+    item.signature = 0x1f;
+    result->mExportForeachFuncs.push(item);
   }
 
   //===--------------------------------------------------------------------===//
@@ -311,8 +270,10 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
   //===--------------------------------------------------------------------===//
   if (object_slots != NULL) {
     llvm::MDNode *node;
+    rsinfo::ObjectSlotItem empty_slot;
+    empty_slot.slot = 0;
     for (unsigned int i = 0; i <= export_var->getNumOperands(); i++) {
-      result->mObjectSlots.push(0);
+      result->mObjectSlots.push(empty_slot);
     }
     FOR_EACH_NODE_IN(object_slots, node) {
       llvm::StringRef val = getStringFromOperand(node->getOperand(0));
@@ -326,7 +287,7 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
                 module.getModuleIdentifier().c_str());
           goto bail;
         } else {
-          result->mObjectSlots.editItemAt(slot) = 1;
+          result->mObjectSlots.editItemAt(slot).slot = 1;
         }
       }
     }
@@ -338,21 +299,38 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
   //===------------------------------------------------------------------===//
   {
       // Store the SHA-1 in the string pool but without a null-terminator.
-      result->mHeader.sourceSha1Idx = cur_string_pool_offset;
-      uint8_t* sha1 = reinterpret_cast<uint8_t*>(result->mStringPool + cur_string_pool_offset);
-      ::memcpy(sha1, sourceHashToEmbed, SHA1_DIGEST_LENGTH);
-      // Update the string pool pointer.
-      cur_string_pool_offset += SHA1_DIGEST_LENGTH;
-      result->mSourceHash = sha1;
-
-      result->mHeader.compileCommandLineIdx = cur_string_pool_offset;
-      result->mCompileCommandLine = writeString(compileCommandLineToEmbed, result->mStringPool,
-                                                &cur_string_pool_offset);
-
-      result->mHeader.buildFingerprintIdx = cur_string_pool_offset;
-      result->mBuildFingerprint = writeString(buildFingerprintToEmbed, result->mStringPool,
-                                              &cur_string_pool_offset);
+      result->mHeader.sourceSha1Idx = string_pool.size();
+      string_pool.append(reinterpret_cast<const char *>(sourceHashToEmbed),
+                         SHA1_DIGEST_LENGTH);
+
+      result->mHeader.compileCommandLineIdx = string_pool.size();
+      string_pool.append(compileCommandLineToEmbed);
+      string_pool.push_back('\0');
+
+      result->mHeader.buildFingerprintIdx = string_pool.size();
+      string_pool.append(buildFingerprintToEmbed);
+      string_pool.push_back('\0');
+  }
+
+  //===--------------------------------------------------------------------===//
+  // Copy the string pool into the result
+  //===--------------------------------------------------------------------===//
+  result->mStringPool = new (std::nothrow) char [ string_pool.size() ];
+  if (result->mStringPool == NULL) {
+    ALOGE("Out of memory when allocate string pool in RSInfo object for %s!",
+          module_name);
+    goto bail;
   }
+  ::memcpy(result->mStringPool, string_pool.data(), string_pool.size());
+  result->mHeader.strPoolSize = string_pool.size();
+  result->mStrings = result->mStringPool;
+
+  result->mSourceHash = reinterpret_cast<const uint8_t *>(
+      result->mStringPool + result->mHeader.sourceSha1Idx);
+  result->mCompileCommandLine =
+      result->mStringPool + result->mHeader.compileCommandLineIdx;
+  result->mBuildFingerprint =
+      result->mStringPool + result->mHeader.buildFingerprintIdx;
 
   //===--------------------------------------------------------------------===//
   // Determine whether the bitcode contains debug information
@@ -362,9 +340,6 @@ RSInfo* RSInfo::ExtractFromSource(const Source& pSource, const DependencyHashTy&
   result->mHeader.hasDebugInformation =
       static_cast<uint8_t>(module.getNamedMetadata("llvm.dbg.cu") != NULL);
 
-  assert((cur_string_pool_offset == string_pool_size) &&
-            "Unexpected string pool size!");
-
   return result;
 
 bail:
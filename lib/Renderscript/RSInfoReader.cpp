@@ -15,11 +15,14 @@
  */
 
 //===----------------------------------------------------------------------===//
-// This file implements RSInfo::ReadFromFile()
+// This file implements RSInfo::ReadFromFile() and RSInfo::ReadFromBuffer()
 //===----------------------------------------------------------------------===//
 
 #include "bcc/Renderscript/RSInfo.h"
 
+#include <stdint.h>
+
+#include <cstring>
 #include <new>
 
 #include <utils/FileMap.h>
@@ -31,116 +34,107 @@ using namespace bcc;
 
 namespace {
 
-template<typename ItemType, typename ItemContainer>
-inline bool helper_read_list_item(const ItemType &pItem,
-                                  const RSInfo &pInfo,
-                                  ItemContainer &pResult);
+// Check the string indices in an item. The items are used in place
+// afterwards, so everything they refer to must be in the string pool.
+template<typename ItemType>
+inline bool helper_check_list_item(const ItemType &pItem,
+                                   const RSInfo &pInfo);
 
-// Process PragmaItem in the file
+// Check PragmaItem in the file
 template<> inline bool
-helper_read_list_item<rsinfo::PragmaItem, RSInfo::PragmaListTy>(
-    const rsinfo::PragmaItem &pItem,
-    const RSInfo &pInfo,
-    RSInfo::PragmaListTy &pResult)
+helper_check_list_item<rsinfo::PragmaItem>(const rsinfo::PragmaItem &pItem,
+                                           const RSInfo &pInfo)
 {
-  const char *key = pInfo.getStringFromPool(pItem.key);
-  const char *value =pInfo.getStringFromPool(pItem.value);
-
-  if (key == NULL) {
+  if (pInfo.getStringFromPool(pItem.key) == NULL) {
     ALOGE("Invalid string index %d for key in RS pragma list.", pItem.key);
     return false;
   }
 
-  if (value == NULL) {
+  if (pInfo.getStringFromPool(pItem.value) == NULL) {
     ALOGE("Invalid string index %d for value in RS pragma list.", pItem.value);
     return false;
   }
 
-  pResult.push(std::make_pair(key, value));
   return true;
 }
 
-// Procee ObjectSlotItem in the file
+// Check ObjectSlotItem in the file
 template<> inline bool
-helper_read_list_item<rsinfo::ObjectSlotItem, RSInfo::ObjectSlotListTy>(
+helper_check_list_item<rsinfo::ObjectSlotItem>(
     const rsinfo::ObjectSlotItem &pItem,
-    const RSInfo &pInfo,
-    RSInfo::ObjectSlotListTy &pResult)
+    const RSInfo &pInfo)
 {
-  pResult.push(pItem.slot);
   return true;
 }
 
-// Procee ExportVarNameItem in the file
+// Check ExportVarNameItem in the file
 template<> inline bool
-helper_read_list_item<rsinfo::ExportVarNameItem, RSInfo::ExportVarNameListTy>(
+helper_check_list_item<rsinfo::ExportVarNameItem>(
     const rsinfo::ExportVarNameItem &pItem,
-    const RSInfo &pInfo,
-    RSInfo::ExportVarNameListTy &pResult)
+    const RSInfo &pInfo)
 {
-  const char *name = pInfo.getStringFromPool(pItem.name);
-
-  if (name == NULL) {
+  if (pInfo.getStringFromPool(pItem.name) == NULL) {
     ALOGE("Invalid string index %d for name in RS export vars.", pItem.name);
     return false;
   }
 
-  pResult.push(name);
   return true;
 }
 
-// Procee ExportFuncNameItem in the file
+// Check ExportFuncNameItem in the file
 template<> inline bool
-helper_read_list_item<rsinfo::ExportFuncNameItem, RSInfo::ExportFuncNameListTy>(
+helper_check_list_item<rsinfo::ExportFuncNameItem>(
     const rsinfo::ExportFuncNameItem &pItem,
-    const RSInfo &pInfo,
-    RSInfo::ExportFuncNameListTy &pResult)
+    const RSInfo &pInfo)
 {
-  const char *name = pInfo.getStringFromPool(pItem.name);
-
-  if (name == NULL) {
+  if (pInfo.getStringFromPool(pItem.name) == NULL) {
     ALOGE("Invalid string index %d for name in RS export funcs.", pItem.name);
     return false;
   }
 
-  pResult.push(name);
   return true;
 }
 
-// Procee ExportForeachFuncItem in the file
+// Check ExportForeachFuncItem in the file
 template<> inline bool
-helper_read_list_item<rsinfo::ExportForeachFuncItem, RSInfo::ExportForeachFuncListTy>(
+helper_check_list_item<rsinfo::ExportForeachFuncItem>(
     const rsinfo::ExportForeachFuncItem &pItem,
-    const RSInfo &pInfo,
-    RSInfo::ExportForeachFuncListTy &pResult)
+    const RSInfo &pInfo)
 {
-  const char *name = pInfo.getStringFromPool(pItem.name);
-
-  if (name == NULL) {
+  if (pInfo.getStringFromPool(pItem.name) == NULL) {
     ALOGE("Invalid string index %d for name in RS export foreachs.", pItem.name);
     return false;
   }
 
-  pResult.push(std::make_pair(name, pItem.signature));
   return true;
 }
 
-template<typename ItemType, typename ItemContainer>
+// Check ExportSymbolItem in the file
+template<> inline bool
+helper_check_list_item<rsinfo::ExportSymbolItem>(
+    const rsinfo::ExportSymbolItem &pItem,
+    const RSInfo &pInfo)
+{
+  return true;
+}
+
+// Point pResult at the items of the list in pData after checking them.
+template<typename ItemType>
 inline bool helper_read_list(const uint8_t *pData,
                              const RSInfo &pInfo,
                              const rsinfo::ListHeader &pHeader,
-                             ItemContainer &pResult) {
-  const ItemType *item;
-
+                             rsinfo::ItemList<ItemType> &pResult) {
   // Out-of-range exception has been checked.
+  const ItemType *items =
+      reinterpret_cast<const ItemType *>(pData + pHeader.offset);
+
   for (uint32_t i = 0; i < pHeader.count; i++) {
-    item = reinterpret_cast<const ItemType *>(pData +
-                                              pHeader.offset +
-                                              i * pHeader.itemSize);
-    if (!helper_read_list_item<ItemType, ItemContainer>(*item, pInfo, pResult)) {
+    if (!helper_check_list_item<ItemType>(items[i], pInfo)) {
       return false;
     }
   }
+
+  pResult.setView(items, pHeader.count);
   return true;
 }
 
@@ -149,8 +143,6 @@ inline bool helper_read_list(const uint8_t *pData,
 RSInfo *RSInfo::ReadFromFile(InputFile &pInput) {
   android::FileMap *map = NULL;
   RSInfo *result = NULL;
-  const uint8_t *data;
-  const rsinfo::Header *header;
   size_t filesize;
   const char *input_filename = pInput.getName().c_str();
   const off_t cur_input_offset = pInput.tell();
@@ -177,15 +169,43 @@ RSInfo *RSInfo::ReadFromFile(InputFile &pInput) {
     goto bail;
   }
 
-  data = reinterpret_cast<const uint8_t *>(map->getDataPtr());
+  result = ReadFromBuffer(reinterpret_cast<const uint8_t *>(map->getDataPtr()),
+                          map->getDataLength(), input_filename);
+  if (result == NULL) {
+    goto bail;
+  }
+
+  // The result refers to the mapping from now on.
+  result->mMap = map;
+
+  return result;
+
+bail:
+  if (map != NULL) {
+    map->release();
+  }
+
+  return NULL;
+} // RSInfo::ReadFromFile
+
+RSInfo *RSInfo::ReadFromBuffer(const uint8_t *pData, size_t pSize,
+                               const char *pName) {
+  RSInfo *result = NULL;
+  const rsinfo::Header *header;
 
-  // Header starts at the beginning of the file.
-  header = reinterpret_cast<const rsinfo::Header *>(data);
+  // Header starts at the beginning of the data.
+  header = reinterpret_cast<const rsinfo::Header *>(pData);
+
+  if (pSize < sizeof(rsinfo::Header)) {
+    ALOGV("RS info %s is too small (%u bytes). Treat it as a dirty cache.",
+          pName, static_cast<unsigned>(pSize));
+    goto bail;
+  }
 
   // Check the magic.
   if (::memcmp(header->magic, RSINFO_MAGIC, sizeof(header->magic)) != 0) {
     ALOGV("Wrong magic found in the RS info file %s. Treat it as a dirty "
-          "cache.", input_filename);
+          "cache.", pName);
     goto bail;
   }
 
@@ -194,7 +214,7 @@ RSInfo *RSInfo::ReadFromFile(InputFile &pInput) {
                RSINFO_VERSION,
                sizeof(header->version)) != 0) {
     ALOGV("Mismatch the version of RS info file %s: (current) %s v.s. (file) "
-          "%s. Treat it as as a dirty cache.", input_filename, RSINFO_VERSION,
+          "%s. Treat it as as a dirty cache.", pName, RSINFO_VERSION,
           header->version);
     goto bail;
   }
@@ -205,57 +225,74 @@ RSInfo *RSInfo::ReadFromFile(InputFile &pInput) {
       (header->objectSlotList.itemSize != sizeof(rsinfo::ObjectSlotItem)) ||
       (header->exportVarNameList.itemSize != sizeof(rsinfo::ExportVarNameItem)) ||
       (header->exportFuncNameList.itemSize != sizeof(rsinfo::ExportFuncNameItem)) ||
-      (header->exportForeachFuncList.itemSize != sizeof(rsinfo::ExportForeachFuncItem))) {
-    ALOGW("Corrupted RS info file %s! (unexpected size found)", input_filename);
+      (header->exportForeachFuncList.itemSize != sizeof(rsinfo::ExportForeachFuncItem)) ||
+      (header->exportSymbolList.itemSize != sizeof(rsinfo::ExportSymbolItem))) {
+    ALOGW("Corrupted RS info file %s! (unexpected size found)", pName);
     goto bail;
   }
 
-  // Check the range.
+  // Check the range. Nothing is copied out of the data, so the ranges are
+  // computed in 64 bits to rule out any wrap-around.
 #define LIST_DATA_RANGE(_list_header) \
-  ((_list_header).offset + (_list_header).count * (_list_header).itemSize)
-  if (((header->headerSize + header->strPoolSize) > filesize) ||
-      (LIST_DATA_RANGE(header->pragmaList) > filesize) ||
-      (LIST_DATA_RANGE(header->objectSlotList) > filesize) ||
-      (LIST_DATA_RANGE(header->exportVarNameList) > filesize) ||
-      (LIST_DATA_RANGE(header->exportFuncNameList) > filesize) ||
-      (LIST_DATA_RANGE(header->exportForeachFuncList) > filesize)) {
-    ALOGW("Corrupted RS info file %s! (data out of the range)", input_filename);
+  (static_cast<uint64_t>((_list_header).offset) + \
+   static_cast<uint64_t>((_list_header).count) * (_list_header).itemSize)
+  if (((static_cast<uint64_t>(header->headerSize) + header->strPoolSize) >
+          pSize) ||
+      (LIST_DATA_RANGE(header->pragmaList) > pSize) ||
+      (LIST_DATA_RANGE(header->objectSlotList) > pSize) ||
+      (LIST_DATA_RANGE(header->exportVarNameList) > pSize) ||
+      (LIST_DATA_RANGE(header->exportFuncNameList) > pSize) ||
+      (LIST_DATA_RANGE(header->exportForeachFuncList) > pSize) ||
+      (LIST_DATA_RANGE(header->exportSymbolList) > pSize)) {
+    ALOGW("Corrupted RS info file %s! (data out of the range)", pName);
     goto bail;
   }
 #undef LIST_DATA_RANGE
 
-  // File seems ok, create result RSInfo object.
-  result = new (std::nothrow) RSInfo(header->strPoolSize);
-  if (result == NULL) {
-    ALOGE("Out of memory when create RSInfo object for %s!", input_filename);
+  // The items are used in place. Reject the lists which aren't aligned (see
+  // RSInfo::layout().)
+#define LIST_DATA_MISALIGNED(_list_header) \
+  ((reinterpret_cast<uintptr_t>(pData + (_list_header).offset) & \
+    (RSINFO_LIST_ALIGNMENT - 1)) != 0)
+  if (LIST_DATA_MISALIGNED(header->pragmaList) ||
+      LIST_DATA_MISALIGNED(header->objectSlotList) ||
+      LIST_DATA_MISALIGNED(header->exportVarNameList) ||
+      LIST_DATA_MISALIGNED(header->exportFuncNameList) ||
+      LIST_DATA_MISALIGNED(header->exportForeachFuncList) ||
+      LIST_DATA_MISALIGNED(header->exportSymbolList)) {
+    ALOGW("Corrupted RS info file %s! (misaligned list)", pName);
     goto bail;
   }
+#undef LIST_DATA_MISALIGNED
 
-  // Make advice on our access pattern.
-  map->advise(android::FileMap::SEQUENTIAL);
-
-  // Copy the header.
-  ::memcpy(&result->mHeader, header, sizeof(rsinfo::Header));
+  // The strings are used in place. Make sure the last one is terminated.
+  if ((header->strPoolSize == 0) ||
+      (pData[header->headerSize + header->strPoolSize - 1] != '\0')) {
+    ALOGW("Corrupted RS info file %s! (unterminated string pool)", pName);
+    goto bail;
+  }
 
-  if (header->strPoolSize > 0) {
-    // Copy the string pool. The string pool is immediately after the header at
-    // the offset header->headerSize.
-    if (result->mStringPool == NULL) {
-      ALOGE("Out of memory when allocate string pool for RS info file %s!",
-            input_filename);
-      goto bail;
-    }
-    ::memcpy(result->mStringPool, data + result->mHeader.headerSize,
-             result->mHeader.strPoolSize);
+  // Data seems ok, create result RSInfo object.
+  result = new (std::nothrow) RSInfo(0);
+  if (result == NULL) {
+    ALOGE("Out of memory when create RSInfo object for %s!", pName);
+    goto bail;
   }
 
+  // Copy the header. The string pool is immediately after the header at the
+  // offset header->headerSize.
+  ::memcpy(&result->mHeader, header, sizeof(rsinfo::Header));
+  result->mStrings =
+      reinterpret_cast<const char *>(pData + result->mHeader.headerSize);
+
   // Populate all the data to the result object.
-  result->mSourceHash =
-              reinterpret_cast<const uint8_t*>(result->getStringFromPool(header->sourceSha1Idx));
-  if (result->mSourceHash == NULL) {
+  if (static_cast<uint64_t>(header->sourceSha1Idx) + SHA1_DIGEST_LENGTH >
+          header->strPoolSize) {
       ALOGE("Invalid string index %d for SHA-1 checksum of source.", header->sourceSha1Idx);
       goto bail;
   }
+  result->mSourceHash =
+              reinterpret_cast<const uint8_t*>(result->getString(header->sourceSha1Idx));
 
   result->mCompileCommandLine = result->getStringFromPool(header->compileCommandLineIdx);
   if (result->mCompileCommandLine == NULL) {
@@ -269,42 +306,40 @@ RSInfo *RSInfo::ReadFromFile(InputFile &pInput) {
       goto bail;
   }
 
-  if (!helper_read_list<rsinfo::PragmaItem, PragmaListTy>
-        (data, *result, header->pragmaList, result->mPragmas)) {
+  if (!helper_read_list<rsinfo::PragmaItem>
+        (pData, *result, header->pragmaList, result->mPragmas)) {
     goto bail;
   }
 
-  if (!helper_read_list<rsinfo::ObjectSlotItem, ObjectSlotListTy>
-        (data, *result, header->objectSlotList, result->mObjectSlots)) {
+  if (!helper_read_list<rsinfo::ObjectSlotItem>
+        (pData, *result, header->objectSlotList, result->mObjectSlots)) {
     goto bail;
   }
 
-  if (!helper_read_list<rsinfo::ExportVarNameItem, ExportVarNameListTy>
-        (data, *result, header->exportVarNameList, result->mExportVarNames)) {
+  if (!helper_read_list<rsinfo::ExportVarNameItem>
+        (pData, *result, header->exportVarNameList, result->mExportVarNames)) {
     goto bail;
   }
 
-  if (!helper_read_list<rsinfo::ExportFuncNameItem, ExportFuncNameListTy>
-        (data, *result, header->exportFuncNameList, result->mExportFuncNames)) {
+  if (!helper_read_list<rsinfo::ExportFuncNameItem>
+        (pData, *result, header->exportFuncNameList, result->mExportFuncNames)) {
     goto bail;
   }
 
-  if (!helper_read_list<rsinfo::ExportForeachFuncItem, ExportForeachFuncListTy>
-        (data, *result, header->exportForeachFuncList, result->mExportForeachFuncs)) {
+  if (!helper_read_list<rsinfo::ExportForeachFuncItem>
+        (pData, *result, header->exportForeachFuncList, result->mExportForeachFuncs)) {
     goto bail;
   }
 
-  // Clean up.
-  map->release();
+  if (!helper_read_list<rsinfo::ExportSymbolItem>
+        (pData, *result, header->exportSymbolList, result->mExportSymbols)) {
+    goto bail;
+  }
 
   return result;
 
 bail:
-  if (map != NULL) {
-    map->release();
-  }
-
   delete result;
 
   return NULL;
-} // RSInfo::ReadFromFile
+} // RSInfo::ReadFromBuffer
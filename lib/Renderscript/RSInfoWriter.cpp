@@ -15,11 +15,17 @@
  */
 
 //===----------------------------------------------------------------------===//
-// This file implements RSInfo::write()
+// This file implements RSInfo::write() and its in-memory variant
 //===----------------------------------------------------------------------===//
 
 #include "bcc/Renderscript/RSInfo.h"
 
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+
 #include "bcc/Support/Log.h"
 #include "bcc/Support/OutputFile.h"
 
@@ -27,116 +33,32 @@ using namespace bcc;
 
 namespace {
 
-template<typename ItemType, typename ItemContainer> inline bool
-helper_adapt_list_item(ItemType &pResult, const RSInfo &pInfo,
-                       const typename ItemContainer::const_iterator &pItem);
-
-
-template<> inline bool
-helper_adapt_list_item<rsinfo::PragmaItem, RSInfo::PragmaListTy>(
-    rsinfo::PragmaItem &pResult,
-    const RSInfo &pInfo,
-    const RSInfo::PragmaListTy::const_iterator &pItem) {
-  pResult.key = pInfo.getStringIdxInPool(pItem->first);
-  pResult.value = pInfo.getStringIdxInPool(pItem->second);
-
-  if (pResult.key == rsinfo::gInvalidStringIndex) {
-    ALOGE("RS pragma list contains invalid string '%s' for key.", pItem->first);
-    return false;
-  }
-
-  if (pResult.value == rsinfo::gInvalidStringIndex) {
-    ALOGE("RS pragma list contains invalid string '%s' for value.",
-          pItem->second);
-    return false;
-  }
-
-  return true;
-}
-
-template<> inline bool
-helper_adapt_list_item<rsinfo::ObjectSlotItem, RSInfo::ObjectSlotListTy>(
-    rsinfo::ObjectSlotItem &pResult,
-    const RSInfo &pInfo,
-    const RSInfo::ObjectSlotListTy::const_iterator &pItem) {
-  pResult.slot = *pItem;
-  return true;
-}
-
-template<> inline bool
-helper_adapt_list_item<rsinfo::ExportVarNameItem, RSInfo::ExportVarNameListTy>(
-    rsinfo::ExportVarNameItem &pResult,
-    const RSInfo &pInfo,
-    const RSInfo::ExportVarNameListTy::const_iterator &pItem) {
-  pResult.name = pInfo.getStringIdxInPool(*pItem);
-
-  if (pResult.name == rsinfo::gInvalidStringIndex) {
-    ALOGE("RS export vars contains invalid string '%s' for name.", *pItem);
-    return false;
-  }
-
-  return true;
-}
-
-template<> inline bool
-helper_adapt_list_item<rsinfo::ExportFuncNameItem,
-                       RSInfo::ExportFuncNameListTy>(
-    rsinfo::ExportFuncNameItem &pResult,
-    const RSInfo &pInfo,
-    const RSInfo::ExportFuncNameListTy::const_iterator &pItem) {
-  pResult.name = pInfo.getStringIdxInPool(*pItem);
-
-  if (pResult.name == rsinfo::gInvalidStringIndex) {
-    ALOGE("RS export funcs contains invalid string '%s' for name.", *pItem);
-    return false;
+template<typename ItemType>
+inline bool helper_write_list(OutputFile &pOutput,
+                              const rsinfo::ListHeader &pHeader,
+                              const rsinfo::ItemList<ItemType> &pList) {
+  // The items are already in the format of the file.
+  size_t list_size = pList.size() * sizeof(ItemType);
+  if (list_size == 0) {
+    return true;
   }
 
-  return true;
-}
-
-template<> inline bool
-helper_adapt_list_item<rsinfo::ExportForeachFuncItem,
-                       RSInfo::ExportForeachFuncListTy>(
-    rsinfo::ExportForeachFuncItem &pResult,
-    const RSInfo &pInfo,
-    const RSInfo::ExportForeachFuncListTy::const_iterator &pItem) {
-  pResult.name = pInfo.getStringIdxInPool(pItem->first);
-  pResult.signature = pItem->second;
-
-  if (pResult.name == rsinfo::gInvalidStringIndex) {
-    ALOGE("RS export foreach contains invalid string '%s' for name.",
-          pItem->first);
+  if (static_cast<size_t>(pOutput.write(pList.array(), list_size)) !=
+          list_size) {
+    ALOGE("Cannot write out items of %s for RSInfo file %s! (%s)",
+          rsinfo::GetItemTypeName<ItemType>(), pOutput.getName().c_str(),
+          pOutput.getErrorMessage().c_str());
     return false;
   }
 
   return true;
 }
 
-template<typename ItemType, typename ItemContainer>
-inline bool helper_write_list(OutputFile &pOutput,
-                              const RSInfo &pInfo,
-                              const rsinfo::ListHeader &pHeader,
-                              ItemContainer &pList) {
-  ItemType item;
-
-  for (typename ItemContainer::const_iterator item_iter = pList.begin(),
-          item_end = pList.end(); item_iter != item_end; item_iter++) {
-    // Convert each entry in the pList to ItemType.
-    if (!helper_adapt_list_item<ItemType, ItemContainer>(item,
-                                                         pInfo,
-                                                         item_iter)) {
-      return false;
-    }
-    // And write out an item.
-    if (pOutput.write(&item, sizeof(item)) != sizeof(item)) {
-      ALOGE("Cannot write out item of %s for RSInfo file %s! (%s)",
-            rsinfo::GetItemTypeName<ItemType>(), pOutput.getName().c_str(),
-            pOutput.getErrorMessage().c_str());
-      return false;
-    }
-  }
-
-  return true;
+template<typename ItemType>
+inline void helper_append_list(std::string &pResult,
+                               const rsinfo::ItemList<ItemType> &pList) {
+  pResult.append(reinterpret_cast<const char *>(pList.array()),
+                 pList.size() * sizeof(ItemType));
 }
 
 } // end anonymous namespace
@@ -152,7 +74,7 @@ bool RSInfo::write(OutputFile &pOutput) {
   }
 
   // Layout.
-  if (!layout(initial_offset)) {
+  if (!layout(initial_offset, mHeader)) {
     return false;
   }
 
@@ -164,42 +86,116 @@ bool RSInfo::write(OutputFile &pOutput) {
   }
 
   // Write string pool.
-  if (static_cast<size_t>(pOutput.write(mStringPool, mHeader.strPoolSize))
+  if (static_cast<size_t>(pOutput.write(mStrings, mHeader.strPoolSize))
           != mHeader.strPoolSize) {
     ALOGE("Cannot write out the string pool for RSInfo file %s! (%s)",
           output_filename, pOutput.getErrorMessage().c_str());
     return false;
   }
 
+  // Pad the string pool up to the first list.
+  static const char padding[RSINFO_LIST_ALIGNMENT] = { 0 };
+  size_t padding_size = mHeader.pragmaList.offset -
+      (initial_offset + mHeader.headerSize + mHeader.strPoolSize);
+  if ((padding_size > 0) &&
+      (static_cast<size_t>(pOutput.write(padding, padding_size)) !=
+           padding_size)) {
+    ALOGE("Cannot write out the padding for RSInfo file %s! (%s)",
+          output_filename, pOutput.getErrorMessage().c_str());
+    return false;
+  }
+
   // Write pragmaList.
-  if (!helper_write_list<rsinfo::PragmaItem, PragmaListTy>
-        (pOutput, *this, mHeader.pragmaList, mPragmas)) {
+  if (!helper_write_list<rsinfo::PragmaItem>
+        (pOutput, mHeader.pragmaList, mPragmas)) {
     return false;
   }
 
   // Write objectSlotList.
-  if (!helper_write_list<rsinfo::ObjectSlotItem, ObjectSlotListTy>
-        (pOutput, *this, mHeader.objectSlotList, mObjectSlots)) {
+  if (!helper_write_list<rsinfo::ObjectSlotItem>
+        (pOutput, mHeader.objectSlotList, mObjectSlots)) {
     return false;
   }
 
   // Write exportVarNameList.
-  if (!helper_write_list<rsinfo::ExportVarNameItem, ExportVarNameListTy>
-        (pOutput, *this, mHeader.exportVarNameList, mExportVarNames)) {
+  if (!helper_write_list<rsinfo::ExportVarNameItem>
+        (pOutput, mHeader.exportVarNameList, mExportVarNames)) {
     return false;
   }
 
   // Write exportFuncNameList.
-  if (!helper_write_list<rsinfo::ExportFuncNameItem, ExportFuncNameListTy>
-        (pOutput, *this, mHeader.exportFuncNameList, mExportFuncNames)) {
+  if (!helper_write_list<rsinfo::ExportFuncNameItem>
+        (pOutput, mHeader.exportFuncNameList, mExportFuncNames)) {
     return false;
   }
 
   // Write exportForeachFuncList.
-  if (!helper_write_list<rsinfo::ExportForeachFuncItem, ExportForeachFuncListTy>
-        (pOutput, *this, mHeader.exportForeachFuncList, mExportForeachFuncs)) {
+  if (!helper_write_list<rsinfo::ExportForeachFuncItem>
+        (pOutput, mHeader.exportForeachFuncList, mExportForeachFuncs)) {
+    return false;
+  }
+
+  // Write exportSymbolList.
+  if (!helper_write_list<rsinfo::ExportSymbolItem>
+        (pOutput, mHeader.exportSymbolList, mExportSymbols)) {
+    return false;
+  }
+
+  return true;
+}
+
+bool RSInfo::writeToFile(const char *pPath) {
+  // Write to a temporary file in the same directory first so that the rename
+  // below replaces the file atomically. Whoever has the current file mapped
+  // keeps the old contents.
+  const std::string tmp_path = OutputFile::CreateTemporary(pPath);
+  if (tmp_path.empty()) {
     return false;
   }
 
+  {
+    OutputFile output(tmp_path, FileBase::kTruncate);
+    if (output.hasError()) {
+      ALOGE("Failed to open the info file %s for write! (%s)",
+            tmp_path.c_str(), output.getErrorMessage().c_str());
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+
+    if (!write(output)) {
+      ::unlink(tmp_path.c_str());
+      return false;
+    }
+  }
+
+  if (::rename(tmp_path.c_str(), pPath) != 0) {
+    ALOGE("Failed to rename %s to %s! (%s)", tmp_path.c_str(), pPath,
+          ::strerror(errno));
+    ::unlink(tmp_path.c_str());
+    return false;
+  }
+
+  return true;
+}
+
+bool RSInfo::write(std::string &pResult) const {
+  // Lay the info out as if it was the only thing in a file. The header of the
+  // info itself is left untouched.
+  rsinfo::Header header = mHeader;
+  if (!layout(0, header)) {
+    return false;
+  }
+
+  size_t begin = pResult.size();
+  pResult.append(reinterpret_cast<const char *>(&header), sizeof(header));
+  pResult.append(mStrings, header.strPoolSize);
+  pResult.resize(begin + header.pragmaList.offset, '\0');
+  helper_append_list(pResult, mPragmas);
+  helper_append_list(pResult, mObjectSlots);
+  helper_append_list(pResult, mExportVarNames);
+  helper_append_list(pResult, mExportFuncNames);
+  helper_append_list(pResult, mExportForeachFuncs);
+  helper_append_list(pResult, mExportSymbols);
+
   return true;
 }
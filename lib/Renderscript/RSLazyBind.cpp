@@ -0,0 +1,237 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Assert.h"
+#include "bcc/Renderscript/RSTransforms.h"
+
+#include <vector>
+
+#include <llvm/IR/DataLayout.h>
+#include <llvm/IR/DerivedTypes.h>
+#include <llvm/IR/Function.h>
+#include <llvm/IR/Instructions.h>
+#include <llvm/IR/IRBuilder.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+#include <llvm/IR/Type.h>
+
+#include "bcc/Renderscript/RSExecutable.h"
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+namespace {
+
+/* RSLazyBindPass - This pass routes the direct calls to the functions defined
+ * outside the script (i.e., in the Renderscript runtime) through a table of
+ * function pointers. Each entry initially points to a stub which asks the
+ * loader to resolve the callee by name (through the hook the loader stores in
+ * .rs.lazy.hook), patches the entry and forwards the call. Imports only used
+ * on rarely executed paths are therefore never looked up. Other uses of the
+ * imports (e.g., taking their addresses) are left intact and are still
+ * resolved when the script is loaded.
+ */
+class RSLazyBindPass : public llvm::ModulePass {
+private:
+  static char ID;
+
+  llvm::Module *M;
+  llvm::LLVMContext *C;
+
+  llvm::GlobalVariable *HookGV;
+  llvm::GlobalVariable *ContextGV;
+
+  // Alignment of the slots. Atomic accesses need it spelled out.
+  unsigned SlotAlignment;
+
+  // Return true if the calls to F can be bound lazily.
+  static bool isLazyBindable(const llvm::Function &F) {
+    if (!F.isDeclaration() || F.isIntrinsic() || F.isVarArg() ||
+        F.hasExternalWeakLinkage() || F.use_empty()) {
+      return false;
+    }
+
+    // Parameters passed in memory are copied again when the stub forwards
+    // the call. Leave them bound eagerly.
+    for (llvm::Function::const_arg_iterator A = F.arg_begin(),
+             AE = F.arg_end(); A != AE; ++A) {
+      if (A->hasByValAttr() || A->hasInAllocaAttr()) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Create the stub which binds F on its first call and store it in the
+  // initializer of SlotGV.
+  llvm::Function *createStub(llvm::Function *F, llvm::GlobalVariable *SlotGV) {
+    llvm::Function *Stub =
+        llvm::Function::Create(F->getFunctionType(),
+                               llvm::GlobalValue::InternalLinkage,
+                               F->getName() + ".rs.lazy.stub", M);
+    Stub->setAttributes(F->getAttributes());
+    Stub->setCallingConv(F->getCallingConv());
+
+    llvm::BasicBlock *Entry = llvm::BasicBlock::Create(*C, "entry", Stub);
+    llvm::IRBuilder<> Builder(Entry);
+
+    // Ask the loader for the address of F. The hook aborts if it cannot be
+    // found, in the same way the eager binding fails the load.
+    llvm::Value *Hook = Builder.CreateLoad(HookGV);
+    llvm::Value *Context = Builder.CreateLoad(ContextGV);
+    llvm::Value *Name = Builder.CreateGlobalStringPtr(F->getName());
+    llvm::Value *Addr = Builder.CreateCall2(Hook, Context, Name);
+    llvm::Value *Callee = Builder.CreateBitCast(Addr, F->getType());
+
+    // Racing stubs on other threads store the same address. The store is
+    // atomic so that the callers never see a torn pointer. The callee is
+    // runtime code which was there before the script was loaded, so no
+    // ordering is required.
+    llvm::StoreInst *Store = Builder.CreateStore(Callee, SlotGV);
+    Store->setAtomic(llvm::Monotonic);
+    Store->setAlignment(SlotAlignment);
+
+    std::vector<llvm::Value *> Args;
+    for (llvm::Function::arg_iterator A = Stub->arg_begin(),
+             AE = Stub->arg_end(); A != AE; ++A) {
+      Args.push_back(A);
+    }
+    llvm::CallInst *Call = Builder.CreateCall(Callee, Args);
+    Call->setAttributes(F->getAttributes());
+    Call->setCallingConv(F->getCallingConv());
+    Call->setTailCall();
+
+    if (Stub->getReturnType()->isVoidTy()) {
+      Builder.CreateRetVoid();
+    } else {
+      Builder.CreateRet(Call);
+    }
+
+    SlotGV->setInitializer(Stub);
+    return Stub;
+  }
+
+  // Collect the direct calls to F into Calls.
+  static void findCalls(llvm::Function *F,
+                        std::vector<llvm::CallInst *> &Calls) {
+    for (llvm::Value::use_iterator U = F->use_begin(), UE = F->use_end();
+         U != UE; ++U) {
+      llvm::CallInst *Call = llvm::dyn_cast<llvm::CallInst>(U->getUser());
+      if ((Call != NULL) && (Call->getCalledValue() == F)) {
+        Calls.push_back(Call);
+      }
+    }
+  }
+
+  // Route Calls through SlotGV. The loads pair with the store in the stub.
+  void rewriteCalls(const std::vector<llvm::CallInst *> &Calls,
+                    llvm::GlobalVariable *SlotGV) {
+    for (size_t i = 0; i < Calls.size(); i++) {
+      llvm::LoadInst *Callee = new llvm::LoadInst(SlotGV, "", Calls[i]);
+      Callee->setAtomic(llvm::Monotonic);
+      Callee->setAlignment(SlotAlignment);
+      Calls[i]->setCalledFunction(Callee);
+    }
+  }
+
+public:
+  RSLazyBindPass()
+      : ModulePass(ID), M(NULL), C(NULL), HookGV(NULL), ContextGV(NULL),
+        SlotAlignment(0) {
+  }
+
+  virtual bool runOnModule(llvm::Module &Module) {
+    M = &Module;
+    C = &Module.getContext();
+
+    // The imports with direct calls, and the calls. Nothing is emitted for
+    // an import only used otherwise.
+    std::vector<llvm::Function *> Imports;
+    std::vector<std::vector<llvm::CallInst *> > ImportCalls;
+    for (llvm::Module::iterator F = M->begin(), FE = M->end(); F != FE; ++F) {
+      if (!isLazyBindable(*F)) {
+        continue;
+      }
+      std::vector<llvm::CallInst *> Calls;
+      findCalls(F, Calls);
+      if (!Calls.empty()) {
+        Imports.push_back(F);
+        ImportCalls.push_back(Calls);
+      }
+    }
+
+    if (Imports.empty()) {
+      return false;
+    }
+
+    llvm::DataLayout DL(M);
+    SlotAlignment = DL.getPointerABIAlignment();
+
+    // i8 *(*.rs.lazy.hook)(i8 *context, const i8 *name) and its context. Both
+    // are set by the loader.
+    llvm::Type *Int8PtrTy = llvm::Type::getInt8PtrTy(*C);
+    llvm::Type *HookArgTys[] = { Int8PtrTy, Int8PtrTy };
+    llvm::FunctionType *HookTy =
+        llvm::FunctionType::get(Int8PtrTy, HookArgTys, false);
+    HookGV = new llvm::GlobalVariable(
+        *M, HookTy->getPointerTo(), false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantPointerNull::get(HookTy->getPointerTo()),
+        RSExecutable::LazyBindHookName);
+    ContextGV = new llvm::GlobalVariable(
+        *M, Int8PtrTy, false, llvm::GlobalValue::ExternalLinkage,
+        llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(Int8PtrTy)),
+        RSExecutable::LazyBindContextName);
+
+    for (size_t i = 0; i < Imports.size(); i++) {
+      llvm::Function *F = Imports[i];
+      llvm::GlobalVariable *SlotGV = new llvm::GlobalVariable(
+          *M, F->getType(), false, llvm::GlobalValue::InternalLinkage,
+          NULL, F->getName() + ".rs.lazy.slot");
+      SlotGV->setAlignment(SlotAlignment);
+      createStub(F, SlotGV);
+      rewriteCalls(ImportCalls[i], SlotGV);
+    }
+
+    // Number of imports bound lazily. The loader reports how many of them
+    // are never called.
+    llvm::Type *Int32Ty = llvm::Type::getInt32Ty(*C);
+    new llvm::GlobalVariable(*M, Int32Ty, true,
+                             llvm::GlobalValue::ExternalLinkage,
+                             llvm::ConstantInt::get(Int32Ty, Imports.size()),
+                             RSExecutable::LazyBindCountName);
+
+    return true;
+  }
+
+  virtual const char *getPassName() const {
+    return "Renderscript Lazy Binding";
+  }
+
+};  // end RSLazyBindPass
+
+}  // end anonymous namespace
+
+char RSLazyBindPass::ID = 0;
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSLazyBindPass() {
+  return new RSLazyBindPass();
+}
+
+}  // end namespace bcc
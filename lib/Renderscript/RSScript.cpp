@@ -16,6 +16,12 @@
 
 #include "bcc/Renderscript/RSScript.h"
 
+#include <new>
+
+#include <llvm/IR/Module.h>
+
+#include "bcinfo/MetadataExtractor.h"
+
 #include "bcc/Assert.h"
 #include "bcc/Renderscript/RSInfo.h"
 #include "bcc/Source.h"
@@ -38,6 +44,8 @@ bool RSScript::LinkRuntime(RSScript &pScript, const char *core_lib) {
   if (NULL != pScript.mLinkRuntimeCallback) {
     pScript.mLinkRuntimeCallback(&pScript,
         &pScript.getSource().getModule(), &libclcore_source->getModule());
+    // The callback is free to rewrite the metadata of the module.
+    pScript.invalidateMetadata();
   }
 
   if (!pScript.getSource().merge(*libclcore_source,
@@ -53,11 +61,41 @@ bool RSScript::LinkRuntime(RSScript &pScript, const char *core_lib) {
 RSScript::RSScript(Source &pSource)
   : Script(pSource), mInfo(NULL), mCompilerVersion(0),
     mOptimizationLevel(kOptLvl3), mLinkRuntimeCallback(NULL),
-    mEmbedInfo(false) { }
+    mEmbedInfo(false), mLazyBinding(false), mExecutionCounters(false),
+    mAccessTrace(false), mMetadata(NULL) { }
 
 bool RSScript::doReset() {
   mInfo = NULL;
+  invalidateMetadata();
   mCompilerVersion = 0;
   mOptimizationLevel = kOptLvl3;
   return true;
 }
+
+const bcinfo::MetadataExtractor *RSScript::getMetadata() {
+  if (mMetadata != NULL) {
+    return mMetadata;
+  }
+
+  const llvm::Module &module = getSource().getModule();
+  mMetadata = new (std::nothrow) bcinfo::MetadataExtractor(&module);
+  if (mMetadata == NULL) {
+    ALOGE("Out of memory when extract the metadata of %s!",
+          module.getModuleIdentifier().c_str());
+    return NULL;
+  }
+
+  if (!mMetadata->extract()) {
+    ALOGE("Could not extract metadata from module %s!",
+          module.getModuleIdentifier().c_str());
+    invalidateMetadata();
+    return NULL;
+  }
+
+  return mMetadata;
+}
+
+void RSScript::invalidateMetadata() {
+  delete mMetadata;
+  mMetadata = NULL;
+}
@@ -0,0 +1,206 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Renderscript/RSScriptLoadBatch.h"
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <new>
+
+#include <llvm/ADT/SmallString.h>
+#include <llvm/Support/Path.h>
+
+#include "bcc/Renderscript/RSCompilerDriver.h"
+#include "bcc/Renderscript/RSExecutable.h"
+#include "bcc/Renderscript/RSInfo.h"
+#include "bcc/Support/Log.h"
+
+#include <utils/String8.h>
+
+using namespace bcc;
+
+namespace {
+
+// Loading is mostly bound by I/O and the serialized relocations. More
+// threads than this don't help.
+const unsigned gMaxLoaderThreads = 4;
+
+void ReadaheadFile(const char *pPath) {
+#if defined(POSIX_FADV_WILLNEED)
+  int fd = ::open(pPath, O_RDONLY);
+  if (fd < 0) {
+    // The script will fail to load later. Leave the error to be reported
+    // there.
+    return;
+  }
+  // The pages stay in the page cache after the file is closed.
+  ::posix_fadvise(fd, 0, 0, POSIX_FADV_WILLNEED);
+  ::close(fd);
+#endif
+  return;
+}
+
+} // end anonymous namespace
+
+RSScriptLoadBatch::RSScriptLoadBatch(SymbolResolverProxy &pResolver)
+  : mResolver(pResolver), mNextItem(0) {
+  pthread_mutex_init(&mItemLock, NULL);
+  pthread_cond_init(&mItemDone, NULL);
+}
+
+void RSScriptLoadBatch::Readahead(const RSScriptLoadRequest &pRequest) {
+  if ((pRequest.cacheDir == NULL) || (pRequest.resName == NULL)) {
+    return;
+  }
+
+  // Same as the path used by RSCompilerDriver::loadScript().
+  llvm::SmallString<80> output_path(pRequest.cacheDir);
+  llvm::sys::path::append(output_path, pRequest.resName);
+  llvm::sys::path::replace_extension(output_path, ".o");
+
+  ReadaheadFile(output_path.c_str());
+  ReadaheadFile(RSInfo::GetPath(output_path.c_str()).string());
+  return;
+}
+
+void *RSScriptLoadBatch::WorkerMain(void *pBatch) {
+  reinterpret_cast<RSScriptLoadBatch *>(pBatch)->runWorker();
+  return NULL;
+}
+
+void RSScriptLoadBatch::runWorker() {
+  while (true) {
+    size_t idx = __sync_fetch_and_add(&mNextItem, 1);
+    if (idx >= mItems.size()) {
+      break;
+    }
+
+    // mItems is not resized after the workers are started. Reading the
+    // request needs no lock.
+    const RSScriptLoadRequest &request = mItems[idx].request;
+    RSExecutable *result =
+        RSCompilerDriver::loadScriptImpl(request.cacheDir, request.resName,
+                                         request.bitcode, request.bitcodeSize,
+                                         request.expectedCompileCommandLine,
+                                         mResolver);
+
+    pthread_mutex_lock(&mItemLock);
+    mItems.editItemAt(idx).result = result;
+    mItems.editItemAt(idx).done = true;
+    pthread_cond_broadcast(&mItemDone);
+    pthread_mutex_unlock(&mItemLock);
+  }
+  return;
+}
+
+RSScriptLoadBatch *RSScriptLoadBatch::Start(const RSScriptLoadRequest *pRequests,
+                                            size_t pNumRequests,
+                                            SymbolResolverProxy &pResolver,
+                                            unsigned pMaxThreads) {
+  if ((pRequests == NULL) && (pNumRequests > 0)) {
+    ALOGE("No request supplied to RSScriptLoadBatch::Start()!");
+    return NULL;
+  }
+
+  RSScriptLoadBatch *result = new (std::nothrow) RSScriptLoadBatch(pResolver);
+  if (result == NULL) {
+    ALOGE("Out of memory when create the batch to load %u scripts!",
+          static_cast<unsigned>(pNumRequests));
+    return NULL;
+  }
+
+  result->mItems.setCapacity(pNumRequests);
+  for (size_t i = 0; i < pNumRequests; i++) {
+    Item item = { pRequests[i], NULL, false, false };
+    result->mItems.push(item);
+  }
+
+  // Start the reads of all the files before any of them is needed.
+  for (size_t i = 0; i < pNumRequests; i++) {
+    Readahead(pRequests[i]);
+  }
+
+  unsigned num_threads = pMaxThreads;
+  if (num_threads == 0) {
+    long num_cpus = ::sysconf(_SC_NPROCESSORS_ONLN);
+    num_threads = (num_cpus > 0) ? static_cast<unsigned>(num_cpus) : 1;
+    if (num_threads > gMaxLoaderThreads) {
+      num_threads = gMaxLoaderThreads;
+    }
+  }
+  if (num_threads > pNumRequests) {
+    num_threads = pNumRequests;
+  }
+
+  for (unsigned i = 0; i < num_threads; i++) {
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, WorkerMain, result) != 0) {
+      ALOGW("Failed to start the thread #%u to load scripts! Continue with %u "
+            "thread(s).", i, i);
+      break;
+    }
+    result->mThreads.push(thread);
+  }
+
+  // Load the scripts on the caller's thread if no worker could be started.
+  if (result->mThreads.isEmpty()) {
+    result->runWorker();
+  }
+
+  return result;
+}
+
+RSExecutable *RSScriptLoadBatch::wait(size_t pIdx) {
+  if (pIdx >= mItems.size()) {
+    ALOGE("Invalid index %u to RSScriptLoadBatch with %u script(s)!",
+          static_cast<unsigned>(pIdx), static_cast<unsigned>(mItems.size()));
+    return NULL;
+  }
+
+  pthread_mutex_lock(&mItemLock);
+  while (!mItems[pIdx].done) {
+    pthread_cond_wait(&mItemDone, &mItemLock);
+  }
+
+  RSExecutable *result = NULL;
+  Item &item = mItems.editItemAt(pIdx);
+  if (!item.taken) {
+    result = item.result;
+    item.taken = true;
+  } else {
+    ALOGE("Result of the script #%u (%s) has been taken!",
+          static_cast<unsigned>(pIdx), item.request.resName);
+  }
+  pthread_mutex_unlock(&mItemLock);
+
+  return result;
+}
+
+RSScriptLoadBatch::~RSScriptLoadBatch() {
+  for (size_t i = 0; i < mThreads.size(); i++) {
+    pthread_join(mThreads[i], NULL);
+  }
+
+  for (size_t i = 0; i < mItems.size(); i++) {
+    if (!mItems[i].taken) {
+      delete mItems[i].result;
+    }
+  }
+
+  pthread_cond_destroy(&mItemDone);
+  pthread_mutex_destroy(&mItemLock);
+}
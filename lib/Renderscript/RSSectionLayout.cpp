@@ -0,0 +1,85 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Renderscript/RSTransforms.h"
+
+#include <llvm/IR/GlobalVariable.h>
+#include <llvm/IR/Module.h>
+#include <llvm/Pass.h>
+
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+namespace {
+
+/* RSSectionLayoutPass - This pass reduces the number of sections in the
+ * object emitted for a script. librsloader places every allocated section of
+ * a relocatable object in memory of its own, so each section costs a mapping
+ * and the protection calls on it at load time, and scatters the read-only
+ * data referenced by the code.
+ *
+ * The code generator puts the constants with unnamed_addr into mergeable
+ * sections by their size and kind (.rodata.cst4, .rodata.cst8, .rodata.str1.1,
+ * etc.) for the linker to merge the duplicates. Nothing merges them when the
+ * object is loaded directly. Dropping unnamed_addr on them lands all of them in
+ * the single .rodata instead.
+ *
+ * This must run after the LTO passes, which merge the identical constants in
+ * the module by unnamed_addr themselves.
+ */
+class RSSectionLayoutPass : public llvm::ModulePass {
+private:
+  static char ID;
+
+public:
+  RSSectionLayoutPass() : ModulePass(ID) { }
+
+  virtual bool runOnModule(llvm::Module &M) {
+    unsigned NumMoved = 0;
+
+    for (llvm::Module::global_iterator GI = M.global_begin(),
+             GE = M.global_end(); GI != GE; ++GI) {
+      if (GI->isDeclaration() || !GI->isConstant() || GI->hasSection() ||
+          !GI->hasUnnamedAddr()) {
+        continue;
+      }
+      GI->setUnnamedAddr(false);
+      NumMoved++;
+    }
+
+    ALOGV("Moved %u constants to .rodata.", NumMoved);
+    return (NumMoved > 0);
+  }
+
+  virtual const char *getPassName() const {
+    return "Renderscript Section Layout";
+  }
+
+};  // end RSSectionLayoutPass
+
+}  // end anonymous namespace
+
+char RSSectionLayoutPass::ID = 0;
+
+namespace bcc {
+
+llvm::ModulePass *
+createRSSectionLayoutPass() {
+  return new RSSectionLayoutPass();
+}
+
+}  // end namespace bcc
@@ -27,6 +27,7 @@ libbcc_support_SRC_FILES := \
   FileBase.cpp \
   Initialization.cpp \
   InputFile.cpp \
+  LoadStats.cpp \
   OutputFile.cpp \
   Sha1Util.cpp \
   sha1.c \
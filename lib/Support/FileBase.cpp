@@ -244,21 +244,29 @@ android::FileMap *FileBase::createMap(off_t pOffset, size_t pLength,
 }
 
 size_t FileBase::getSize() {
-  if (mFD < 0 || hasError()) {
+  struct stat file_stat;
+  if (!getStat(file_stat)) {
     return static_cast<size_t>(-1);
   }
 
-  struct stat file_stat;
+  return file_stat.st_size;
+}
+
+bool FileBase::getStat(struct stat &pResult) {
+  if (mFD < 0 || hasError()) {
+    return false;
+  }
+
   do {
-    if (::fstat(mFD, &file_stat) == 0) {
+    if (::fstat(mFD, &pResult) == 0) {
       break;
     } else if (errno != EINTR) {
       detectError();
-      return static_cast<size_t>(-1);
+      return false;
     }
   } while (true);
 
-  return file_stat.st_size;
+  return true;
 }
 
 off_t FileBase::seek(off_t pOffset) {
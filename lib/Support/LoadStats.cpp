@@ -0,0 +1,137 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "bcc/Support/LoadStats.h"
+
+#include <pthread.h>
+#include <time.h>
+
+#include "bcc/Support/Log.h"
+
+using namespace bcc;
+
+namespace {
+
+// Guards gProcessTotal.
+pthread_mutex_t gProcessTotalLock = PTHREAD_MUTEX_INITIALIZER;
+LoadStats gProcessTotal;
+
+uint64_t GetMonotonicTime() {
+  struct timespec ts;
+  if (::clock_gettime(CLOCK_MONOTONIC, &ts) != 0) {
+    return 0;
+  }
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
+
+} // end anonymous namespace
+
+LoadStats::Timer::Timer() : mStart(GetMonotonicTime()) { }
+
+uint64_t LoadStats::Timer::elapsed() const {
+  return GetMonotonicTime() - mStart;
+}
+
+void LoadStats::Timer::restart() {
+  mStart = GetMonotonicTime();
+}
+
+LoadStats::LoadStats() {
+  reset();
+}
+
+void LoadStats::reset() {
+  mNumLoads = 0;
+  mNumMappings = 0;
+  for (unsigned i = 0; i < kNumPhases; i++) {
+    mTimes[i] = 0;
+  }
+  for (unsigned i = 0; i < kNumMemoryKinds; i++) {
+    mBytes[i] = 0;
+  }
+}
+
+void LoadStats::accumulate(const LoadStats &pOther) {
+  mNumLoads += pOther.mNumLoads;
+  mNumMappings += pOther.mNumMappings;
+  for (unsigned i = 0; i < kNumPhases; i++) {
+    mTimes[i] += pOther.mTimes[i];
+  }
+  for (unsigned i = 0; i < kNumMemoryKinds; i++) {
+    mBytes[i] += pOther.mBytes[i];
+  }
+}
+
+uint64_t LoadStats::getTotalTime() const {
+  uint64_t total = 0;
+  for (unsigned i = 0; i < kNumPhases; i++) {
+    total += mTimes[i];
+  }
+  return total;
+}
+
+const char *LoadStats::GetPhaseName(Phase pPhase) {
+  switch (pPhase) {
+    case kLockPhase:          return "lock";
+    case kFileIOPhase:        return "file I/O";
+    case kSHA1Phase:          return "SHA-1";
+    case kInfoParsePhase:     return "RS info parse";
+    case kSectionCopyPhase:   return "section copy";
+    case kRelocationPhase:    return "relocation";
+    case kSymbolLookupPhase:  return "symbol lookup";
+    default:                  return "(unknown)";
+  }
+}
+
+const char *LoadStats::GetMemoryKindName(MemoryKind pKind) {
+  switch (pKind) {
+    case kTextMemory:         return "text";
+    case kDataMemory:         return "data";
+    case kBSSMemory:          return "bss";
+    case kRelocationMemory:   return "relocation";
+    case kDebugMemory:        return "debug";
+    default:                  return "(unknown)";
+  }
+}
+
+void LoadStats::dump(const char *pTitle) const {
+  ALOGV("%s: %u load(s) in %llu us", pTitle, mNumLoads,
+        static_cast<unsigned long long>(getTotalTime() / 1000));
+  for (unsigned i = 0; i < kNumPhases; i++) {
+    ALOGV("\t%-16s %10llu us", GetPhaseName(static_cast<Phase>(i)),
+          static_cast<unsigned long long>(mTimes[i] / 1000));
+  }
+  for (unsigned i = 0; i < kNumMemoryKinds; i++) {
+    ALOGV("\t%-16s %10u bytes", GetMemoryKindName(static_cast<MemoryKind>(i)),
+          static_cast<unsigned>(mBytes[i]));
+  }
+  ALOGV("\t%-16s %10u", "mappings", mNumMappings);
+  return;
+}
+
+void LoadStats::AddToProcessTotal(const LoadStats &pStats) {
+  pthread_mutex_lock(&gProcessTotalLock);
+  gProcessTotal.accumulate(pStats);
+  pthread_mutex_unlock(&gProcessTotalLock);
+  return;
+}
+
+LoadStats LoadStats::GetProcessTotal() {
+  pthread_mutex_lock(&gProcessTotalLock);
+  LoadStats result = gProcessTotal;
+  pthread_mutex_unlock(&gProcessTotalLock);
+  return result;
+}
@@ -17,6 +17,11 @@
 #include "bcc/Support/OutputFile.h"
 
 #include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
 
 #include <llvm/Support/raw_ostream.h>
 
@@ -97,3 +102,23 @@ llvm::raw_fd_ostream *OutputFile::dup() {
 
   return result;
 }
+
+std::string OutputFile::CreateTemporary(const std::string &pPath) {
+  std::string pattern = pPath + ".XXXXXX";
+  std::vector<char> buf(pattern.begin(), pattern.end());
+  buf.push_back('\0');
+
+  int fd = ::mkstemp(&buf[0]);
+  if (fd < 0) {
+    ALOGE("Failed to create temporary file for %s! (%s)", pPath.c_str(),
+          ::strerror(errno));
+    return std::string();
+  }
+
+  // mkstemp() creates the file with mode 0600. Use the permissions FileBase
+  // gives to a newly created file so the result matches a direct write.
+  ::fchmod(fd, 0644);
+  ::close(fd);
+
+  return std::string(&buf[0]);
+}
@@ -25,6 +25,7 @@
 #include <llvm/Config/config.h>
 #include <llvm/Support/CommandLine.h>
 #include <llvm/Support/FileSystem.h>
+#include <llvm/Support/Format.h>
 #include <llvm/Support/MemoryBuffer.h>
 #include <llvm/Support/PluginLoader.h>
 #include <llvm/Support/raw_ostream.h>
@@ -36,7 +37,9 @@
 #include <bcc/ExecutionEngine/ObjectLoader.h>
 #include <bcc/ExecutionEngine/SymbolResolverProxy.h>
 #include <bcc/ExecutionEngine/SymbolResolvers.h>
+#include <bcc/Renderscript/RSAccessTrace.h>
 #include <bcc/Renderscript/RSCompilerDriver.h>
+#include <bcc/Renderscript/RSExecutionCounters.h>
 #include <bcc/Script.h>
 #include <bcc/Source.h>
 #include <bcc/Support/CompilerConfig.h>
@@ -91,6 +94,26 @@ llvm::cl::opt<bool>
 OptRSDebugContext("rs-debug-ctx",
     llvm::cl::desc("Enable build to work with a RenderScript debug context"));
 
+llvm::cl::opt<bool>
+OptExecutionCounters("enable-counters",
+    llvm::cl::desc("Instrument the script to count the executions of its "
+                   "entry points"));
+
+llvm::cl::opt<bool>
+OptDumpCounters("dump-counters",
+    llvm::cl::desc("Treat the input as the execution counters saved for a "
+                   "script (<object>.counters) and print them"));
+
+llvm::cl::opt<bool>
+OptAccessTrace("enable-access-trace",
+    llvm::cl::desc("Instrument the script to sample the memory accesses of "
+                   "its kernels"));
+
+llvm::cl::opt<bool>
+OptDumpAccessTrace("dump-access-trace",
+    llvm::cl::desc("Treat the input as the access trace saved for a script "
+                   "(<object>.trace) and summarize it"));
+
 //===----------------------------------------------------------------------===//
 // Compiler Options
 //===----------------------------------------------------------------------===//
@@ -114,6 +137,65 @@ void BCCVersionPrinter() {
 
 } // end anonymous namespace
 
+static inline
+int DumpExecutionCounters(const char *pPath) {
+  RSExecutionCounters counters;
+  if (!counters.readFromFile(pPath)) {
+    llvm::errs() << "Failed to read the execution counters from " << pPath
+                 << "!\n";
+    return EXIT_FAILURE;
+  }
+
+  llvm::raw_ostream &os = llvm::outs();
+  for (size_t i = 0; i < counters.size(); i++) {
+    os << llvm::format("%20llu ",
+                       static_cast<unsigned long long>(counters.getValue(i)))
+       << counters.getName(i) << "\n";
+  }
+  return EXIT_SUCCESS;
+}
+
+static inline
+int DumpAccessTrace(const char *pPath) {
+  RSAccessTrace trace;
+  if (!trace.readFromFile(pPath)) {
+    llvm::errs() << "Failed to read the access trace from " << pPath << "!\n";
+    return EXIT_FAILURE;
+  }
+
+  android::Vector<RSAccessTrace::SourceSummary> summaries;
+  trace.summarize(summaries);
+
+  llvm::raw_ostream &os = llvm::outs();
+  os << trace.size() << " samples\n";
+  for (size_t i = 0; i < summaries.size(); i++) {
+    const RSAccessTrace::SourceSummary &summary = summaries[i];
+    os << trace.getSourceName(i) << ":\n";
+    if (summary.numSamples == 0) {
+      os << "  no samples\n";
+      continue;
+    }
+    os << llvm::format("  samples: %llu (with address: %llu)\n",
+                       static_cast<unsigned long long>(summary.numSamples),
+                       static_cast<unsigned long long>(summary.numAddressed))
+       << llvm::format("  x: [%u, %u], y: [%u, %u]\n",
+                       summary.minX, summary.maxX, summary.minY, summary.maxY);
+    if (summary.numAddressed == 0) {
+      continue;
+    }
+    if (summary.numStrides > 0) {
+      os << llvm::format("  stride: %lld bytes (%llu of %llu)\n",
+                         static_cast<long long>(summary.stride),
+                         static_cast<unsigned long long>(summary.numStrideHits),
+                         static_cast<unsigned long long>(summary.numStrides));
+    }
+    os << llvm::format("  cache lines: %llu, reused: %llu\n",
+                       static_cast<unsigned long long>(summary.numCacheLines),
+                       static_cast<unsigned long long>(summary.numReused));
+  }
+  return EXIT_SUCCESS;
+}
+
 static inline
 bool ConfigCompiler(RSCompilerDriver &pRSCD) {
   RSCompiler *RSC = pRSCD.getCompiler();
@@ -167,6 +249,14 @@ bool ConfigCompiler(RSCompilerDriver &pRSCD) {
     pRSCD.setDebugContext(true);
   }
 
+  if (OptExecutionCounters) {
+    pRSCD.setEnableExecutionCounters(true);
+  }
+
+  if (OptAccessTrace) {
+    pRSCD.setEnableAccessTrace(true);
+  }
+
   if (result != Compiler::kSuccess) {
     llvm::errs() << "Failed to configure the compiler! (detail: "
                  << Compiler::GetErrorString(result) << ")\n";
@@ -182,6 +272,14 @@ int main(int argc, char **argv) {
   std::string commandLine = bcc::getCommandLine(argc, argv);
   init::Initialize();
 
+  if (OptDumpCounters) {
+    return DumpExecutionCounters(OptInputFilename.c_str());
+  }
+
+  if (OptDumpAccessTrace) {
+    return DumpAccessTrace(OptInputFilename.c_str());
+  }
+
   BCCContext context;
   RSCompilerDriver RSCD;
 
@@ -0,0 +1,387 @@
+/*
+ * Copyright 2013, The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//===----------------------------------------------------------------------===//
+// bcc_symhash generates the tables of a bcc::PerfectHashSymbolResolver from a
+// list of symbols. Each line of the input is
+//
+//   <symbol name> [<address expression>]
+//
+// where the address expression defaults to &<symbol name>. Empty lines and
+// lines starting with '#' are ignored. With -bench, it measures the lookup
+// of the listed names against bcc::ArraySymbolResolver instead.
+//===----------------------------------------------------------------------===//
+
+#include <stdint.h>
+#include <sys/time.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <llvm/ADT/StringRef.h>
+#include <llvm/ADT/StringSet.h>
+#include <llvm/Support/CommandLine.h>
+#include <llvm/Support/FileSystem.h>
+#include <llvm/Support/MemoryBuffer.h>
+#include <llvm/Support/ToolOutputFile.h>
+#include <llvm/Support/raw_ostream.h>
+
+#include <bcc/ExecutionEngine/SymbolResolvers.h>
+
+using namespace bcc;
+
+namespace {
+
+llvm::cl::opt<std::string>
+OptInputFilename(llvm::cl::Positional, llvm::cl::ValueRequired,
+                 llvm::cl::desc("<input symbol list>"));
+
+llvm::cl::opt<std::string>
+OptOutputFilename("o", llvm::cl::desc("Specify the output filename"),
+                  llvm::cl::value_desc("filename"), llvm::cl::init("-"));
+
+llvm::cl::opt<std::string>
+OptClassName("class", llvm::cl::desc("Name of the class deriving from "
+                                     "PerfectHashSymbolResolver to generate "
+                                     "the tables for"),
+             llvm::cl::value_desc("class"));
+
+llvm::cl::opt<bool>
+OptBench("bench", llvm::cl::desc("Compare the lookup time of the perfect hash "
+                                 "against the binary search over the "
+                                 "symbols instead of generating the tables"));
+
+llvm::cl::opt<unsigned>
+OptBenchRounds("bench-rounds", llvm::cl::desc("Number of times to look up "
+                                              "every symbol with -bench"),
+               llvm::cl::init(1000));
+
+struct Symbol {
+  std::string name;
+  std::string addr;
+};
+
+bool ReadSymbolList(const std::string &pFilename,
+                    std::vector<Symbol> &pSymbols) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> mb_or_error =
+      llvm::MemoryBuffer::getFileOrSTDIN(pFilename);
+  if (mb_or_error.getError()) {
+    llvm::errs() << "Failed to read " << pFilename << "! ("
+                 << mb_or_error.getError().message() << ")\n";
+    return false;
+  }
+
+  llvm::StringSet<> names;
+  llvm::StringRef rest = mb_or_error.get()->getBuffer();
+  unsigned line_no = 0;
+  while (!rest.empty()) {
+    std::pair<llvm::StringRef, llvm::StringRef> split = rest.split('\n');
+    llvm::StringRef line = split.first.trim();
+    rest = split.second;
+    line_no++;
+
+    if (line.empty() || line.startswith("#")) {
+      continue;
+    }
+
+    std::pair<llvm::StringRef, llvm::StringRef> fields = line.split(' ');
+    Symbol symbol;
+    symbol.name = fields.first.str();
+    symbol.addr = fields.second.trim().str();
+    if (symbol.addr.empty()) {
+      symbol.addr = "&" + symbol.name;
+    }
+
+    if (!names.insert(symbol.name).second) {
+      llvm::errs() << pFilename << ":" << line_no << ": duplicated symbol "
+                   << symbol.name << "\n";
+      return false;
+    }
+    pSymbols.push_back(symbol);
+  }
+
+  return true;
+}
+
+bool BucketSizeGreater(const std::vector<size_t> &pA,
+                       const std::vector<size_t> &pB) {
+  return (pA.size() > pB.size());
+}
+
+// Build a minimal perfect hash with the hash and displace method. On return,
+// pOrder[i] is the index in pNames of the name placed at slot i and
+// pHashSeeds is the displacement table described in SymbolResolvers.h.
+bool BuildPerfectHash(const std::vector<std::string> &pNames,
+                      std::vector<size_t> &pOrder,
+                      std::vector<int32_t> &pHashSeeds) {
+  const size_t size = pNames.size();
+  const size_t kEmpty = static_cast<size_t>(-1);
+
+  pOrder.assign(size, kEmpty);
+  pHashSeeds.assign(size, 0);
+
+  if (size == 0) {
+    return true;
+  }
+
+  // Place the names into the buckets by the first level hash. Names with the
+  // same full hash can never be told apart by the second level.
+  std::vector<uint32_t> hashes(size);
+  std::vector<std::vector<size_t> > buckets(size);
+  for (size_t i = 0; i < size; i++) {
+    hashes[i] = HashSymbolName(pNames[i].c_str());
+    for (size_t j = 0; j < buckets[hashes[i] % size].size(); j++) {
+      size_t other = buckets[hashes[i] % size][j];
+      if (hashes[other] == hashes[i]) {
+        llvm::errs() << "Symbols " << pNames[other] << " and " << pNames[i]
+                     << " have the same hash!\n";
+        return false;
+      }
+    }
+    buckets[hashes[i] % size].push_back(i);
+  }
+
+  // Process the buckets with the most collisions first, while the most slots
+  // are still available.
+  std::stable_sort(buckets.begin(), buckets.end(), BucketSizeGreater);
+
+  size_t b = 0;
+  for (; (b < size) && (buckets[b].size() > 1); b++) {
+    const std::vector<size_t> &bucket = buckets[b];
+    std::vector<size_t> slots;
+    uint32_t seed = 0;
+
+    // Find a seed which places every name in the bucket into a free slot.
+    size_t item = 0;
+    while (item < bucket.size()) {
+      size_t slot = RehashSymbolName(hashes[bucket[item]], seed) % size;
+      if ((pOrder[slot] != kEmpty) ||
+          (std::find(slots.begin(), slots.end(), slot) != slots.end())) {
+        seed++;
+        if (seed > 0x7fffffffu) {
+          llvm::errs() << "Failed to find the seed for the bucket of "
+                       << pNames[bucket[0]] << "!\n";
+          return false;
+        }
+        item = 0;
+        slots.clear();
+      } else {
+        slots.push_back(slot);
+        item++;
+      }
+    }
+
+    pHashSeeds[hashes[bucket[0]] % size] = seed;
+    for (size_t i = 0; i < bucket.size(); i++) {
+      pOrder[slots[i]] = bucket[i];
+    }
+  }
+
+  // The buckets with only one name refer their slots directly.
+  size_t free_slot = 0;
+  for (; (b < size) && (buckets[b].size() == 1); b++) {
+    while (pOrder[free_slot] != kEmpty) {
+      free_slot++;
+    }
+    size_t name = buckets[b][0];
+    pHashSeeds[hashes[name] % size] = -static_cast<int32_t>(free_slot) - 1;
+    pOrder[free_slot] = name;
+  }
+
+  return true;
+}
+
+void EmitTables(llvm::raw_ostream &pOS, const std::vector<Symbol> &pSymbols,
+                const std::vector<size_t> &pOrder,
+                const std::vector<int32_t> &pHashSeeds) {
+  const std::string &cls = OptClassName;
+
+  pOS << "// Generated by bcc_symhash from " << OptInputFilename
+      << ". DO NOT EDIT.\n\n";
+
+  pOS << "const " << cls << "::SymbolMap " << cls << "::SymbolArray[] = {\n";
+  for (size_t i = 0; i < pOrder.size(); i++) {
+    const Symbol &symbol = pSymbols[pOrder[i]];
+    pOS << "  { \"" << symbol.name << "\", (void *) " << symbol.addr
+        << " },\n";
+  }
+  pOS << "};\n\n";
+
+  pOS << "const int32_t " << cls << "::HashSeeds[] = {";
+  for (size_t i = 0; i < pHashSeeds.size(); i++) {
+    pOS << (((i % 8) == 0) ? "\n  " : " ") << pHashSeeds[i] << ",";
+  }
+  pOS << "\n};\n\n";
+
+  pOS << "const size_t " << cls << "::NumSymbols = " << pOrder.size()
+      << ";\n";
+}
+
+//===----------------------------------------------------------------------===//
+// Benchmark
+//===----------------------------------------------------------------------===//
+class BenchArrayResolver : public ArraySymbolResolver<BenchArrayResolver> {
+public:
+  static SymbolMap *SymbolArray;
+  static size_t NumSymbols;
+
+  BenchArrayResolver() : ArraySymbolResolver<BenchArrayResolver>(true) { }
+};
+
+BenchArrayResolver::SymbolMap *BenchArrayResolver::SymbolArray = NULL;
+size_t BenchArrayResolver::NumSymbols = 0;
+
+class BenchHashResolver :
+    public PerfectHashSymbolResolver<BenchHashResolver> {
+public:
+  static SymbolMap *SymbolArray;
+  static int32_t *HashSeeds;
+  static size_t NumSymbols;
+};
+
+BenchHashResolver::SymbolMap *BenchHashResolver::SymbolArray = NULL;
+int32_t *BenchHashResolver::HashSeeds = NULL;
+size_t BenchHashResolver::NumSymbols = 0;
+
+bool CompareSymbolMapName(const BenchArrayResolver::SymbolMap &pA,
+                          const BenchArrayResolver::SymbolMap &pB) {
+  return (::strcmp(pA.mName, pB.mName) < 0);
+}
+
+// Return the time in microseconds spent on looking up all pNames
+// OptBenchRounds times through pResolver. Return -1 if any lookup failed.
+long long TimeLookups(SymbolResolverInterface &pResolver,
+                      const std::vector<std::string> &pNames) {
+  struct timeval start, end;
+
+  ::gettimeofday(&start, NULL);
+  for (unsigned round = 0; round < OptBenchRounds; round++) {
+    for (size_t i = 0; i < pNames.size(); i++) {
+      if (pResolver.getAddress(pNames[i].c_str()) == NULL) {
+        llvm::errs() << "Failed to look up " << pNames[i] << "!\n";
+        return -1;
+      }
+    }
+  }
+  ::gettimeofday(&end, NULL);
+
+  return ((end.tv_sec - start.tv_sec) * 1000000LL +
+          (end.tv_usec - start.tv_usec));
+}
+
+bool RunBench(const std::vector<std::string> &pNames,
+              const std::vector<size_t> &pOrder,
+              const std::vector<int32_t> &pHashSeeds) {
+  const size_t size = pNames.size();
+
+  // Use the index (plus one, for non-NULL) as the address of each name.
+  std::vector<BenchArrayResolver::SymbolMap> sorted(size);
+  for (size_t i = 0; i < size; i++) {
+    sorted[i].mName = pNames[i].c_str();
+    sorted[i].mAddr = reinterpret_cast<void *>(i + 1);
+  }
+  std::sort(sorted.begin(), sorted.end(), CompareSymbolMapName);
+
+  std::vector<BenchHashResolver::SymbolMap> hashed(size);
+  for (size_t i = 0; i < size; i++) {
+    hashed[i].mName = pNames[pOrder[i]].c_str();
+    hashed[i].mAddr = reinterpret_cast<void *>(pOrder[i] + 1);
+  }
+  std::vector<int32_t> seeds(pHashSeeds);
+
+  BenchArrayResolver::SymbolArray = sorted.data();
+  BenchArrayResolver::NumSymbols = size;
+  BenchHashResolver::SymbolArray = hashed.data();
+  BenchHashResolver::HashSeeds = seeds.data();
+  BenchHashResolver::NumSymbols = size;
+
+  BenchArrayResolver array_resolver;
+  BenchHashResolver hash_resolver;
+
+  // Verify both resolvers agree before timing them.
+  for (size_t i = 0; i < size; i++) {
+    if (array_resolver.getAddress(pNames[i].c_str()) !=
+        hash_resolver.getAddress(pNames[i].c_str())) {
+      llvm::errs() << "Mismatched lookup result for " << pNames[i] << "!\n";
+      return false;
+    }
+  }
+  if (hash_resolver.getAddress("bcc_symhash.not.a.symbol") != NULL) {
+    llvm::errs() << "Lookup of an unknown symbol succeeded!\n";
+    return false;
+  }
+
+  long long array_time = TimeLookups(array_resolver, pNames);
+  long long hash_time = TimeLookups(hash_resolver, pNames);
+  if ((array_time < 0) || (hash_time < 0)) {
+    return false;
+  }
+
+  unsigned long long lookups =
+      static_cast<unsigned long long>(size) * OptBenchRounds;
+  llvm::outs() << "Symbols: " << size << ", lookups: " << lookups << "\n";
+  llvm::outs() << "  ArraySymbolResolver (bsearch): " << array_time << " us\n";
+  llvm::outs() << "  PerfectHashSymbolResolver:     " << hash_time << " us\n";
+
+  return true;
+}
+
+} // end anonymous namespace
+
+int main(int argc, char **argv) {
+  llvm::cl::ParseCommandLineOptions(argc, argv, "perfect hash generator for "
+                                    "bcc::PerfectHashSymbolResolver\n");
+
+  if (!OptBench && OptClassName.empty()) {
+    llvm::errs() << "-class is required to generate the tables!\n";
+    return EXIT_FAILURE;
+  }
+
+  std::vector<Symbol> symbols;
+  if (!ReadSymbolList(OptInputFilename, symbols)) {
+    return EXIT_FAILURE;
+  }
+
+  std::vector<std::string> names;
+  for (size_t i = 0; i < symbols.size(); i++) {
+    names.push_back(symbols[i].name);
+  }
+
+  std::vector<size_t> order;
+  std::vector<int32_t> hash_seeds;
+  if (!BuildPerfectHash(names, order, hash_seeds)) {
+    return EXIT_FAILURE;
+  }
+
+  if (OptBench) {
+    return (RunBench(names, order, hash_seeds) ? EXIT_SUCCESS : EXIT_FAILURE);
+  }
+
+  std::string error_info;
+  llvm::tool_output_file output(OptOutputFilename.c_str(), error_info,
+                                llvm::sys::fs::F_None);
+  if (!error_info.empty()) {
+    llvm::errs() << error_info << '\n';
+    return EXIT_FAILURE;
+  }
+
+  EmitTables(output.os(), symbols, order, hash_seeds);
+  output.keep();
+
+  return EXIT_SUCCESS;
+}